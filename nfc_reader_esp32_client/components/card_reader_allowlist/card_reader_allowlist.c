@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "mbedtls/md.h"
+
+#include "card_reader_allowlist.h"
+
+//#define ALLOWLIST_DEBUG_EN
+
+#ifdef ALLOWLIST_DEBUG_EN
+#define ALLOWLIST_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define ALLOWLIST_DEBUG(fmt, ...)
+#endif
+
+#define ALLOWLIST_SECTOR_SIZE 4096 // Flash erase unit
+
+static const char* TAG = "card_reader_allowlist";
+
+static const esp_partition_t *partition;
+static const uint8_t *mapped; // Whole partition, mapped once
+static spi_flash_mmap_handle_t mapHandle;
+static SemaphoreHandle_t allowlistMutex; // Guards the active snapshot against a switch
+static const allowlist_header_t *active; // Snapshot used for lookups (NULL = none)
+static const allowlist_entry_t *entries; // Entries of the active snapshot
+static int activeSlot = -1;
+static int updateSlot = -1;
+static size_t updateSize;
+
+/**
+* @brief  Get the size of one snapshot slot (half the partition, whole sectors)
+*/
+static size_t allowlist_slotSize() {
+  return (partition->size / ALLOWLIST_SLOTS) & ~(size_t)(ALLOWLIST_SECTOR_SIZE - 1);
+}
+
+/**
+* @brief  Check the snapshot in a slot: header, sorted unique keys and hash
+*
+* @param  slot      Slot number
+*
+* @return Header of the snapshot or NULL if the slot holds no valid snapshot
+*/
+static const allowlist_header_t *allowlist_validate(int slot) {
+  const allowlist_header_t *header = (const allowlist_header_t *)(mapped + slot * allowlist_slotSize());
+  const allowlist_entry_t *list = (const allowlist_entry_t *)(header + 1);
+  uint8_t hash[ALLOWLIST_HASH_LEN];
+
+  if(header->magic != ALLOWLIST_MAGIC || header->version != ALLOWLIST_VERSION || header->entrySize != sizeof(allowlist_entry_t))
+    return NULL;
+  if(header->count > (allowlist_slotSize() - sizeof(allowlist_header_t)) / sizeof(allowlist_entry_t)) {
+    ESP_LOGE(TAG, "Snapshot in slot %d doesn't fit the slot", slot);
+    return NULL;
+  }
+
+  // Binary search relies on the order
+  for(uint32_t i = 1; i < header->count; ++i) {
+    if(memcmp(&list[i - 1], &list[i], ALLOWLIST_KEY_LEN) >= 0) {
+      ESP_LOGE(TAG, "Snapshot in slot %d isn't sorted at entry %u", slot, i);
+      return NULL;
+    }
+  }
+
+  if(mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const unsigned char *)list, header->count * sizeof(allowlist_entry_t), hash) ||
+     memcmp(hash, header->hash, ALLOWLIST_HASH_LEN)) {
+    ESP_LOGE(TAG, "Snapshot in slot %d is corrupted", slot);
+    return NULL;
+  }
+  return header;
+}
+
+/**
+* @brief  Make a slot the snapshot used for lookups
+*/
+static void allowlist_activate(int slot, const allowlist_header_t *header) {
+  xSemaphoreTake(allowlistMutex, portMAX_DELAY);
+  activeSlot = slot;
+  active = header;
+  entries = (const allowlist_entry_t *)(header + 1);
+  xSemaphoreGive(allowlistMutex);
+
+  ESP_LOGI(TAG, "Allowlist #%u with %u entries active (slot %d)", header->sequence, header->count, slot);
+}
+
+/**
+* @brief  Map the allowlist partition and pick the newest valid snapshot
+*
+* @return ESP_OK (also without a snapshot), an error if the partition is missing or can't be mapped
+*/
+esp_err_t allowlist_setup() {
+  const allowlist_header_t *newest = NULL;
+  int newestSlot = -1;
+  esp_err_t err;
+
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ALLOWLIST_PARTITION_LABEL);
+  if(partition == NULL) {
+    ESP_LOGE(TAG, "No \"%s\" partition", ALLOWLIST_PARTITION_LABEL);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  // Lookups read the entries in place through the flash cache
+  err = esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, (const void **)&mapped, &mapHandle);
+  if(err != ESP_OK) {
+    ESP_LOGE(TAG, "Mapping the allowlist failed (%s)", esp_err_to_name(err));
+    return err;
+  }
+
+  allowlistMutex = xSemaphoreCreateMutex();
+  if(allowlistMutex == NULL)
+    return ESP_ERR_NO_MEM;
+
+  for(int slot = 0; slot < ALLOWLIST_SLOTS; ++slot) {
+    const allowlist_header_t *header = allowlist_validate(slot);
+    if(header && (newest == NULL || header->sequence > newest->sequence)) {
+      newest = header;
+      newestSlot = slot;
+    }
+  }
+
+  if(newest)
+    allowlist_activate(newestSlot, newest);
+  else
+    ESP_LOGW(TAG, "No allowlist snapshot, every decision goes to the server");
+  return ESP_OK;
+}
+
+/**
+* @brief  Look a card up in the active snapshot. The entries are binary searched
+*         in flash, nothing is copied.
+*
+* @param  uid       Card ID
+* @param  uidLen    Length of uid
+* @param  data      Card data the decision is bound to
+* @param  dataLen   Length of data
+*
+* @return ALLOWLIST_GRANT or ALLOWLIST_DENY for a valid entry, ALLOWLIST_UNKNOWN
+*         without one (no snapshot, unknown card, outside of the validity or the
+*         clock isn't set for an entry with validity)
+*/
+uint8_t allowlist_lookup(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen) {
+  uint8_t key[ALLOWLIST_KEY_LEN] = {0};
+  uint8_t hash[ALLOWLIST_HASH_LEN];
+  uint8_t decision = ALLOWLIST_UNKNOWN;
+
+  if(uidLen > ALLOWLIST_UID_LEN || mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data, dataLen, hash))
+    return ALLOWLIST_UNKNOWN;
+  key[0] = uidLen;
+  memcpy(&key[1], uid, uidLen);
+  memcpy(&key[1 + ALLOWLIST_UID_LEN], hash, ALLOWLIST_DIGEST_LEN);
+
+  if(allowlistMutex == NULL)
+    return ALLOWLIST_UNKNOWN;
+  xSemaphoreTake(allowlistMutex, portMAX_DELAY);
+  if(active) {
+    uint32_t lo = 0;
+    uint32_t hi = active->count;
+
+    while(lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      int cmp = memcmp(&entries[mid], key, ALLOWLIST_KEY_LEN);
+
+      if(cmp < 0) {
+        lo = mid + 1;
+      }
+      else if(cmp > 0) {
+        hi = mid;
+      }
+      else {
+        const allowlist_entry_t *entry = &entries[mid];
+        time_t now = time(NULL);
+        bool bounded = entry->validFrom || entry->validUntil;
+
+        if(bounded && now < ALLOWLIST_CLOCK_VALID) {
+          ALLOWLIST_DEBUG("Clock not set, entry with validity ignored\n");
+        }
+        else if((entry->validFrom && now < entry->validFrom) || (entry->validUntil && now >= entry->validUntil)) {
+          ALLOWLIST_DEBUG("Entry outside of its validity\n");
+        }
+        else if(entry->decision == ALLOWLIST_GRANT || entry->decision == ALLOWLIST_DENY) {
+          decision = entry->decision;
+        }
+        break;
+      }
+    }
+  }
+  xSemaphoreGive(allowlistMutex);
+
+  return decision;
+}
+
+/**
+* @brief  Get the sequence number of the active snapshot
+*
+* @return Sequence number, 0 without a snapshot
+*/
+uint32_t allowlist_sequence() {
+  uint32_t sequence = 0;
+
+  if(allowlistMutex == NULL)
+    return 0;
+  xSemaphoreTake(allowlistMutex, portMAX_DELAY);
+  if(active)
+    sequence = active->sequence;
+  xSemaphoreGive(allowlistMutex);
+
+  return sequence;
+}
+
+/**
+* @brief  Start writing a new snapshot to the slot lookups don't use
+*
+* @param  size      Size of the snapshot in bytes (header and entries)
+*
+* @return ESP_OK or an error code
+*/
+esp_err_t allowlist_beginUpdate(size_t size) {
+  if(partition == NULL)
+    return ESP_ERR_INVALID_STATE;
+  if(size < sizeof(allowlist_header_t) || size > allowlist_slotSize())
+    return ESP_ERR_INVALID_SIZE;
+
+  updateSlot = (activeSlot + 1) % ALLOWLIST_SLOTS;
+  updateSize = size;
+  return esp_partition_erase_range(partition, updateSlot * allowlist_slotSize(), (size + ALLOWLIST_SECTOR_SIZE - 1) & ~(size_t)(ALLOWLIST_SECTOR_SIZE - 1));
+}
+
+/**
+* @brief  Write a part of the new snapshot, e.g. as it is downloaded
+*
+* @param  offset    Offset in the snapshot
+* @param  data      Snapshot bytes
+* @param  len       Length of data
+*
+* @return ESP_OK or an error code
+*/
+esp_err_t allowlist_writeUpdate(size_t offset, const void *data, size_t len) {
+  if(updateSlot < 0)
+    return ESP_ERR_INVALID_STATE;
+  if(offset + len > updateSize)
+    return ESP_ERR_INVALID_SIZE;
+
+  return esp_partition_write(partition, updateSlot * allowlist_slotSize() + offset, data, len);
+}
+
+/**
+* @brief  Check the new snapshot and switch lookups to it. Snapshots that are
+*         invalid or not newer than the active one are rejected.
+*
+* @return ESP_OK or an error code
+*/
+esp_err_t allowlist_commitUpdate() {
+  const allowlist_header_t *header;
+  int slot = updateSlot;
+
+  if(slot < 0)
+    return ESP_ERR_INVALID_STATE;
+  updateSlot = -1;
+
+  // Flash writes invalidate the cache of the mapped range, the new slot reads back as written
+  header = allowlist_validate(slot);
+  if(header == NULL)
+    return ESP_ERR_INVALID_CRC;
+  if(sizeof(allowlist_header_t) + header->count * sizeof(allowlist_entry_t) > updateSize)
+    return ESP_ERR_INVALID_SIZE;
+  if(active && header->sequence <= active->sequence) {
+    ESP_LOGW(TAG, "Allowlist #%u isn't newer than #%u", header->sequence, active->sequence);
+    return ESP_ERR_INVALID_VERSION;
+  }
+
+  allowlist_activate(slot, header);
+  return ESP_OK;
+}
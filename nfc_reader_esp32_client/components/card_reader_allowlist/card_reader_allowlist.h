@@ -0,0 +1,58 @@
+#ifndef __ALLOWLIST_H__
+#define __ALLOWLIST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// Snapshot of access decisions published by the server, kept in the "allowlist"
+// data partition (see partitions.csv). The partition holds two slots: lookups use
+// the valid snapshot with the highest sequence number while an update is written
+// to the other slot.
+#define ALLOWLIST_PARTITION_LABEL "allowlist"
+#define ALLOWLIST_SLOTS 2
+
+#define ALLOWLIST_MAGIC 0x414C4E46 // "FNLA" little endian
+#define ALLOWLIST_VERSION 1
+#define ALLOWLIST_UID_LEN 8 // Same as CARD_ID_LEN, shorter UIDs are zero padded
+#define ALLOWLIST_DIGEST_LEN 8 // Leading bytes of SHA-256 over the card data
+#define ALLOWLIST_HASH_LEN 32 // SHA-256 over all entries of a snapshot
+#define ALLOWLIST_CLOCK_VALID 1577836800 // 2020-01-01, earlier system time means the clock isn't set
+
+// Results of allowlist_lookup
+#define ALLOWLIST_UNKNOWN 0 // No valid entry, ask the server
+#define ALLOWLIST_GRANT 1
+#define ALLOWLIST_DENY 2
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic; // ALLOWLIST_MAGIC
+  uint16_t version; // ALLOWLIST_VERSION
+  uint16_t entrySize; // sizeof(allowlist_entry_t)
+  uint32_t sequence; // Newer snapshots have higher numbers
+  uint32_t count; // Entries following the header
+  uint32_t published; // Unix time the server built the snapshot
+  uint8_t hash[ALLOWLIST_HASH_LEN]; // SHA-256 over the entries
+} allowlist_header_t;
+
+// Entries are sorted by key (uidLen, uid, digest) in memcmp order, keys are unique
+typedef struct __attribute__((packed)) {
+  uint8_t uidLen;
+  uint8_t uid[ALLOWLIST_UID_LEN];
+  uint8_t digest[ALLOWLIST_DIGEST_LEN];
+  uint8_t decision; // ALLOWLIST_GRANT or ALLOWLIST_DENY
+  uint16_t reserved;
+  uint32_t validFrom; // Unix time, 0 = no lower bound
+  uint32_t validUntil; // Unix time, 0 = no upper bound
+} allowlist_entry_t;
+
+#define ALLOWLIST_KEY_LEN (1 + ALLOWLIST_UID_LEN + ALLOWLIST_DIGEST_LEN)
+
+esp_err_t allowlist_setup();
+uint8_t allowlist_lookup(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen);
+uint32_t allowlist_sequence();
+esp_err_t allowlist_beginUpdate(size_t size);
+esp_err_t allowlist_writeUpdate(size_t offset, const void *data, size_t len);
+esp_err_t allowlist_commitUpdate();
+
+#endif
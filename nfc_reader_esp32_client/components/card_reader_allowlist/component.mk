@@ -0,0 +1 @@
+# Component Makefile
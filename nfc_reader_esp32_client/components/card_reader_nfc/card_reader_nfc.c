@@ -6,10 +6,14 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "pn532.h"
+#include "pn532_trace.h"
 
 #include "card_reader_nfc.h"
 
+// The host build (host_test) defines NFC_NO_DEBUG
+#ifndef NFC_NO_DEBUG
 #define NFC_DEBUG_EN
+#endif
 
 #ifdef NFC_DEBUG_EN
 #define NFC_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
@@ -19,14 +23,98 @@
 
 static const char* TAG = "card_reader_nfc";
 
+// Key that last opened a sector on cards sharing a UID prefix
+typedef struct {
+  uint8_t prefix[NFC_KEY_CACHE_PREFIX_LEN];
+  uint8_t sector;
+  nfc_key_t key;
+  uint32_t used; // Age stamp for LRU replacement (0 = free)
+} nfc_key_cache_t;
+
+static nfc_key_cache_t keyCache[NFC_KEY_CACHE_SIZE];
+static uint32_t keyCacheClock;
+static portMUX_TYPE keyCacheMux = portMUX_INITIALIZER_UNLOCKED; // Shared by all reader tasks
+
+#ifdef NFC_TAP_CACHE_EN
+// Card recently logged by a reader, kept in an open addressing table
+typedef struct {
+  const pn532_t *reader;
+  uint8_t cid[CARD_ID_LEN];
+  uint8_t cidLen; // 0 = slot never used
+  int64_t logged; // Time the card was last logged
+  int64_t seen; // Time the card was last in the field
+} nfc_tap_t;
+
+static nfc_tap_t tapCache[NFC_TAP_CACHE_SIZE];
+static portMUX_TYPE tapCacheMux = portMUX_INITIALIZER_UNLOCKED; // Shared by all reader tasks
+#endif
+
+#ifdef NFC_TRACE_EN
+static pn532_trace_t traces[NFC_READER_COUNT];
+static pn532_t *tracedReaders[NFC_READER_COUNT];
+#endif
+
+// Detection runs in cycles with a rest in between instead of one endless poll
+#if (defined(NFC_AUTOPOLL_EN) && defined(NFC_POWERDOWN_EN)) || (!defined(NFC_AUTOPOLL_EN) && defined(NFC_RF_PROFILE_EN))
+#define NFC_DETECT_CYCLES
+static void nfc_idle(pn532_t *obj, int64_t start);
+#endif
+
 /**
 * @brief  Configure and start communication with PN532 module
 *
 * @param  obj       Pointer to PN532 device descriptor struct
 */
 void nfc_setup(pn532_t *obj) {
-  // Configure pins
-  pn532_spi_init(obj, PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
+  nfc_setupReader(obj, PN532_SS, PN532_IRQ);
+}
+
+/**
+* @brief  Configure and start all NFC_READER_COUNT PN532 modules on the SPI bus
+*
+* @param  objs      Array of NFC_READER_COUNT PN532 device descriptor structs
+*/
+void nfc_setupReaders(pn532_t *objs) {
+  uint8_t ss[NFC_READER_COUNT] = NFC_READER_SS_PINS;
+  uint8_t irq[NFC_READER_COUNT] = NFC_READER_IRQ_PINS;
+
+  for(int i = 0; i < NFC_READER_COUNT; ++i) {
+    nfc_setupReader(&objs[i], ss[i], irq[i]);
+  }
+}
+
+/**
+* @brief  Configure and start communication with one PN532 module on the shared SPI bus
+*
+* @param  obj       Pointer to PN532 device descriptor struct
+* @param  ss        SS pin of the module
+* @param  irq       IRQ pin of the module (PN532_NO_IRQ if not wired)
+*/
+void nfc_setupReader(pn532_t *obj, uint8_t ss, uint8_t irq) {
+  // Configure pins, hardware SPI with DMA and bit-banged SPI as a fallback
+  if(pn532_spi_master_init(obj, PN532_SPI_HOST, PN532_SCK, PN532_MISO, PN532_MOSI, ss) != ESP_OK) {
+    ESP_LOGW(TAG, "SPI host unavailable, falling back to bit-banged SPI");
+    pn532_spi_init(obj, PN532_SCK, PN532_MISO, PN532_MOSI, ss);
+  }
+  // Sleep on the IRQ line instead of polling the status byte when it is wired
+  if(irq != PN532_NO_IRQ && pn532_irq_init(obj, irq) != ESP_OK) {
+    ESP_LOGW(TAG, "PN532 IRQ setup failed, polling status instead");
+  }
+  // Allow several tasks to share the module
+  if(pn532_lock_init(obj) != ESP_OK) {
+    ESP_LOGW(TAG, "PN532 lock setup failed");
+  }
+#ifdef NFC_TRACE_EN
+  // Record the bus traffic from the first frame on
+  for(int i = 0; i < NFC_READER_COUNT; ++i) {
+    if(tracedReaders[i] == NULL || tracedReaders[i] == obj) {
+      tracedReaders[i] = obj;
+      pn532_trace_init(&traces[i]);
+      pn532_trace_attach(obj, &traces[i]);
+      break;
+    }
+  }
+#endif
   pn532_begin(obj);
 
   // Check connection to PN532 and get firmware version
@@ -45,6 +133,29 @@ void nfc_setup(pn532_t *obj) {
   // Configure board to read RFID tags
   pn532_SAMConfig(obj);
 
+#ifdef NFC_RF_PROFILE_EN
+  // Give up on failed activations quickly, see nfc_readCardIds
+  pn532_rf_config_t rfConfig = {
+    .mxRtyATR = 0x01,
+    .mxRtyPSL = 0x01,
+    .mxRtyPassiveActivation = NFC_RF_ACTIVATION_RETRIES,
+    .mxRtyCOM = NFC_RF_COM_RETRIES,
+    .atrResTimeout = NFC_RF_ATR_TIMEOUT,
+    .retryTimeout = NFC_RF_RESPONSE_TIMEOUT,
+    .autoRFCA = false,
+  };
+  if(!pn532_setRFConfig(obj, &rfConfig)) {
+    ESP_LOGW(TAG, "PN532 RF configuration failed");
+  }
+#endif
+
+#ifdef NFC_ASYNC_EN
+  // Hand the module over to its driver task, commands are queued from now on
+  if(pn532_async_start(obj, NFC_ASYNC_QUEUE_LEN, NFC_ASYNC_PRIORITY) != ESP_OK) {
+    ESP_LOGW(TAG, "PN532 driver task setup failed, commands run on the caller");
+  }
+#endif
+
   ESP_LOGI(TAG, "NFC module set up!");
 }
 
@@ -57,23 +168,144 @@ void nfc_setup(pn532_t *obj) {
 * @return Length of card ID or -1 for faliure
 */
 uint32_t nfc_readCardId(pn532_t *obj, log_data_t *logData) {
-  if(pn532_readPassiveTargetID(obj, PN532_MIFARE_ISO14443A, logData->cid, &(logData->cidLen), 0)) {
-    NFC_DEBUG("Found an ISO14443A card\n");
-    NFC_DEBUG("Card ID Length: %d bytes\n", logData->cidLen);
-    NFC_DEBUG("Card ID Value:");
-    for(int i = 0; i < CARD_ID_LEN; ++i)
-    NFC_DEBUG(" %02hhx", logData->cid[i]);
-    NFC_DEBUG("\n");
-
+  if(nfc_readCardIds(obj, logData, 1)) {
     return logData->cidLen;
   }
   else {
     NFC_DEBUG("Card timeout\n");
     return -1;
   }
+}
+
+/**
+* @brief  Save target info reported by the PN532 to log_data_t struct
+*
+* @param  logData   Pointer to struct holding log data
+* @param  cardType  Target type (PN532_AUTOPOLL_*)
+* @param  target    Target activated by the PN532
+*/
+static void nfc_setTarget(log_data_t *logData, uint8_t cardType, pn532_target_t *target) {
+  logData->cardType = cardType;
+  logData->tg = target->tg;
+  logData->cidLen = target->uidLen;
+  logData->target = *target;
+  for(int i = 0; i < target->uidLen; ++i)
+    logData->cid[i] = target->uid[i];
+
+  NFC_DEBUG("Found an ISO14443A card (type %02hhx, Tg %d)\n", logData->cardType, logData->tg);
+  NFC_DEBUG("ATQA: %04x, SAK: %02hhx, ATS: %d bytes\n", target->atqa, target->sak, target->atsLen);
+  NFC_DEBUG("Card ID Length: %d bytes\n", logData->cidLen);
+  NFC_DEBUG("Card ID Value:");
+  for(int i = 0; i < CARD_ID_LEN; ++i)
+  NFC_DEBUG(" %02hhx", logData->cid[i]);
+  NFC_DEBUG("\n");
+}
+
+/**
+* @brief  Print the recorded bus traffic of a reader (NFC_TRACE_EN), see pn532_trace_dump
+*
+* @param  obj       Pointer to PN532 device descriptor struct
+*/
+void nfc_dumpTrace(pn532_t *obj) {
+#ifdef NFC_TRACE_EN
+  for(int i = 0; i < NFC_READER_COUNT; ++i) {
+    if(tracedReaders[i] == obj) {
+      pn532_trace_dump(&traces[i]);
+      return;
+    }
+  }
+#endif
+  ESP_LOGW(TAG, "No bus trace recorded for this reader");
+}
 
+/**
+* @brief  Wait for ISO14443A cards and save IDs of all cards presented together
+*         (up to NFC_MAX_CARDS) in log_data_t structs.
+*
+* @param  obj       Pointer to PN532 device descriptor struct
+* @param  logData   Array of maxCards structs holding log data
+* @param  maxCards  Maximum number of cards to read
+*
+* @return Number of cards found
+*/
+uint8_t nfc_readCardIds(pn532_t *obj, log_data_t *logData, uint8_t maxCards) {
+  uint8_t found = 0;
+  pn532_target_t target;
+  int64_t start = pn532_time_now();
+
+  if(maxCards > NFC_MAX_CARDS)
+    maxCards = NFC_MAX_CARDS;
+
+#ifdef NFC_AUTOPOLL_EN
+  // The PN532 polls by itself, the task sleeps until a target is activated
+  static const uint8_t types[] = NFC_AUTOPOLL_TYPES;
+  pn532_autopoll_t polled[NFC_MAX_CARDS];
+  uint8_t n = pn532_inAutoPoll(obj, NFC_AUTOPOLL_POLLNR, NFC_AUTOPOLL_PERIOD, types, sizeof(types), polled, maxCards, 0);
+#ifdef NFC_DETECT_CYCLES
+  // Each cycle ends after NFC_AUTOPOLL_POLLNR rounds, rest in between
+  while(!n) {
+    nfc_idle(obj, start);
+    start = pn532_time_now();
+    n = pn532_inAutoPoll(obj, NFC_AUTOPOLL_POLLNR, NFC_AUTOPOLL_PERIOD, types, sizeof(types), polled, maxCards, 0);
+  }
+#endif
+  for(int i = 0; i < n; ++i) {
+    if(pn532_autoPollTarget(&polled[i], &target)) {
+      nfc_setTarget(&logData[found++], polled[i].type, &target);
+    }
+  }
+#else
+  pn532_target_t targets[NFC_MAX_CARDS];
+  uint8_t n = pn532_inListPassiveTargets(obj, maxCards, targets, 0);
+#ifdef NFC_DETECT_CYCLES
+  // Each cycle gives up after NFC_RF_ACTIVATION_RETRIES, rest in between
+  while(!n) {
+    nfc_idle(obj, start);
+    start = pn532_time_now();
+    n = pn532_inListPassiveTargets(obj, maxCards, targets, 0);
+  }
+#endif
+  for(int i = 0; i < n; ++i) {
+    target = targets[i];
+    nfc_setTarget(&logData[found++], (target.sak & 0x20) ? PN532_AUTOPOLL_ISO14443_4A : PN532_AUTOPOLL_MIFARE, &target);
+  }
+#endif
+
+  if(found) {
+    ESP_LOGD(TAG, "%d card(s) activated after %lld us", found, (long long)(pn532_time_now() - start));
+#ifdef NFC_POWERDOWN_EN
+    ESP_LOGD(TAG, "Wake-to-UID latency %u us", pn532_wakeLatency(obj));
+#endif
+  }
+  return found;
 }
 
+#ifdef NFC_DETECT_CYCLES
+/**
+* @brief  Rest between detection cycles: PowerDown with NFC_POWERDOWN_EN,
+*         otherwise the RF field is switched off
+*
+* @param  obj       Pointer to PN532 device descriptor struct
+* @param  start     Time the detection cycle started
+*/
+static void nfc_idle(pn532_t *obj, int64_t start) {
+  ESP_LOGD(TAG, "No card, detection cycle gave up after %lld us", (long long)(pn532_time_now() - start));
+#ifdef NFC_POWERDOWN_EN
+  if(pn532_powerDown(obj, NFC_POWERDOWN_WAKEUP, true)) {
+    if(pn532_sleep(obj, NFC_POWERDOWN_MS)) {
+      ESP_LOGD(TAG, "PN532 woken by an external RF field");
+    }
+    // State is retained in PowerDown, no pn532_begin/SAMConfig needed
+    pn532_resume(obj);
+    return;
+  }
+  ESP_LOGW(TAG, "PN532 power down failed");
+#endif
+  pn532_setRFField(obj, false, false);
+  vTaskDelay(NFC_RF_OFF_MS / portTICK_PERIOD_MS);
+}
+#endif
+
 /**
 * @brief  Save Reader ID to log_data_t struct.
 *
@@ -115,31 +347,345 @@ uint8_t nfc_authReadBlock(pn532_t *obj, log_data_t *logData, uint8_t *keyA, uint
 	return 0;
 }
 
+/**
+* @brief  Get the sector a MIFARE Classic block belongs to
+*
+* @param  block     Block number
+*
+* @return Sector number
+*/
+uint8_t nfc_blockSector(uint16_t block) {
+  if(block < NFC_CLASSIC_SMALL_SECTORS * 4)
+    return block / 4;
+  return NFC_CLASSIC_SMALL_SECTORS + (block - NFC_CLASSIC_SMALL_SECTORS * 4) / 16;
+}
+
+/**
+* @brief  Get the first block of a MIFARE Classic sector
+*
+* @param  sector    Sector number
+*
+* @return Block number
+*/
+uint16_t nfc_sectorFirstBlock(uint8_t sector) {
+  if(sector < NFC_CLASSIC_SMALL_SECTORS)
+    return sector * 4;
+  return NFC_CLASSIC_SMALL_SECTORS * 4 + (sector - NFC_CLASSIC_SMALL_SECTORS) * 16;
+}
+
+/**
+* @brief  Get the number of blocks in a MIFARE Classic sector
+*
+* @param  sector    Sector number
+*
+* @return Number of blocks (4 or 16)
+*/
+uint8_t nfc_sectorBlockCount(uint8_t sector) {
+  return sector < NFC_CLASSIC_SMALL_SECTORS ? 4 : 16;
+}
+
+/**
+* @brief  Activate a card again after it dropped out, e.g. after a failed
+*         authentication. Other cards activated with it are released.
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data (card ID to activate)
+*
+* @return true if the card is active again
+*/
+bool nfc_reactivateCard(pn532_t *obj, log_data_t *logData) {
+  pn532_target_t target;
+
+  if(!pn532_reactivateTarget(obj, logData->cid, logData->cidLen, &target, NFC_REACTIVATE_TIMEOUT)) {
+    ESP_LOGE(TAG, "Reactivating the card failed");
+    return false;
+  }
+  logData->tg = target.tg;
+  logData->target = target;
+  return true;
+}
+
+/**
+* @brief  Find the cached key of a sector for cards with the UID prefix of logData
+*
+* @return true if a key was found
+*/
+static bool nfc_keyCacheGet(log_data_t *logData, uint8_t sector, nfc_key_t *key) {
+  bool found = false;
+
+  portENTER_CRITICAL(&keyCacheMux);
+  for(int i = 0; i < NFC_KEY_CACHE_SIZE; ++i) {
+    if(keyCache[i].used && keyCache[i].sector == sector && !memcmp(keyCache[i].prefix, logData->cid, NFC_KEY_CACHE_PREFIX_LEN)) {
+      keyCache[i].used = ++keyCacheClock;
+      *key = keyCache[i].key;
+      found = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&keyCacheMux);
+  return found;
+}
+
+/**
+* @brief  Remember the key that opened a sector, replacing the least recently used entry
+*/
+static void nfc_keyCachePut(log_data_t *logData, uint8_t sector, const nfc_key_t *key) {
+  int slot = 0;
+
+  portENTER_CRITICAL(&keyCacheMux);
+  for(int i = 0; i < NFC_KEY_CACHE_SIZE; ++i) {
+    if(keyCache[i].used && keyCache[i].sector == sector && !memcmp(keyCache[i].prefix, logData->cid, NFC_KEY_CACHE_PREFIX_LEN)) {
+      slot = i;
+      break;
+    }
+    if(keyCache[i].used < keyCache[slot].used)
+      slot = i;
+  }
+  memcpy(keyCache[slot].prefix, logData->cid, NFC_KEY_CACHE_PREFIX_LEN);
+  keyCache[slot].sector = sector;
+  keyCache[slot].key = *key;
+  keyCache[slot].used = ++keyCacheClock;
+  portEXIT_CRITICAL(&keyCacheMux);
+}
+
+/**
+* @brief  Forget all cached keys, e.g. after the key table changed
+*/
+void nfc_clearKeyCache(void) {
+  portENTER_CRITICAL(&keyCacheMux);
+  memset(keyCache, 0, sizeof(keyCache));
+  keyCacheClock = 0;
+  portEXIT_CRITICAL(&keyCacheMux);
+}
+
+#ifdef NFC_TAP_CACHE_EN
+/**
+* @brief  Home slot of a card in the tap cache (FNV-1a of reader and UID)
+*/
+static size_t nfc_tapHash(const pn532_t *obj, log_data_t *logData) {
+  uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)obj;
+
+  for(int i = 0; i < logData->cidLen; ++i)
+    h = (h ^ logData->cid[i]) * 16777619u;
+  return h & (NFC_TAP_CACHE_SIZE - 1);
+}
+
+static bool nfc_tapMatches(const nfc_tap_t *tap, const pn532_t *obj, log_data_t *logData) {
+  return tap->reader == obj && tap->cidLen == logData->cidLen && !memcmp(tap->cid, logData->cid, logData->cidLen);
+}
+
+static bool nfc_tapAlive(const nfc_tap_t *tap, int64_t now) {
+  return tap->cidLen && (now - tap->seen < NFC_TAP_GONE_MS * 1000LL || now - tap->logged < NFC_TAP_WINDOW_MS * 1000LL);
+}
+
+/**
+* @brief  Check whether a card in the field was logged recently and note that
+*         it is still there
+*
+* @return true if the card has to be skipped
+*/
+static bool nfc_tapSeen(pn532_t *obj, log_data_t *logData) {
+  int64_t now = pn532_time_now();
+  size_t slot = nfc_tapHash(obj, logData);
+  bool repeated = false;
+
+  portENTER_CRITICAL(&tapCacheMux);
+  for(int i = 0; i < NFC_TAP_CACHE_SIZE && tapCache[slot].cidLen; ++i, slot = (slot + 1) & (NFC_TAP_CACHE_SIZE - 1)) {
+    if(nfc_tapMatches(&tapCache[slot], obj, logData)) {
+      repeated = nfc_tapAlive(&tapCache[slot], now);
+      tapCache[slot].seen = now;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&tapCacheMux);
+  return repeated;
+}
+
+/**
+* @brief  Remember a logged card. Expired slots on the probe path are reused,
+*         with all slots alive the card seen longest ago is replaced.
+*/
+static void nfc_tapLogged(pn532_t *obj, log_data_t *logData) {
+  int64_t now = pn532_time_now();
+  size_t slot = nfc_tapHash(obj, logData);
+  size_t use = NFC_TAP_CACHE_SIZE;
+  size_t oldest = slot;
+
+  portENTER_CRITICAL(&tapCacheMux);
+  for(int i = 0; i < NFC_TAP_CACHE_SIZE; ++i, slot = (slot + 1) & (NFC_TAP_CACHE_SIZE - 1)) {
+    if(nfc_tapMatches(&tapCache[slot], obj, logData) || !tapCache[slot].cidLen) {
+      use = slot;
+      break;
+    }
+    if(use == NFC_TAP_CACHE_SIZE && !nfc_tapAlive(&tapCache[slot], now))
+      use = slot;
+    if(tapCache[slot].seen < tapCache[oldest].seen)
+      oldest = slot;
+  }
+  if(use == NFC_TAP_CACHE_SIZE)
+    use = oldest;
+
+  tapCache[use].reader = obj;
+  memcpy(tapCache[use].cid, logData->cid, logData->cidLen);
+  tapCache[use].cidLen = logData->cidLen;
+  tapCache[use].logged = now;
+  tapCache[use].seen = now;
+  portEXIT_CRITICAL(&tapCacheMux);
+}
+#endif
+
+/**
+* @brief  Forget all recently logged cards, so the next tap of every card is logged
+*/
+void nfc_clearTapCache(void) {
+#ifdef NFC_TAP_CACHE_EN
+  portENTER_CRITICAL(&tapCacheMux);
+  memset(tapCache, 0, sizeof(tapCache));
+  portEXIT_CRITICAL(&tapCacheMux);
+#endif
+}
+
+/**
+* @brief  Authenticate a MIFARE Classic sector, trying the cached key first and
+*         then the candidates of the key table. The card is reactivated after
+*         every failed attempt, so it is still usable when this returns.
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data (card ID used for authentication)
+* @param  keys        Key table
+* @param  sector      Sector to authenticate
+*
+* @return true if the sector is authenticated
+*/
+bool nfc_authSector(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint8_t sector) {
+  const nfc_sector_keys_t *entry = NULL;
+  nfc_key_t cached;
+  bool haveCached;
+
+  for(size_t i = 0; i < keys->entryCount; ++i) {
+    if(sector >= keys->entries[i].firstSector && sector <= keys->entries[i].lastSector) {
+      entry = &keys->entries[i];
+      break;
+    }
+  }
+  if(entry == NULL) {
+    ESP_LOGE(TAG, "No keys for sector %d", sector);
+    return false;
+  }
+
+  haveCached = nfc_keyCacheGet(logData, sector, &cached);
+  for(int i = haveCached ? -1 : 0; i < entry->keyCount; ++i) {
+    const nfc_key_t *key = (i < 0) ? &cached : &entry->keys[i];
+
+    // The cached key was tried already
+    if(i >= 0 && haveCached && key->type == cached.type && !memcmp(key->key, cached.key, NFC_KEY_LEN))
+      continue;
+
+    if(pn532_mifareclassic_AuthenticateBlock(obj, logData->cid, logData->cidLen, nfc_sectorFirstBlock(sector), key->type, (uint8_t *)key->key)) {
+      if(i >= 0)
+        nfc_keyCachePut(logData, sector, key);
+      return true;
+    }
+    NFC_DEBUG("Key %c #%d rejected for sector %d\n", key->type == NFC_KEY_B ? 'B' : 'A', i, sector);
+
+    // A failed authentication halts the card until it is activated again
+    if(!nfc_reactivateCard(obj, logData))
+      return false;
+  }
+
+  ESP_LOGE(TAG, "Authentication of sector %d failed", sector);
+  return false;
+}
+
+/**
+* @brief  Read ranges of MIFARE Classic blocks, authenticating once per sector.
+*
+* Blocks are read sector by sector no matter the order of the ranges, a failed
+* sector doesn't stop the others. Block i of the request (counted across all
+* ranges in order) is stored at data[i * 16] with its status in status[i].
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data (card ID used for authentication)
+* @param  keys        Key table used for card authentication
+* @param  ranges      Block ranges to read
+* @param  rangeCount  Number of ranges
+* @param  data        Output buffer, 16 bytes per requested block
+* @param  status      Output status per requested block (NFC_BLOCK_*)
+*
+* @return Number of blocks read successfully
+*/
+size_t nfc_readBlocks(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, const nfc_block_range_t *ranges, size_t rangeCount, uint8_t *data, uint8_t *status) {
+  size_t blockCount = 0;
+  size_t readCount = 0;
+
+  // Blocks outside of the card memory can't be planned
+  for(size_t r = 0; r < rangeCount; ++r) {
+    for(uint16_t i = 0; i < ranges[r].blockCount; ++i) {
+      status[blockCount + i] = (ranges[r].firstBlock + i < NFC_CLASSIC_MAX_BLOCKS) ? NFC_BLOCK_READ_FAILED : NFC_BLOCK_INVALID;
+    }
+    blockCount += ranges[r].blockCount;
+  }
+
+  for(uint8_t sector = 0; sector <= nfc_blockSector(NFC_CLASSIC_MAX_BLOCKS - 1); ++sector) {
+    uint16_t first = nfc_sectorFirstBlock(sector);
+    uint16_t last = first + nfc_sectorBlockCount(sector) - 1;
+    bool authenticated = false;
+    bool authFailed = false;
+
+    // Walk all requested blocks of this sector
+    size_t index = 0;
+    for(size_t r = 0; r < rangeCount; ++r) {
+      for(uint16_t i = 0; i < ranges[r].blockCount; ++i, ++index) {
+        uint16_t block = ranges[r].firstBlock + i;
+        if(block < first || block > last)
+          continue;
+
+        if(!authenticated && !authFailed) {
+          // One authentication covers every block of the sector
+          if(nfc_authSector(obj, logData, keys, sector)) {
+            authenticated = true;
+          }
+          else {
+            authFailed = true;
+          }
+        }
+        if(authFailed) {
+          status[index] = NFC_BLOCK_AUTH_FAILED;
+        }
+        else if(pn532_mifareclassic_ReadDataBlock(obj, block, &data[index * NFC_CLASSIC_BLOCK_SIZE])) {
+          status[index] = NFC_BLOCK_OK;
+          ++readCount;
+        }
+        else {
+          ESP_LOGE(TAG, "Reading block %d failed", block);
+          status[index] = NFC_BLOCK_READ_FAILED;
+        }
+      }
+    }
+  }
+
+  return readCount;
+}
+
 /**
 * @brief  Authenticate and read blocks and store data to log_data_t struct
 *
 * @param  obj         Pointer to PN532 device descriptor struct
 * @param  logData     Pointer to struct holding log data
-* @param  keyA        Key A used for card authentication
+* @param  keys        Key table used for card authentication
 * @param  firstBlock  Number of the first block to be read
 *
 * @return Error code (0 = success, 1 = failed)
 */
-uint8_t nfc_authReadData(pn532_t *obj, log_data_t *logData, uint8_t *keyA, uint32_t firstBlock) {
+uint8_t nfc_authReadData(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint32_t firstBlock) {
   uint8_t data[CARD_DATA_LEN];
+  uint8_t status[CARD_DATA_LEN / NFC_CLASSIC_BLOCK_SIZE];
+  nfc_block_range_t range = { firstBlock, CARD_DATA_LEN / NFC_CLASSIC_BLOCK_SIZE };
 
   // Read blocks
-  for(int b = firstBlock; b < (firstBlock + CARD_DATA_LEN / 16); ++b) {
-    uint8_t block_data[CARD_DATA_LEN];
-    if(!nfc_authReadBlock(obj, logData, keyA, b, block_data)) {
-      for(int i = 0; i < 16; ++i) {
-        data[i + (b-firstBlock)*16] = block_data[i];
-      }
-    }
-    else {
-      ESP_LOGE(TAG, "Reading block %d failed", b);
-      return 1;
-    }
+  if(nfc_readBlocks(obj, logData, keys, &range, 1, data, status) != range.blockCount) {
+    ESP_LOGE(TAG, "Reading blocks %d-%d failed", range.firstBlock, range.firstBlock + range.blockCount - 1);
+    return 1;
   }
 
   // Print debug info
@@ -147,7 +693,9 @@ uint8_t nfc_authReadData(pn532_t *obj, log_data_t *logData, uint8_t *keyA, uint3
   for(int i = 0; i < CARD_DATA_LEN; ++i) {
     logData->data[i] = data[i];
 
-    if(i%16 == 0) NFC_DEBUG("\n");
+    if(i%16 == 0) {
+      NFC_DEBUG("\n");
+    }
     NFC_DEBUG("%02hhx ", logData->data[i]);
   }
   NFC_DEBUG("\n");
@@ -155,13 +703,264 @@ uint8_t nfc_authReadData(pn532_t *obj, log_data_t *logData, uint8_t *keyA, uint3
   return 0;
 }
 
+/**
+* @brief  Tell the card family from SAK and ATQA (NXP AN10833)
+*
+* @param  logData     Pointer to struct holding log data of an activated card
+*
+* @return Card family (NFC_CARD_*)
+*/
+uint8_t nfc_cardFamily(log_data_t *logData) {
+  uint8_t sak = logData->target.sak;
+
+  // SmartMX cards emulating a Classic (SAK 0x28/0x38) keep their data in the Classic sectors
+  if(sak & 0x08)
+    return NFC_CARD_CLASSIC;
+  if(sak & 0x20)
+    return NFC_CARD_ISODEP;
+  if(sak == 0x00 && logData->target.atqa == 0x0044)
+    return NFC_CARD_NTAG;
+  return NFC_CARD_UNKNOWN;
+}
+
+/**
+* @brief  Read card data from NTAG21x user memory with FAST_READ
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data
+*
+* @return Error code (0 = success, 1 = failed)
+*/
+static uint8_t nfc_readNtagData(pn532_t *obj, log_data_t *logData) {
+  if(!pn532_ntag2xx_ReadPages(obj, NFC_NTAG_DATA_FIRST_PAGE, CARD_DATA_LEN / 4, logData->data)) {
+    ESP_LOGE(TAG, "Reading pages %d-%d failed", NFC_NTAG_DATA_FIRST_PAGE, NFC_NTAG_DATA_FIRST_PAGE + CARD_DATA_LEN / 4 - 1);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+* @brief  Read card data from the NFC_ISODEP_AID application: SELECT by AID,
+*         then READ BINARY of the selected file at the fastest bit rate
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data
+*
+* @return Error code (0 = success, 1 = failed)
+*/
+static uint8_t nfc_readIsoDepData(pn532_t *obj, log_data_t *logData) {
+  static const uint8_t aid[] = NFC_ISODEP_AID;
+  uint8_t apdu[5 + sizeof(aid) + 1] = { 0x00, 0xA4, 0x04, 0x00, sizeof(aid) };
+  uint8_t readBinary[] = { 0x00, 0xB0, 0x00, 0x00, CARD_DATA_LEN }; // From offset 0
+  uint8_t fci[256 + 2]; // Le = 00: up to 256 bytes of FCI and the status word
+  uint8_t resp[CARD_DATA_LEN + 2];
+  uint16_t respLen;
+  uint16_t sw;
+
+  // Staying at 106 kbps still works, only slower
+  if(!pn532_isodep_selectBaudRate(obj, &logData->target, NFC_ISODEP_MAX_RATE))
+    ESP_LOGW(TAG, "Bit rate change failed");
+
+  memcpy(&apdu[5], aid, sizeof(aid));
+  apdu[5 + sizeof(aid)] = 0x00; // Le
+  if(!pn532_apdu(obj, logData->tg, apdu, sizeof(apdu), fci, sizeof(fci), &respLen, &sw) || sw != PN532_SW_OK) {
+    ESP_LOGE(TAG, "Selecting the application failed");
+    return 1;
+  }
+
+  if(!pn532_apdu(obj, logData->tg, readBinary, sizeof(readBinary), resp, sizeof(resp), &respLen, &sw) || sw != PN532_SW_OK || respLen != CARD_DATA_LEN) {
+    ESP_LOGE(TAG, "Reading the data file failed");
+    return 1;
+  }
+
+  memcpy(logData->data, resp, CARD_DATA_LEN);
+  return 0;
+}
+
+/**
+* @brief  Read card data with the strategy of the card family, so cards
+*         without Classic sectors don't go through a failing authentication
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data of an activated card
+* @param  keys        Key table used for Classic authentication
+*
+* @return Error code (0 = success, 1 = failed)
+*/
+uint8_t nfc_readCardData(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys) {
+  switch(nfc_cardFamily(logData)) {
+    case NFC_CARD_CLASSIC:
+      return nfc_authReadData(obj, logData, keys, CARD_DATA_FIRST_BLOCK);
+    case NFC_CARD_NTAG:
+      return nfc_readNtagData(obj, logData);
+    case NFC_CARD_ISODEP:
+      return nfc_readIsoDepData(obj, logData);
+    default:
+      ESP_LOGE(TAG, "Unsupported card (ATQA %04x, SAK %02x)", logData->target.atqa, logData->target.sak);
+      return 1;
+  }
+}
+
+/**
+* @brief  Bring NTAG21x user memory to an image, writing only the pages that
+*         differ. The current contents are fetched with FAST_READ one frame
+*         of pages at a time, changed pages are written and read back.
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  firstPage   Page the image starts at (user memory only)
+* @param  image       Wanted contents
+* @param  imageLen    Length of image in bytes, a multiple of the page size
+* @param  written     Output number of pages written
+*
+* @return Error code (0 = success, 1 = failed)
+*/
+uint8_t nfc_writeNtagImage(pn532_t *obj, uint8_t firstPage, const uint8_t *image, size_t imageLen, size_t *written) {
+  uint8_t current[PN532_FASTREAD_MAX_PAGES * NFC_NTAG_PAGE_SIZE];
+  size_t pageCount = imageLen / NFC_NTAG_PAGE_SIZE;
+
+  *written = 0;
+  if(imageLen % NFC_NTAG_PAGE_SIZE || firstPage < NFC_NTAG_DATA_FIRST_PAGE || firstPage + pageCount - 1 > NFC_NTAG_LAST_PAGE) {
+    ESP_LOGE(TAG, "Image doesn't fit the user memory");
+    return 1;
+  }
+
+  for(size_t done = 0; done < pageCount; ) {
+    uint8_t page = firstPage + done;
+    uint8_t chunk = (pageCount - done > PN532_FASTREAD_MAX_PAGES) ? PN532_FASTREAD_MAX_PAGES : pageCount - done;
+    const uint8_t *want = &image[done * NFC_NTAG_PAGE_SIZE];
+    bool changed = false;
+
+    if(!pn532_ntag2xx_ReadPages(obj, page, chunk, current)) {
+      ESP_LOGE(TAG, "Reading pages %d-%d failed", page, page + chunk - 1);
+      return 1;
+    }
+
+    for(uint8_t i = 0; i < chunk; ++i) {
+      if(!memcmp(&current[i * NFC_NTAG_PAGE_SIZE], &want[i * NFC_NTAG_PAGE_SIZE], NFC_NTAG_PAGE_SIZE))
+        continue;
+      if(!pn532_ntag2xx_WritePage(obj, page + i, (uint8_t *)&want[i * NFC_NTAG_PAGE_SIZE])) {
+        ESP_LOGE(TAG, "Writing page %d failed", page + i);
+        return 1;
+      }
+      ++*written;
+      changed = true;
+    }
+
+    // One FAST_READ verifies the whole chunk
+    if(changed && (!pn532_ntag2xx_ReadPages(obj, page, chunk, current) || memcmp(current, want, chunk * NFC_NTAG_PAGE_SIZE))) {
+      ESP_LOGE(TAG, "Verifying pages %d-%d failed", page, page + chunk - 1);
+      return 1;
+    }
+    done += chunk;
+  }
+
+  NFC_DEBUG("%zu of %zu pages written\n", *written, pageCount);
+  return 0;
+}
+
+/**
+* @brief  Bring MIFARE Classic blocks to an image, writing only the blocks that
+*         differ. Each sector is authenticated once (the key table needs a key
+*         with write access, e.g. key B first), then its blocks are read,
+*         written if different and read back. Block 0 and the sector trailers
+*         are never written, the image bytes at their place are ignored.
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data (card ID used for authentication)
+* @param  keys        Key table used for card authentication
+* @param  firstBlock  Block the image starts at
+* @param  image       Wanted contents, 16 bytes per block
+* @param  imageLen    Length of image in bytes, a multiple of the block size
+* @param  written     Output number of blocks written
+*
+* @return Error code (0 = success, 1 = failed)
+*/
+uint8_t nfc_writeClassicImage(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint16_t firstBlock, const uint8_t *image, size_t imageLen, size_t *written) {
+  uint8_t current[NFC_CLASSIC_BLOCK_SIZE];
+  size_t blockCount = imageLen / NFC_CLASSIC_BLOCK_SIZE;
+  uint16_t lastBlock = firstBlock + blockCount - 1;
+
+  *written = 0;
+  if(imageLen % NFC_CLASSIC_BLOCK_SIZE || blockCount == 0 || lastBlock >= NFC_CLASSIC_MAX_BLOCKS) {
+    ESP_LOGE(TAG, "Image doesn't fit the card memory");
+    return 1;
+  }
+
+  for(uint8_t sector = nfc_blockSector(firstBlock); sector <= nfc_blockSector(lastBlock); ++sector) {
+    uint16_t first = nfc_sectorFirstBlock(sector);
+    uint16_t trailer = first + nfc_sectorBlockCount(sector) - 1;
+
+    // One authentication covers reads and writes of the whole sector
+    if(!nfc_authSector(obj, logData, keys, sector))
+      return 1;
+
+    for(uint16_t block = (first > firstBlock) ? first : firstBlock; block < trailer && block <= lastBlock; ++block) {
+      const uint8_t *want = &image[(block - firstBlock) * NFC_CLASSIC_BLOCK_SIZE];
+
+      if(block == 0)
+        continue;
+      if(!pn532_mifareclassic_ReadDataBlock(obj, block, current)) {
+        ESP_LOGE(TAG, "Reading block %d failed", block);
+        return 1;
+      }
+      if(!memcmp(current, want, NFC_CLASSIC_BLOCK_SIZE))
+        continue;
+
+      if(!pn532_mifareclassic_WriteDataBlock(obj, block, (uint8_t *)want)) {
+        ESP_LOGE(TAG, "Writing block %d failed", block);
+        return 1;
+      }
+      if(!pn532_mifareclassic_ReadDataBlock(obj, block, current) || memcmp(current, want, NFC_CLASSIC_BLOCK_SIZE)) {
+        ESP_LOGE(TAG, "Verifying block %d failed", block);
+        return 1;
+      }
+      ++*written;
+    }
+  }
+
+  NFC_DEBUG("%zu of %zu blocks written\n", *written, blockCount);
+  return 0;
+}
+
+/**
+* @brief  Bring a card to an image with the strategy of its card family,
+*         writing only what differs
+*
+* @param  obj         Pointer to PN532 device descriptor struct
+* @param  logData     Pointer to struct holding log data of an activated card
+* @param  keys        Key table used for Classic authentication
+* @param  first       First page (NTAG) or block (Classic) of the image
+* @param  image       Wanted contents
+* @param  imageLen    Length of image in bytes
+* @param  written     Output number of pages or blocks written
+*
+* @return Error code (0 = success, 1 = failed)
+*/
+uint8_t nfc_writeCardImage(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint16_t first, const uint8_t *image, size_t imageLen, size_t *written) {
+  *written = 0;
+  switch(nfc_cardFamily(logData)) {
+    case NFC_CARD_CLASSIC:
+      return nfc_writeClassicImage(obj, logData, keys, first, image, imageLen, written);
+    case NFC_CARD_NTAG:
+      if(first > NFC_NTAG_LAST_PAGE)
+        return 1;
+      return nfc_writeNtagImage(obj, first, image, imageLen, written);
+    default:
+      ESP_LOGE(TAG, "Unsupported card (ATQA %04x, SAK %02x)", logData->target.atqa, logData->target.sak);
+      return 1;
+  }
+}
+
 /**
 * @brief  Set all variables in log_data_t struct to 0
 *
 * @param  logData     Pointer to struct holding log data
 */
 void nfc_initLogData(log_data_t *logData) {
+  logData->cardType = 0;
+  logData->tg = 0;
   logData-> cidLen = 0;
+  memset(&logData->target, 0, sizeof(logData->target));
   for(int i = 0; i < READER_ID_LEN ; ++i) logData->rid[i] = 0x00;
   for(int i = 0; i < CARD_ID_LEN ; ++i) logData->cid[i] = 0x00;
   for(int i = 0; i < CARD_DATA_LEN ; ++i) logData->data[i] = 0x00;
@@ -179,6 +978,7 @@ void nfc_printLogData(log_data_t *logData) {
   ESP_LOGI(TAG, "Reader ID:");
   esp_log_buffer_hexdump_internal(TAG, logData->rid, READER_ID_LEN, ESP_LOG_INFO);
   ESP_LOGI(TAG, "Card ID Length: %d", logData->cidLen);
+  ESP_LOGI(TAG, "ATQA: %04x, SAK: %02x", logData->target.atqa, logData->target.sak);
   ESP_LOGI(TAG, "Card ID:");
   esp_log_buffer_hexdump_internal(TAG, logData->cid, CARD_ID_LEN, ESP_LOG_INFO);
   ESP_LOGI(TAG, "Data:");
@@ -186,66 +986,155 @@ void nfc_printLogData(log_data_t *logData) {
   ESP_LOGI(TAG, "---");
 }
 
+static const char hexDigits[16] = "0123456789abcdef";
+
+/**
+* @brief  Append a field in the format key=0x[array in hex] to a REST API string,
+*         fields after the first are separated by '&'
+*
+* @param  destination  Output string
+* @param  size         Size of destination including the terminator
+* @param  n            Length of the string already in destination
+* @param  key          Name/key of the field
+* @param  array        Array of values to be converted
+* @param  arrayLen     Length of the array
+*
+* @return New length of the string, 0 if the field doesn't fit
+*/
+static size_t nfc_appendApiField(char *destination, size_t size, size_t n, const char *key, const uint8_t *array, size_t arrayLen) {
+  size_t keyLen = strlen(key);
+
+  // Separator, key, "=0x", two digits per byte and the terminator
+  if(n + (n ? 1 : 0) + keyLen + 3 + 2 * arrayLen + 1 > size)
+    return 0;
+
+  if(n)
+    destination[n++] = '&';
+  memcpy(&destination[n], key, keyLen);
+  n += keyLen;
+  memcpy(&destination[n], "=0x", 3);
+  n += 3;
+  for(size_t i = 0; i < arrayLen; ++i) {
+    destination[n++] = hexDigits[array[i] >> 4];
+    destination[n++] = hexDigits[array[i] & 0x0F];
+  }
+  destination[n] = '\0';
+  return n;
+}
+
 /**
 * @brief  Convert log_data_t to REST API string
 *
 * @param  logData      Pointer to struct holding log data
 * @param  destination  Pointer to the output string location
+* @param  size         Size of destination including the terminator
 *
-* @return Output string
+* @return Output string or NULL if it doesn't fit
 */
-char *nfc_logDataToApiString(log_data_t *logData, char *destination) {
-  nfc_arrayToApiString(NULL, "rid", logData->rid, READER_ID_LEN, destination);
-  nfc_arrayToApiString(destination, "cid", logData->cid, CARD_ID_LEN, destination);
-  return nfc_arrayToApiString(destination, "data", logData->data, CARD_DATA_LEN, destination);
+char *nfc_logDataToApiString(const log_data_t *logData, char *destination, size_t size) {
+  size_t n = nfc_appendApiField(destination, size, 0, "rid", logData->rid, READER_ID_LEN);
+  if(n)
+    n = nfc_appendApiField(destination, size, n, "cid", logData->cid, CARD_ID_LEN);
+  if(n)
+    n = nfc_appendApiField(destination, size, n, "data", logData->data, CARD_DATA_LEN);
+  if(!n) {
+    ESP_LOGE(TAG, "Log data don't fit API string of %d bytes", (int)size);
+    return NULL;
+  }
+  NFC_DEBUG("API string: %s\n", destination);
+  return destination;
 }
 
 /**
-* @brief  Convert array to REST API string in the fomat prefix&key=0x[array in hex]
+* @brief  Convert array to REST API string in the fomat key=0x[array in hex]
 *
-* @param  prefix       String to be prepended in frot of the output (if NULL no prefix will be prepended)
-* @param  key          Name/key of the filed
+* @param  key          Name/key of the field
 * @param  array        Array of values to be converted
 * @param  arrayLen     Length of the array
 * @param  destination  Pointer to the output string location
+* @param  size         Size of destination including the terminator
 *
-* @return Output string
+* @return Output string or NULL if it doesn't fit
 */
-char *nfc_arrayToApiString(char *prefix, char *key, uint8_t *array, size_t arrayLen, char *destination) {
-  int n = 0;
-  if(prefix != NULL) { // If NULL prefix is ignored
-    n += sprintf(&destination[n], prefix);
-    n += sprintf(&destination[n], "&");
+char *nfc_arrayToApiString(const char *key, const uint8_t *array, size_t arrayLen, char *destination, size_t size) {
+  if(!nfc_appendApiField(destination, size, 0, key, array, arrayLen)) {
+    ESP_LOGE(TAG, "Field %s doesn't fit API string of %d bytes", key, (int)size);
+    return NULL;
   }
-  n += sprintf(&destination[n], key);
-  n += sprintf(&destination[n], "=0x");
-  for(int i = 0; i < arrayLen; ++i) {
-		n += sprintf(&destination[n],"%02hhx", array[i]);
-	}
   NFC_DEBUG("API string: %s\n", destination);
   return destination;
 }
 
 /**
-* @brief  Wait for the ISO14443A card and log its info to log_data_t struct
+* @brief  Wait for ISO14443A cards and log info of each card presented together
+*         to its own log_data_t struct
 *
 * @param  obj         Pointer to PN532 device descriptor struct
-* @param  logData     Pointer to struct holding log data
+* @param  logData     Array of NFC_MAX_CARDS structs holding log data
+* @param  cardCount   Number of successfully logged cards (stored at the start of logData),
+*                     cards logged recently are skipped (NFC_TAP_CACHE_EN)
 * @param  readerId    Reader ID array
-* @param  keyA        Key A used for card authentication
+* @param  keys        Key table used for card authentication
 *
-* @return Error code (0 = success, 1 = reading ID failed, 2 = reading data failed)
+* @return Error code (0 = success, 1 = reading ID failed, 2 = reading data of a card failed)
 */
-uint8_t nfc_logCard(pn532_t *obj, log_data_t *logData, uint8_t *readerId, uint8_t *keyA) {
-  nfc_initLogData(logData);
-  nfc_setReaderId(logData, readerId);
-  if(nfc_readCardId(obj, logData) == -1) {
+uint8_t nfc_logCard(pn532_t *obj, log_data_t *logData, uint8_t *cardCount, uint8_t *readerId, const nfc_key_table_t *keys) {
+  uint8_t err = 0;
+  uint8_t found;
+  uint8_t skipped = 0;
+
+  *cardCount = 0;
+  for(int i = 0; i < NFC_MAX_CARDS; ++i) {
+    nfc_initLogData(&logData[i]);
+    nfc_setReaderId(&logData[i], readerId);
+  }
+
+  // Keep the whole card session on this module atomic
+  pn532_lock(obj);
+  found = nfc_readCardIds(obj, logData, NFC_MAX_CARDS);
+  if(!found) {
     ESP_LOGE(TAG, "Reading Card ID failed");
-    return 1;
+    err = 1;
   }
-  if(nfc_authReadData(obj,logData, keyA, CARD_DATA_FIRST_BLOCK)) {
-    ESP_LOGE(TAG, "Reading Card Data failed");
-    return 2;
+  for(int i = 0; i < found; ++i) {
+#ifdef NFC_TAP_CACHE_EN
+    // Left on the reader or tapped again right away
+    if(nfc_tapSeen(obj, &logData[i])) {
+      NFC_DEBUG("Card already logged, skipped\n");
+      ++skipped;
+      continue;
+    }
+#endif
+    // Both cards stay activated, switch to the one being read. A reactivation
+    // while reading the other card released it, so activate it again.
+    if(found > 1 && !pn532_inSelect(obj, logData[i].tg) && !nfc_reactivateCard(obj, &logData[i])) {
+      ESP_LOGE(TAG, "Selecting card %d failed", logData[i].tg);
+      err = 2;
+    }
+    else if(nfc_readCardData(obj, &logData[i], keys)) {
+      ESP_LOGE(TAG, "Reading Card Data failed");
+      err = 2;
+    }
+    else {
+#ifdef NFC_TAP_CACHE_EN
+      nfc_tapLogged(obj, &logData[i]);
+#endif
+      if(*cardCount != i)
+        logData[*cardCount] = logData[i];
+      (*cardCount)++;
+    }
   }
-  return 0;
+  pn532_unlock(obj);
+
+  // Don't spin on a card left on the reader
+  if(found && skipped == found)
+    vTaskDelay(NFC_TAP_PAUSE_MS / portTICK_PERIOD_MS);
+
+#ifdef NFC_TRACE_EN
+  // Keep what happened on the bus for a failed card
+  if(err == 2)
+    nfc_dumpTrace(obj);
+#endif
+
+  return err;
 }
@@ -5,29 +5,160 @@
 #define PN532_MOSI 33
 #define PN532_SS 32
 #define PN532_MISO 25
+#define PN532_SPI_HOST HSPI_HOST
+#define PN532_IRQ PN532_NO_IRQ // GPIO wired to PN532 IRQ, PN532_NO_IRQ polls the status byte
+
+// PN532 modules sharing the SPI bus, each on its own SS (and IRQ) pin
+#define NFC_READER_COUNT 1
+#define NFC_READER_SS_PINS { PN532_SS } // e.g. { 32, 27 } for an entry/exit pair
+#define NFC_READER_IRQ_PINS { PN532_IRQ }
+
+// Battery saving: the PN532 sleeps in PowerDown between detection cycles and is
+// resumed without the full setup. RF wake-up only reacts to external fields (phones),
+// passive cards are found by the next cycle. Without autopoll needs NFC_RF_PROFILE_EN.
+#define NFC_POWERDOWN_EN
+#define NFC_POWERDOWN_WAKEUP (PN532_WAKEUP_SPI | PN532_WAKEUP_RF)
+#define NFC_POWERDOWN_MS 250 // Sleep between detection cycles
+
+// Card detection: with NFC_AUTOPOLL_EN the PN532 polls on its own (InAutoPoll)
+// and wakes the task on IRQ/ready, otherwise InListPassiveTarget is used
+#define NFC_AUTOPOLL_EN
+#define NFC_AUTOPOLL_PERIOD 1 // Pause between polling rounds in 150 ms units
+#ifdef NFC_POWERDOWN_EN
+#define NFC_AUTOPOLL_POLLNR 2 // Polling rounds per detection cycle
+#else
+#define NFC_AUTOPOLL_POLLNR PN532_AUTOPOLL_ENDLESS
+#endif
+#define NFC_AUTOPOLL_TYPES { PN532_AUTOPOLL_ISO14443_4A, PN532_AUTOPOLL_MIFARE } // In polling order
+
+// Latency profile applied in nfc_setupReader: short activation bursts with the
+// RF field off in between instead of one endless InListPassiveTarget
+#define NFC_RF_PROFILE_EN
+#define NFC_RF_ACTIVATION_RETRIES 0x02 // MxRtyPassiveActivation per detection cycle
+#define NFC_RF_COM_RETRIES 0x00 // Card exchange retries after a timeout
+#define NFC_RF_RESPONSE_TIMEOUT PN532_RF_TIMEOUT_25_6MS // Card response timeout (default 51.2 ms)
+#define NFC_RF_ATR_TIMEOUT PN532_RF_TIMEOUT_25_6MS // ATR_RES timeout (default 102.4 ms)
+#define NFC_RF_OFF_MS 100 // Field off between detection cycles
+
+// With NFC_ASYNC_EN a driver task owns each PN532 and reader tasks queue commands to it
+#define NFC_ASYNC_EN
+#define NFC_ASYNC_QUEUE_LEN 4
+#define NFC_ASYNC_PRIORITY 6 // Above the reader tasks so responses are picked up promptly
+
+// Bus trace for field debugging: the SPI traffic of each reader is recorded in a
+// RAM ring (PN532_TRACE_RING_SIZE bytes per reader) and dumped when reading a card fails
+//#define NFC_TRACE_EN
+
+// Duplicate taps: a card is not read and logged again while it stays in the field
+// (seen again within NFC_TAP_GONE_MS) or within NFC_TAP_WINDOW_MS of being logged
+#define NFC_TAP_CACHE_EN
+#define NFC_TAP_CACHE_SIZE 16 // Cards remembered across all readers, a power of two
+#define NFC_TAP_WINDOW_MS 5000
+#define NFC_TAP_GONE_MS 1000 // Longer than a detection cycle
+#define NFC_TAP_PAUSE_MS 200 // Rest when only known cards are in the field
+
+#define NFC_MAX_CARDS PN532_MAX_TARGETS // Cards presented together that are read in one field activation
 
 #define READER_ID_LEN 8
 #define CARD_ID_LEN 8
 #define CARD_DATA_LEN 32
 #define CARD_DATA_FIRST_BLOCK 4
 
+// MIFARE Classic 1K/4K layout: 32 sectors of 4 blocks, then 8 sectors of 16 blocks (4K only)
+#define NFC_CLASSIC_BLOCK_SIZE 16
+#define NFC_CLASSIC_MAX_BLOCKS 256
+#define NFC_CLASSIC_SMALL_SECTORS 32
+#define NFC_CLASSIC_SECTORS 40
+
+// MIFARE Classic keys: candidates per sector range, tried in order after the
+// key that last opened the sector on a card with the same UID prefix
+#define NFC_KEY_A 0
+#define NFC_KEY_B 1
+#define NFC_KEY_LEN 6
+#define NFC_KEY_CACHE_SIZE 16 // Remembered (UID prefix, sector) -> key pairs
+#define NFC_KEY_CACHE_PREFIX_LEN 3 // UID bytes shared by a card batch
+#define NFC_REACTIVATE_TIMEOUT 100 // Reactivation after a failed authentication in ms
+
+// Per-block status of nfc_readBlocks (same codes as nfc_authReadBlock)
+#define NFC_BLOCK_OK 0
+#define NFC_BLOCK_AUTH_FAILED 1
+#define NFC_BLOCK_READ_FAILED 2
+#define NFC_BLOCK_INVALID 3 // Block outside of the card memory
+
+// Card families told apart by SAK/ATQA, each read with its own strategy (nfc_readCardData)
+#define NFC_CARD_UNKNOWN 0
+#define NFC_CARD_CLASSIC 1 // MIFARE Classic Mini/1K/4K: sector auth and block reads
+#define NFC_CARD_NTAG 2 // NTAG21x/Ultralight EV1: FAST_READ, no auth
+#define NFC_CARD_ISODEP 3 // ISO14443-4 (DESFire, phones): SELECT and READ BINARY
+
+// Where card data lives on non-Classic cards
+#define NFC_NTAG_DATA_FIRST_PAGE 4 // First page of user memory
+#define NFC_ISODEP_AID { 0xF0, 0x4E, 0x46, 0x43, 0x52, 0x44, 0x52 } // Application holding the data (proprietary AID)
+#define NFC_ISODEP_MAX_RATE PN532_BAUD_424 // Fastest bit rate negotiated with InPSL
+
+// Card image writer (nfc_writeCardImage): only pages/blocks that differ are written
+#define NFC_NTAG_PAGE_SIZE 4
+#define NFC_NTAG_LAST_PAGE 225 // Last user page of NTAG216
+
 typedef struct {
+  uint8_t cardType; // Target type reported by the PN532 (PN532_AUTOPOLL_*)
+  uint8_t tg; // PN532 logical target number of the card
   uint8_t cidLen; // Length of Card ID
+  pn532_target_t target; // Activation data: ATQA, SAK and ATS
   uint8_t rid[READER_ID_LEN]; // Reader ID
   uint8_t cid[CARD_ID_LEN]; // Card ID
   uint8_t data[CARD_DATA_LEN]; // 2 blocks of data
 } log_data_t;
 
+typedef struct {
+  uint8_t type; // NFC_KEY_A or NFC_KEY_B
+  uint8_t key[NFC_KEY_LEN];
+} nfc_key_t;
+
+typedef struct {
+  uint8_t firstSector; // Sector range the keys apply to
+  uint8_t lastSector;
+  const nfc_key_t *keys; // Candidates in order of preference
+  uint8_t keyCount;
+} nfc_sector_keys_t;
+
+typedef struct {
+  const nfc_sector_keys_t *entries; // First entry covering a sector wins
+  size_t entryCount;
+} nfc_key_table_t;
+
+typedef struct {
+  uint16_t firstBlock; // First block of the range
+  uint16_t blockCount; // Number of consecutive blocks
+} nfc_block_range_t;
+
 void nfc_setup(pn532_t *obj);
+void nfc_setupReader(pn532_t *obj, uint8_t ss, uint8_t irq);
+void nfc_setupReaders(pn532_t *objs);
+void nfc_dumpTrace(pn532_t *obj);
 uint32_t nfc_readCardId(pn532_t *obj, log_data_t *logData);
+uint8_t nfc_readCardIds(pn532_t *obj, log_data_t *logData, uint8_t maxCards);
 void nfc_setReaderId(log_data_t *logData, uint8_t *id);
 uint8_t nfc_authReadBlock(pn532_t *obj, log_data_t *logData, uint8_t *keyA, uint32_t block, uint8_t *block_data);
-uint8_t nfc_authReadData(pn532_t *obj, log_data_t *logData, uint8_t *keyA, uint32_t firstBlock);
+uint8_t nfc_blockSector(uint16_t block);
+uint16_t nfc_sectorFirstBlock(uint8_t sector);
+uint8_t nfc_sectorBlockCount(uint8_t sector);
+bool nfc_reactivateCard(pn532_t *obj, log_data_t *logData);
+bool nfc_authSector(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint8_t sector);
+void nfc_clearKeyCache(void);
+void nfc_clearTapCache(void);
+size_t nfc_readBlocks(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, const nfc_block_range_t *ranges, size_t rangeCount, uint8_t *data, uint8_t *status);
+uint8_t nfc_authReadData(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint32_t firstBlock);
+uint8_t nfc_cardFamily(log_data_t *logData);
+uint8_t nfc_readCardData(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys);
+uint8_t nfc_writeNtagImage(pn532_t *obj, uint8_t firstPage, const uint8_t *image, size_t imageLen, size_t *written);
+uint8_t nfc_writeClassicImage(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint16_t firstBlock, const uint8_t *image, size_t imageLen, size_t *written);
+uint8_t nfc_writeCardImage(pn532_t *obj, log_data_t *logData, const nfc_key_table_t *keys, uint16_t first, const uint8_t *image, size_t imageLen, size_t *written);
 void nfc_initLogData(log_data_t *logData);
 void nfc_printLogData(log_data_t *logData);
-char *nfc_logDataToApiString(log_data_t *logData, char *destination);
-char *nfc_arrayToApiString(char *prefix, char *key, uint8_t *array, size_t arrayLen, char *destination);
-uint8_t nfc_logCard(pn532_t *obj, log_data_t *logData, uint8_t *readerId, uint8_t *keyA);
+char *nfc_logDataToApiString(const log_data_t *logData, char *destination, size_t size);
+char *nfc_arrayToApiString(const char *key, const uint8_t *array, size_t arrayLen, char *destination, size_t size);
+uint8_t nfc_logCard(pn532_t *obj, log_data_t *logData, uint8_t *cardCount, uint8_t *readerId, const nfc_key_table_t *keys);
 uint8_t nfc_generateReaderKey(uint8_t *readerId, uint8_t *destination);
 
 #endif
@@ -11,6 +11,7 @@
 #include "esp_netif.h"
 #include "esp_tls.h"
 #include "esp_http_client.h"
+#include "mbedtls/md.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -39,6 +40,27 @@ extern const char server_cert_pem_end[]   asm("_binary_server_cert_pem_end");
 static EventGroupHandle_t wifi_event_group;
 static int retry_num = 0;
 
+/**
+* Cache directives of the response being received (requests are serialized by the caller)
+*/
+static uint32_t headerMaxAge;
+static bool headerNoStore;
+static bool headerInvalidate;
+
+#ifdef WIFI_CACHE_EN
+// Server decision for a card, reused until it expires
+typedef struct {
+  uint8_t key[WIFI_CACHE_KEY_LEN]; // uidLen, zero padded uid, digest of the card data
+  uint32_t apiCode;
+  TickType_t expires;
+  uint32_t used; // Age stamp for LRU replacement (0 = free)
+} wifi_cache_t;
+
+static wifi_cache_t decisionCache[WIFI_CACHE_SIZE];
+static uint32_t decisionCacheClock;
+static portMUX_TYPE decisionCacheMux = portMUX_INITIALIZER_UNLOCKED; // Shared by all reader tasks
+#endif
+
 /**
 * @brief  Manage WiFi events
 */
@@ -85,6 +107,18 @@ esp_err_t wifi_httpEventHandler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_HEADER:
             WIFI_DEBUG("HTTP_EVENT_ON_HEADER, key=%s, value=%s\n", evt->header_key, evt->header_value);
+            if (strcasecmp(evt->header_key, "Cache-Control") == 0) {
+                char *maxAge = strstr(evt->header_value, "max-age=");
+                if (maxAge != NULL) {
+                    long age = strtol(maxAge + 8, NULL, 10);
+                    headerMaxAge = age < 0 ? 0 : (age > WIFI_CACHE_MAX_AGE_S ? WIFI_CACHE_MAX_AGE_S : age);
+                }
+                if (strstr(evt->header_value, "no-store") || strstr(evt->header_value, "no-cache")) {
+                    headerNoStore = true;
+                }
+            } else if (strcasecmp(evt->header_key, WIFI_CACHE_INVALIDATE_HEADER) == 0) {
+                headerInvalidate = true;
+            }
             break;
         case HTTP_EVENT_ON_DATA:
             WIFI_DEBUG("HTTP_EVENT_ON_DATA, len=%d\n", evt->data_len);
@@ -234,9 +268,13 @@ uint8_t wifi_httpsExchangeData(http_response_t *response, char* responseBuffer,
   if(queryString == NULL || queryString[0] == '\0') {
     ESP_LOGW(TAG, "No query string");
   }
-  else {
+  else if(strlen(SERVER_ADDR) + strlen(queryString) < MAX_HTTP_URL_BUFFER) {
     strcat(urlStr, queryString); // Conctenate server URL and API request string
   }
+  else {
+    ESP_LOGE(TAG, "Query string too long for URL buffer");
+    return 1;
+  }
   esp_http_client_config_t config = {
       .url = urlStr,
       .cert_pem = server_cert_pem_start,
@@ -252,9 +290,18 @@ uint8_t wifi_httpsExchangeData(http_response_t *response, char* responseBuffer,
     esp_http_client_set_header(client, "Set-Cookie", readerKeyString);
   }
   // Perform request
+  headerMaxAge = 0;
+  headerNoStore = false;
+  headerInvalidate = false;
   esp_err_t err = esp_http_client_perform(client);
   // Parse response
   uint8_t ret = wifi_parseResponse(response, client, responseBuffer, err);
+  response->maxAge = headerNoStore ? 0 : headerMaxAge;
+  response->noStore = headerNoStore;
+  if(ret == 0 && headerInvalidate) {
+    ESP_LOGI(TAG, "Server invalidated cached decisions");
+    wifi_cacheClear();
+  }
   // Cleanup
   esp_http_client_cleanup(client);
 
@@ -333,3 +380,136 @@ uint32_t wifi_parseApiCode(char *buffer) {
 void wifi_printResponse(http_response_t *response) {
   ESP_LOGI(TAG, "API Code: %d, API Message: %s", response->apiCode, response->apiMessage);
 }
+
+#ifdef WIFI_CACHE_EN
+/**
+* @brief   Build the cache key of a card: UID and a digest of the data the decision is bound to
+*
+* @return  true on success
+*/
+static bool wifi_cacheKey(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen, uint8_t *key) {
+  uint8_t hash[32];
+
+  if(uidLen > WIFI_CACHE_UID_LEN || mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data, dataLen, hash))
+    return false;
+  memset(key, 0, WIFI_CACHE_KEY_LEN);
+  key[0] = uidLen;
+  memcpy(&key[1], uid, uidLen);
+  memcpy(&key[1 + WIFI_CACHE_UID_LEN], hash, WIFI_CACHE_DIGEST_LEN);
+  return true;
+}
+
+static bool wifi_cacheExpired(const wifi_cache_t *entry, TickType_t now) {
+  return (int32_t)(entry->expires - now) <= 0;
+}
+#endif
+
+/**
+* @brief   Get the cached server decision for a card
+*
+* @param   uid        Card ID
+* @param   uidLen     Length of uid
+* @param   data       Card data the decision is bound to
+* @param   dataLen    Length of data
+* @param   apiCode    Where to store the API Code of the cached response
+*
+* @return  true if an unexpired decision was found
+*/
+bool wifi_cacheLookup(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen, uint32_t *apiCode) {
+#ifdef WIFI_CACHE_EN
+  uint8_t key[WIFI_CACHE_KEY_LEN];
+  TickType_t now = xTaskGetTickCount();
+  bool found = false;
+
+  if(!wifi_cacheKey(uid, uidLen, data, dataLen, key))
+    return false;
+
+  portENTER_CRITICAL(&decisionCacheMux);
+  for(int i = 0; i < WIFI_CACHE_SIZE; ++i) {
+    wifi_cache_t *entry = &decisionCache[i];
+    if(!entry->used || memcmp(entry->key, key, WIFI_CACHE_KEY_LEN))
+      continue;
+    if(wifi_cacheExpired(entry, now)) {
+      entry->used = 0;
+    }
+    else {
+      entry->used = ++decisionCacheClock;
+      *apiCode = entry->apiCode;
+      found = true;
+    }
+    break;
+  }
+  portEXIT_CRITICAL(&decisionCacheMux);
+
+  if(found)
+    WIFI_DEBUG("Cached decision used, API Code: %d\n", *apiCode);
+  return found;
+#else
+  return false;
+#endif
+}
+
+/**
+* @brief   Update the cache with a server response to a card log. The decision is
+*          stored for response->maxAge seconds, without max-age (or with no-store)
+*          a cached decision for the card is dropped. Getting the cached decision
+*          again (e.g. from the log of a cached tap) doesn't extend its lifetime.
+*
+* @param   uid        Card ID
+* @param   uidLen     Length of uid
+* @param   data       Card data the decision is bound to
+* @param   dataLen    Length of data
+* @param   response   Parsed server response
+*/
+void wifi_cacheUpdate(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen, const http_response_t *response) {
+#ifdef WIFI_CACHE_EN
+  uint8_t key[WIFI_CACHE_KEY_LEN];
+  TickType_t now = xTaskGetTickCount();
+  bool store = !response->noStore && response->maxAge && response->apiCode != (uint32_t)-1;
+  wifi_cache_t *use = NULL;
+
+  if(!wifi_cacheKey(uid, uidLen, data, dataLen, key))
+    return;
+
+  portENTER_CRITICAL(&decisionCacheMux);
+  for(int i = 0; i < WIFI_CACHE_SIZE; ++i) {
+    wifi_cache_t *entry = &decisionCache[i];
+    if(entry->used && !memcmp(entry->key, key, WIFI_CACHE_KEY_LEN)) {
+      use = entry;
+      break;
+    }
+    // Free or expired entries first, then the least recently used one
+    if(!entry->used || wifi_cacheExpired(entry, now))
+      entry->used = 0;
+    if(use == NULL || (use->used && entry->used < use->used))
+      use = entry;
+  }
+  if(store) {
+    TickType_t expires = now + response->maxAge * configTICK_RATE_HZ;
+    bool same = use->used && !memcmp(use->key, key, WIFI_CACHE_KEY_LEN) &&
+                !wifi_cacheExpired(use, now) && use->apiCode == response->apiCode;
+
+    // Keep the expiry of an unchanged decision unless the server shortened it
+    if(!same || (int32_t)(expires - use->expires) < 0)
+      use->expires = expires;
+    memcpy(use->key, key, WIFI_CACHE_KEY_LEN);
+    use->apiCode = response->apiCode;
+    use->used = ++decisionCacheClock;
+  }
+  else if(use->used && !memcmp(use->key, key, WIFI_CACHE_KEY_LEN)) {
+    use->used = 0;
+  }
+  portEXIT_CRITICAL(&decisionCacheMux);
+#endif
+}
+
+/**
+* @brief   Forget all cached decisions, every card asks the server on its next tap
+*/
+void wifi_cacheClear(void) {
+#ifdef WIFI_CACHE_EN
+  portENTER_CRITICAL(&decisionCacheMux);
+  memset(decisionCache, 0, sizeof(decisionCache));
+  portEXIT_CRITICAL(&decisionCacheMux);
+#endif
+}
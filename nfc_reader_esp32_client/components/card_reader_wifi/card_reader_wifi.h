@@ -14,9 +14,23 @@
 
 #define WIFI_MAX_RETRY 5 // Max number of attempts to connect to WiFi on startup
 
+// Decision cache: a card log response with "Cache-Control: max-age=N" may be reused
+// for repeat taps of the same card (and card data) for N seconds. "no-store" or
+// "no-cache" drops the card's entry, a WIFI_CACHE_INVALIDATE_HEADER header on any
+// response (alive messages included) drops all entries.
+#define WIFI_CACHE_EN
+#define WIFI_CACHE_SIZE 32 // Cards remembered, least recently used is replaced
+#define WIFI_CACHE_MAX_AGE_S 86400 // Cap on the server's max-age
+#define WIFI_CACHE_UID_LEN 8 // Same as CARD_ID_LEN
+#define WIFI_CACHE_DIGEST_LEN 16 // Leading bytes of SHA-256 over the card data
+#define WIFI_CACHE_KEY_LEN (1 + WIFI_CACHE_UID_LEN + WIFI_CACHE_DIGEST_LEN)
+#define WIFI_CACHE_INVALIDATE_HEADER "X-Cache-Invalidate"
+
 typedef struct {
   uint32_t apiCode;
   char apiMessage[MAX_HTTP_OUTPUT_BUFFER-3];
+  uint32_t maxAge; // Seconds the decision may be reused (0 = not cacheable)
+  bool noStore; // Server asked to forget a cached decision for the card
 } http_response_t;
 
 static void wifi_eventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
@@ -27,5 +41,8 @@ uint8_t wifi_httpsExchangeData(http_response_t *response, char* responseBuffer,
 uint8_t wifi_parseResponse(http_response_t *response, esp_http_client_handle_t client, char *buffer, esp_err_t error);
 uint32_t wifi_parseApiCode(char *buffer);
 void wifi_printResponse(http_response_t *response);
+bool wifi_cacheLookup(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen, uint32_t *apiCode);
+void wifi_cacheUpdate(const uint8_t *uid, uint8_t uidLen, const uint8_t *data, size_t dataLen, const http_response_t *response);
+void wifi_cacheClear(void);
 
 #endif
@@ -30,43 +30,95 @@
 #define MIFARE_DEBUG(fmt, ...)
 #endif
 
-#define PN532_PACKBUFFSIZ 64
+#define PN532_DELAY(ms) vTaskDelay(ms / portTICK_RATE_MS)
 
-#ifndef _BV
-#define _BV(bit) (1 << (bit))
-#endif
+// SS low to the first clock, lets the PN532 wake up from power down
+#define PN532_CS_WAKEUP_US (1000)
+// SS low pulse of a fast resume, the oscillator is running when it ends
+#define PN532_RESUME_US (2000)
 
-#define PN532_DELAY(ms) vTaskDelay(ms / portTICK_RATE_MS)
+#define PN532_UNLOCK_RETURN(obj, ret) \
+    do                                \
+    {                                 \
+        pn532_unlock(obj);            \
+        return ret;                   \
+    } while (0)
 
-static uint8_t pn532ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
-static uint8_t pn532response_firmwarevers[] = {0x00, 0xFF, 0x06, 0xFA, 0xD5, 0x03};
-static uint8_t pn532_packetbuffer[PN532_PACKBUFFSIZ];
+// Bytes read before the frame size is known: optional preamble, start code, LEN, LCS, TFI, code
+#define PN532_FRAME_HEADER_READ (7)
 
 static void pn532_readdata(pn532_t *obj, uint8_t *buff, uint8_t n);
-static void pn532_writecommand(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen);
+static bool pn532_readframe(pn532_t *obj, uint8_t *buff, uint16_t size, pn532_frame_t *frame);
+static bool pn532_readresponse(pn532_t *obj, uint8_t command, uint8_t *buff, uint16_t size, pn532_frame_t *frame);
+static void pn532_writecommand(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen);
 static bool pn532_readack(pn532_t *obj);
 static bool pn532_isready(pn532_t *obj);
 static bool pn532_waitready(pn532_t *obj, uint16_t timeout);
-static void pn532_spi_write(pn532_t *obj, uint8_t c);
-static uint8_t pn532_spi_read(pn532_t *obj);
+static uint16_t pn532_parsetarget(const uint8_t *data, uint16_t len, bool sized, pn532_target_t *target);
+static void pn532_targetfound(pn532_t *obj);
+
+// Arguments of pn532_sleep run by the driver task
+typedef struct
+{
+    pn532_t *obj;
+    uint16_t ms;
+} pn532_sleep_args_t;
+
+// Once the driver task runs, other tasks don't talk to the PN532 themselves
+static bool pn532_viaDriver(pn532_t *obj)
+{
+    return obj->_asyncTask != NULL && xTaskGetCurrentTaskHandle() != obj->_asyncTask;
+}
+
+static bool pn532_sleepCall(void *arg)
+{
+    pn532_sleep_args_t *args = arg;
+    return pn532_sleep(args->obj, args->ms);
+}
+
+static bool pn532_resumeCall(void *arg)
+{
+    pn532_resume(arg);
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Creates the device lock so several tasks can share one PN532
+
+    Every driver call takes the (recursive) lock for the duration of the
+    command; callers can hold it across a whole card session with
+    pn532_lock/pn532_unlock. Without this call locking is a no-op.
+
+    @returns ESP_OK or ESP_ERR_NO_MEM
+*/
+/**************************************************************************/
+esp_err_t pn532_lock_init(pn532_t *obj)
+{
+    obj->_lock = xSemaphoreCreateRecursiveMutex();
+    return obj->_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Takes the device lock (no-op without pn532_lock_init)
+*/
+/**************************************************************************/
+void pn532_lock(pn532_t *obj)
+{
+    if (obj->_lock)
+        xSemaphoreTakeRecursive(obj->_lock, portMAX_DELAY);
+}
 
-void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss)
+/**************************************************************************/
+/*!
+    @brief  Releases the device lock
+*/
+/**************************************************************************/
+void pn532_unlock(pn532_t *obj)
 {
-    obj->_clk = clk;
-    obj->_miso = miso;
-    obj->_mosi = mosi;
-    obj->_ss = ss;
-
-    gpio_pad_select_gpio(obj->_clk);
-    gpio_pad_select_gpio(obj->_miso);
-    gpio_pad_select_gpio(obj->_mosi);
-    gpio_pad_select_gpio(obj->_ss);
-
-    gpio_set_direction(obj->_ss, GPIO_MODE_OUTPUT);
-    gpio_set_level(obj->_ss, 1);
-    gpio_set_direction(obj->_clk, GPIO_MODE_OUTPUT);
-    gpio_set_direction(obj->_mosi, GPIO_MODE_OUTPUT);
-    gpio_set_direction(obj->_miso, GPIO_MODE_INPUT);
+    if (obj->_lock)
+        xSemaphoreGiveRecursive(obj->_lock);
 }
 
 /**************************************************************************/
@@ -76,16 +128,27 @@ void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8
 /**************************************************************************/
 void pn532_begin(pn532_t *obj)
 {
-    gpio_set_level(obj->_ss, 0);
+    pn532_lock(obj);
+
+    obj->_transport->select(obj->_transportCtx);
 
     PN532_DELAY(1000);
 
+    obj->_transport->deselect(obj->_transportCtx);
+
+    // Target addressed by the card helpers until a card is inlisted or selected
+    obj->_inListedTag = 1;
+
     // not exactly sure why but we have to send a dummy command to get synced up
-    pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
-    pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000);
+    obj->_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
+    if (pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 1, 1000))
+    {
+        // ignore response, just drain it so it can't be mistaken for the next one
+        pn532_frame_t frame;
+        pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer), &frame);
+    }
 
-    // ignore response!
-    gpio_set_level(obj->_ss, 1);
+    pn532_unlock(obj);
 }
 
 /**************************************************************************/
@@ -97,35 +160,35 @@ void pn532_begin(pn532_t *obj)
 /**************************************************************************/
 uint32_t pn532_getFirmwareVersion(pn532_t *obj)
 {
+    pn532_lock(obj);
+
     uint32_t response;
+    pn532_frame_t frame;
 
-    pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
+    obj->_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000))
+    if (!pn532_command(obj, obj->_packetbuffer, 1, &frame, 1000))
     {
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 12);
-
-    // check some basic stuff
-    if (0 != strncmp((char *)pn532_packetbuffer, (char *)pn532response_firmwarevers, 6))
+    // read data packet (IC, Ver, Rev, Support)
+    if (frame.payloadLen < 4)
     {
         PN532_DEBUG("Firmware doesn't match!\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    int offset = 6;
-    response = pn532_packetbuffer[offset++];
+    int offset = 0;
+    response = frame.payload[offset++];
     response <<= 8;
-    response |= pn532_packetbuffer[offset++];
+    response |= frame.payload[offset++];
     response <<= 8;
-    response |= pn532_packetbuffer[offset++];
+    response |= frame.payload[offset++];
     response <<= 8;
-    response |= pn532_packetbuffer[offset++];
+    response |= frame.payload[offset++];
 
-    return response;
+    PN532_UNLOCK_RETURN(obj, response);
 }
 
 /**************************************************************************/
@@ -138,10 +201,12 @@ uint32_t pn532_getFirmwareVersion(pn532_t *obj)
 
     @returns  1 if everything is OK, 0 if timeout occured before an
               ACK was recieved
+
+    The caller holds the device lock until the response has been read.
 */
 /**************************************************************************/
 // default timeout of one second
-bool pn532_sendCommandCheckAck(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen, uint16_t timeout)
+bool pn532_sendCommandCheckAck(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint16_t timeout)
 {
     // write the command
     pn532_writecommand(obj, cmd, cmdlen);
@@ -169,6 +234,107 @@ bool pn532_sendCommandCheckAck(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen, uint1
     return true; // ack'd command
 }
 
+/**************************************************************************/
+/*!
+    @brief  Sends a command and reads its response on the calling task
+
+    @param  cmd       Pointer to the command buffer
+    @param  cmdlen    The size of the command in bytes
+    @param  buff      Buffer receiving the response frame
+    @param  size      Size of buff in bytes
+    @param  frame     Parsed view of the response, payload points into buff
+    @param  timeout   Timeout in ms for the ACK and for the response
+
+    @returns true if the command was ACKed and answered, false otherwise
+*/
+/**************************************************************************/
+bool pn532_transceive(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint8_t *buff, uint16_t size, pn532_frame_t *frame, uint16_t timeout)
+{
+    if (!pn532_sendCommandCheckAck(obj, cmd, cmdlen, timeout))
+        return false;
+
+    return pn532_readresponse(obj, cmd[0], buff, size, frame);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs a command and reads its response into _packetbuffer
+
+    Once pn532_async_start has been called the command is queued to the
+    driver task and the caller sleeps until it completes, otherwise it
+    runs on the calling task. Every driver function goes through here.
+
+    @param  cmd       Pointer to the command buffer (may be _packetbuffer)
+    @param  cmdlen    The size of the command in bytes
+    @param  frame     Parsed view of the response, payload points into
+                      _packetbuffer
+    @param  timeout   Timeout in ms (0 = wait forever)
+
+    @returns true if the command was ACKed and answered, false otherwise
+*/
+/**************************************************************************/
+bool pn532_command(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, pn532_frame_t *frame, uint16_t timeout)
+{
+    return pn532_commandInto(obj, cmd, cmdlen, obj->_packetbuffer, sizeof(obj->_packetbuffer), frame, timeout);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs a command like pn532_command, reading the response into
+            a caller buffer instead of _packetbuffer
+
+    On the calling task the response frame is read straight into buff.
+    Through the driver task only the payload is copied there once.
+
+    @param  cmd       Pointer to the command buffer (may be buff)
+    @param  cmdlen    The size of the command in bytes
+    @param  buff      Buffer receiving the response
+    @param  size      Size of buff in bytes; a response that doesn't fit
+                      fails the command
+    @param  frame     Parsed view of the response, payload points into buff
+    @param  timeout   Timeout in ms (0 = wait forever)
+
+    @returns true if the command was ACKed and answered, false otherwise
+*/
+/**************************************************************************/
+bool pn532_commandInto(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint8_t *buff, uint16_t size, pn532_frame_t *frame, uint16_t timeout)
+{
+    if (pn532_viaDriver(obj))
+        return pn532_async_command(obj, cmd, cmdlen, buff, size, frame, timeout);
+
+    return pn532_transceive(obj, cmd, cmdlen, buff, size, frame, timeout);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Aborts the command the PN532 is executing
+
+    The PN532 drops the current command (e.g. a pending InListPassiveTarget
+    or InAutoPoll) when the host sends an ACK frame and is then ready for
+    the next one. With the driver task running, the command it runs is
+    cancelled and the driver task sends the ACK frame.
+*/
+/**************************************************************************/
+void pn532_abortCommand(pn532_t *obj)
+{
+    uint8_t frame[1 + 6]; // SPI DW, ACK frame
+    size_t n;
+
+    if (pn532_viaDriver(obj))
+    {
+        pn532_async_cancelRunning(obj);
+        return;
+    }
+
+    frame[0] = PN532_SPI_DATAWRITE;
+    n = pn532_frame_encode_ack(frame + 1, sizeof(frame) - 1) + 1;
+
+    obj->_transport->select(obj->_transportCtx);
+    pn532_delay_us(PN532_CS_WAKEUP_US);
+    obj->_transport->transfer(obj->_transportCtx, frame, NULL, n);
+    obj->_transport->deselect(obj->_transportCtx);
+}
+
 /**************************************************************************/
 /*!
     Writes an 8-bit value that sets the state of the PN532's GPIO pins
@@ -192,33 +358,24 @@ bool pn532_sendCommandCheckAck(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen, uint1
 /**************************************************************************/
 bool pn532_writeGPIO(pn532_t *obj, uint8_t pinstate)
 {
+    pn532_lock(obj);
 
     // Make sure pinstate does not try to toggle P32 or P34
     pinstate |= (1 << PN532_GPIO_P32) | (1 << PN532_GPIO_P34);
 
     // Fill command buffer
-    pn532_packetbuffer[0] = PN532_COMMAND_WRITEGPIO;
-    pn532_packetbuffer[1] = PN532_GPIO_VALIDATIONBIT | pinstate; // P3 Pins
-    pn532_packetbuffer[2] = 0x00;                                // P7 GPIO Pins (not used ... taken by SPI)
+    obj->_packetbuffer[0] = PN532_COMMAND_WRITEGPIO;
+    obj->_packetbuffer[1] = PN532_GPIO_VALIDATIONBIT | pinstate; // P3 Pins
+    obj->_packetbuffer[2] = 0x00;                                // P7 GPIO Pins (not used ... taken by SPI)
 
-    PN532_DEBUG("Writing P3 GPIO: %02x\n", pn532_packetbuffer[1]);
+    PN532_DEBUG("Writing P3 GPIO: %02x\n", obj->_packetbuffer[1]);
 
     // Send the WRITEGPIO command (0x0E)
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 3, 1000))
-        return 0x0;
-
-    // Read response packet (00 FF PLEN PLENCHECKSUM D5 CMD+1(0x0F) DATACHECKSUM 00)
-    pn532_readdata(obj, pn532_packetbuffer, 8);
-
-    PN532_DEBUG("Received:");
-    for (int i = 0; i < 8; i++)
-    {
-        PN532_DEBUG(" %02x", pn532_packetbuffer[i]);
-    }
-    PN532_DEBUG("\n");
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 3, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, 0x0);
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x0F);
+    PN532_UNLOCK_RETURN(obj, true);
 }
 
 /**************************************************************************/
@@ -237,39 +394,32 @@ bool pn532_writeGPIO(pn532_t *obj, uint8_t pinstate)
 /**************************************************************************/
 uint8_t pn532_readGPIO(pn532_t *obj)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_READGPIO;
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_READGPIO;
 
     // Send the READGPIO command (0x0C)
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000))
-        return 0x0;
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 1, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, 0x0);
 
     // Read response packet (00 FF PLEN PLENCHECKSUM D5 CMD+1(0x0D) P3 P7 IO1 DATACHECKSUM 00)
-    pn532_readdata(obj, pn532_packetbuffer, 11);
+    if (frame.payloadLen < 3)
+        PN532_UNLOCK_RETURN(obj, 0x0);
 
-    /* READGPIO response should be in the following format:
+    /* READGPIO response payload should be in the following format:
 
     uint8_t            Description
     -------------   ------------------------------------------
-    b0..5           Frame header and preamble (with I2C there is an extra 0x00)
-    b6              P3 GPIO Pins
-    b7              P7 GPIO Pins (not used ... taken by SPI)
-    b8              Interface Mode Pins (not used ... bus select pins)
-    b9..10          checksum */
-
-    int p3offset = 6;
-
-    PN532_DEBUG("Received:");
-    for (int i = 0; i < 11; i++)
-    {
-        PN532_DEBUG(" %02x", pn532_packetbuffer[i]);
-    }
-    PN532_DEBUG("\n");
+    b0              P3 GPIO Pins
+    b1              P7 GPIO Pins (not used ... taken by SPI)
+    b2              Interface Mode Pins (not used ... bus select pins) */
 
-    PN532_DEBUG("P3 GPIO: %02x\n", pn532_packetbuffer[p3offset]);
-    PN532_DEBUG("P7 GPIO: %02x\n", pn532_packetbuffer[p3offset + 1]);
-    PN532_DEBUG("IO GPIO: %02x\n", pn532_packetbuffer[p3offset + 2]);
+    PN532_DEBUG("P3 GPIO: %02x\n", frame.payload[0]);
+    PN532_DEBUG("P7 GPIO: %02x\n", frame.payload[1]);
+    PN532_DEBUG("IO GPIO: %02x\n", frame.payload[2]);
     // Note: You can use the IO GPIO value to detect the serial bus being used
-    switch (pn532_packetbuffer[p3offset + 2])
+    switch (frame.payload[2])
     {
     case 0x00: // Using UART
         PN532_DEBUG("Using UART (IO = 0x00)\n");
@@ -282,7 +432,7 @@ uint8_t pn532_readGPIO(pn532_t *obj)
         break;
     }
 
-    return pn532_packetbuffer[p3offset];
+    PN532_UNLOCK_RETURN(obj, frame.payload[0]);
 }
 
 /**************************************************************************/
@@ -292,19 +442,144 @@ uint8_t pn532_readGPIO(pn532_t *obj)
 /**************************************************************************/
 bool pn532_SAMConfig(pn532_t *obj)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
-    pn532_packetbuffer[1] = 0x01; // normal mode;
-    pn532_packetbuffer[2] = 0x14; // timeout 50ms * 20 = 1 second
-    pn532_packetbuffer[3] = 0x01; // use IRQ pin!
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
+    obj->_packetbuffer[1] = 0x01; // normal mode;
+    obj->_packetbuffer[2] = 0x14; // timeout 50ms * 20 = 1 second
+    obj->_packetbuffer[3] = 0x01; // use IRQ pin!
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 4, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Puts the PN532 into power down until a wake-up source fires
+
+    Configuration (SAM, RFConfiguration) is kept, wake it with
+    pn532_resume. The RF level detector only reacts to an external field
+    (a phone or another reader), passive cards don't wake the PN532.
+
+    @param  wakeUpEnable  Wake-up sources (PN532_WAKEUP_*)
+    @param  generateIrq   true to pull IRQ low on wake-up
+
+    @returns 1 if the PN532 went to power down, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_powerDown(pn532_t *obj, uint8_t wakeUpEnable, bool generateIrq)
+{
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_POWERDOWN;
+    obj->_packetbuffer[1] = wakeUpEnable;
+    obj->_packetbuffer[2] = generateIrq ? 0x01 : 0x00;
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 3, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    if (frame.payloadLen < 1 || (frame.payload[0] & 0x3F) != 0x00)
+    {
+        PN532_DEBUG("PowerDown failed (%02x)\n", frame.payloadLen ? frame.payload[0] : 0xFF);
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    obj->_poweredDown = true;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Waits in power down for up to ms milliseconds
+
+    With the IRQ line wired (and generateIrq set in pn532_powerDown) the
+    task wakes as soon as an enabled source (e.g. an external RF field)
+    woke the PN532.
+
+    @returns true if the PN532 woke up by itself, false after ms
+*/
+/**************************************************************************/
+bool pn532_sleep(pn532_t *obj, uint16_t ms)
+{
+    // the driver task waits, so no queued command is sent in power down
+    if (pn532_viaDriver(obj))
+    {
+        pn532_sleep_args_t args = {obj, ms};
+        return pn532_async_call(obj, pn532_sleepCall, &args);
+    }
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    if (obj->_irqSem == NULL || !obj->_poweredDown)
+    {
+        PN532_DELAY(ms);
         return false;
+    }
+
+    return pn532_waitready(obj, ms);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Fast resume from power down
+
+    A short SS low pulse wakes the PN532. Configuration is retained in
+    power down, so unlike after pn532_begin there is no 1 s wake-up pulse
+    and no SAMConfig. Starts the wake-to-target latency measurement, see
+    pn532_wakeLatency.
+*/
+/**************************************************************************/
+void pn532_resume(pn532_t *obj)
+{
+    if (pn532_viaDriver(obj))
+    {
+        pn532_async_call(obj, pn532_resumeCall, obj);
+        return;
+    }
+
+    // the driver task serialises the device by itself, and the task that
+    // queued the resume may hold the lock while it waits for it
+    if (obj->_asyncTask == NULL)
+        pn532_lock(obj);
+
+    obj->_transport->select(obj->_transportCtx);
+    pn532_delay_us(PN532_RESUME_US);
+    obj->_transport->deselect(obj->_transportCtx);
+
+    // a status read releases IRQ if the PN532 pulled it on wake-up
+    if (obj->_irqSem != NULL)
+        pn532_isready(obj);
+
+    obj->_poweredDown = false;
+    obj->_wakeAt = pn532_time_now();
+
+    if (obj->_asyncTask == NULL)
+        pn532_unlock(obj);
+}
 
-    // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 8);
+/**************************************************************************/
+/*!
+    @brief  Latency of the last wake-up
+
+    @returns Microseconds from pn532_resume to the first target activated
+             after it, 0 if none was measured yet
+*/
+/**************************************************************************/
+uint32_t pn532_wakeLatency(pn532_t *obj)
+{
+    return obj->_wakeLatency;
+}
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x15);
+void pn532_targetfound(pn532_t *obj)
+{
+    if (obj->_wakeAt == 0)
+        return;
+
+    obj->_wakeLatency = (uint32_t)(pn532_time_now() - obj->_wakeAt);
+    obj->_wakeAt = 0;
+    PN532_DEBUG("Wake-to-target latency: %u us\n", (unsigned)obj->_wakeLatency);
 }
 
 /**************************************************************************/
@@ -319,18 +594,175 @@ bool pn532_SAMConfig(pn532_t *obj)
 /**************************************************************************/
 bool pn532_setPassiveActivationRetries(pn532_t *obj, uint8_t maxRetries)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
-    pn532_packetbuffer[1] = 5;    // Config item 5 (MaxRetries)
-    pn532_packetbuffer[2] = 0xFF; // MxRtyATR (default = 0xFF)
-    pn532_packetbuffer[3] = 0x01; // MxRtyPSL (default = 0x01)
-    pn532_packetbuffer[4] = maxRetries;
-
     PN532_DEBUG("Setting MxRtyPassiveActivation to %d\n", maxRetries);
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 5, 1000))
-        return 0x0; // no ACK
+    // MxRtyATR and MxRtyPSL keep their defaults
+    return pn532_setMaxRetries(obj, 0xFF, 0x01, maxRetries);
+}
+
+/**************************************************************************/
+/*!
+    Writes one item of the RFConfiguration
+
+    @param  item      Configuration item (PN532_RFCFG_*)
+    @param  data      ConfigurationData of the item
+    @param  dataLen   Length of data in bytes
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_rfConfiguration(pn532_t *obj, uint8_t item, const uint8_t *data, uint8_t dataLen)
+{
+    if (dataLen > PN532_RFCFG_MAX_DATA)
+        return false;
+
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
+    obj->_packetbuffer[1] = item;
+    memcpy(obj->_packetbuffer + 2, data, dataLen);
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 2 + dataLen, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, 0x0);
+
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    Switches the RF field on or off
+
+    Initiator commands switch the field back on when they need it, so
+    the field can be turned off between detection cycles.
+
+    @param  on        true to switch the field on
+    @param  autoRFCA  true to check for an external field first
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setRFField(pn532_t *obj, bool on, bool autoRFCA)
+{
+    uint8_t field = (on ? PN532_RF_FIELD_ON : 0) | (autoRFCA ? PN532_RF_FIELD_AUTO_RFCA : 0);
+
+    return pn532_rfConfiguration(obj, PN532_RFCFG_FIELD, &field, 1);
+}
+
+/**************************************************************************/
+/*!
+    Sets the ATR_RES timeout and the card response timeout
+
+    @param  atrResTimeout   Timeout for ATR_RES (DEP activation)
+    @param  retryTimeout    Timeout for card responses to
+                            InCommunicateThru/InDataExchange
 
-    return 1;
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setRFTimings(pn532_t *obj, pn532_rf_timeout_t atrResTimeout, pn532_rf_timeout_t retryTimeout)
+{
+    uint8_t timings[] = {
+        0x00,          // RFU
+        atrResTimeout,
+        retryTimeout,
+    };
+
+    return pn532_rfConfiguration(obj, PN532_RFCFG_TIMINGS, timings, sizeof(timings));
+}
+
+/**************************************************************************/
+/*!
+    Sets how often a card exchange is retried after a timeout
+
+    @param  maxRetries    0x00 for no retries, 0xFF to retry forever
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setMaxRetryCom(pn532_t *obj, uint8_t maxRetries)
+{
+    return pn532_rfConfiguration(obj, PN532_RFCFG_MAXRTYCOM, &maxRetries, 1);
+}
+
+/**************************************************************************/
+/*!
+    Sets the activation retry counts
+
+    @param  mxRtyATR                ATR_REQ retries (DEP)
+    @param  mxRtyPSL                PSL_REQ/PPS retries
+    @param  mxRtyPassiveActivation  Passive activation retries
+                                    (0xFF = retry forever)
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setMaxRetries(pn532_t *obj, uint8_t mxRtyATR, uint8_t mxRtyPSL, uint8_t mxRtyPassiveActivation)
+{
+    uint8_t retries[] = {mxRtyATR, mxRtyPSL, mxRtyPassiveActivation};
+
+    return pn532_rfConfiguration(obj, PN532_RFCFG_MAXRETRIES, retries, sizeof(retries));
+}
+
+/**************************************************************************/
+/*!
+    Sets the CIU analog settings used at 106 kbps type A
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setAnalog106A(pn532_t *obj, const pn532_analog_106a_t *analog)
+{
+    uint8_t data[] = {
+        analog->rfCfg, analog->gsNOn, analog->cwGsP, analog->modGsP,
+        analog->demodWhenRFOn, analog->rxThreshold, analog->demodWhenRFOff,
+        analog->gsNOff, analog->modWidth, analog->mifNFC, analog->txBitPhase,
+    };
+
+    return pn532_rfConfiguration(obj, PN532_RFCFG_ANALOG_106A, data, sizeof(data));
+}
+
+/**************************************************************************/
+/*!
+    Sets the CIU analog settings used at 212 and 424 kbps
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setAnalog212_424(pn532_t *obj, const pn532_analog_212_424_t *analog)
+{
+    uint8_t data[] = {
+        analog->rfCfg, analog->gsNOn, analog->cwGsP, analog->modGsP,
+        analog->demodWhenRFOn, analog->rxThreshold, analog->demodWhenRFOff,
+        analog->gsNOff,
+    };
+
+    return pn532_rfConfiguration(obj, PN532_RFCFG_ANALOG_212_424, data, sizeof(data));
+}
+
+/**************************************************************************/
+/*!
+    Applies a set of RF settings (retries, timeouts, analog settings)
+
+    Stops at the first item the PN532 rejects.
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setRFConfig(pn532_t *obj, const pn532_rf_config_t *config)
+{
+    bool ok;
+
+    pn532_lock(obj);
+
+    ok = pn532_setMaxRetries(obj, config->mxRtyATR, config->mxRtyPSL, config->mxRtyPassiveActivation) &&
+         pn532_setMaxRetryCom(obj, config->mxRtyCOM) &&
+         pn532_setRFTimings(obj, config->atrResTimeout, config->retryTimeout) &&
+         (config->analog106A == NULL || pn532_setAnalog106A(obj, config->analog106A)) &&
+         (config->analog212_424 == NULL || pn532_setAnalog212_424(obj, config->analog212_424)) &&
+         pn532_setRFField(obj, true, config->autoRFCA);
+
+    PN532_UNLOCK_RETURN(obj, ok);
 }
 
 /***** ISO14443A Commands ******/
@@ -350,206 +782,579 @@ bool pn532_setPassiveActivationRetries(pn532_t *obj, uint8_t maxRetries)
 /**************************************************************************/
 bool pn532_readPassiveTargetID(pn532_t *obj, uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-    pn532_packetbuffer[1] = 1; // max 1 cards at once (we can set this to 2 later)
-    pn532_packetbuffer[2] = cardbaudrate;
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    obj->_packetbuffer[1] = 1; // max 1 cards at once (we can set this to 2 later)
+    obj->_packetbuffer[2] = cardbaudrate;
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 3, timeout))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 3, &frame, timeout))
     {
         PN532_DEBUG("No card(s) read\n");
-        return 0x0; // no cards read
+        PN532_UNLOCK_RETURN(obj, 0x0); // no cards read
     }
 
-    // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 20);
-    // check some basic stuff
-
-    /* ISO14443A card response should be in the following format:
+    /* ISO14443A card response payload should be in the following format:
 
     uint8_t            Description
     -------------   ------------------------------------------
-    b0..6           Frame header and preamble
-    b7              Tags Found
-    b8              Tag Number (only one used in this example)
-    b9..10          SENS_RES
-    b11             SEL_RES
-    b12             NFCID Length
-    b13..NFCIDLen   NFCID                                      */
-
-    PN532_DEBUG("Found %d tags\n", pn532_packetbuffer[7]);
-    if (pn532_packetbuffer[7] != 1)
-        return 0;
-
-    uint16_t sens_res = pn532_packetbuffer[9];
+    b0              Tags Found
+    b1              Tag Number (only one used in this example)
+    b2..3           SENS_RES
+    b4              SEL_RES
+    b5              NFCID Length
+    b6..NFCIDLen    NFCID                                      */
+
+    PN532_DEBUG("Found %d tags\n", frame.payload[0]);
+    if (frame.payloadLen < 6 || frame.payload[0] != 1)
+        PN532_UNLOCK_RETURN(obj, 0);
+
+    uint16_t sens_res = frame.payload[2];
     sens_res <<= 8;
-    sens_res |= pn532_packetbuffer[10];
+    sens_res |= frame.payload[3];
     PN532_DEBUG("ATQA: %02x\n", sens_res);
-    PN532_DEBUG("SAK: %02x\n", pn532_packetbuffer[11]);
+    PN532_DEBUG("SAK: %02x\n", frame.payload[4]);
 
     /* Card appears to be Mifare Classic */
-    *uidLength = pn532_packetbuffer[12];
+    if (frame.payload[5] > 7 || 6 + frame.payload[5] > frame.payloadLen)
+        PN532_UNLOCK_RETURN(obj, 0);
+    *uidLength = frame.payload[5];
 
-    for (uint8_t i = 0; i < pn532_packetbuffer[12]; i++)
+    for (uint8_t i = 0; i < frame.payload[5]; i++)
     {
-        uid[i] = pn532_packetbuffer[13 + i];
+        uid[i] = frame.payload[6 + i];
     }
 
     PN532_DEBUG("UID:");
-    for (int i = 0; i < pn532_packetbuffer[12]; i++)
+    for (int i = 0; i < frame.payload[5]; i++)
+    {
+        PN532_DEBUG(" %02x", uid[i]);
+    }
+    PN532_DEBUG("\n");
+
+    PN532_UNLOCK_RETURN(obj, 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Exchanges an APDU with the currently inlisted peer
+
+    @param  send            Pointer to data to send
+    @param  sendLength      Length of the data to send
+    @param  response        Pointer to response data
+    @param  responseLength  Size of response on input, the response data
+                            length on output
+
+    @returns true if the whole response fit into response, false otherwise
+*/
+/**************************************************************************/
+bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint16_t sendLength, uint8_t *response, uint8_t *responseLength)
+{
+    uint16_t length = *responseLength;
+    uint8_t status;
+
+    pn532_lock(obj);
+
+    if (!pn532_inDataExchangeLink(obj, obj->_inListedTag, send, sendLength, response, &length, &status))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    if (status & PN532_STATUS_MI)
+    {
+        PN532_DEBUG("Chained response, use pn532_isodep_transceive\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    *responseLength = length;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  One InDataExchange round trip, a single link of a chain
+
+    @param  tg              Target number, PN532_TG_MI set when more
+                            data follows this chunk
+    @param  send            Pointer to data to send (may be empty to
+                            fetch the next chunk of a chained response)
+    @param  sendLength      Length of the data to send
+    @param  response        Pointer to response data
+    @param  responseLength  Size of response on input, the response data
+                            length on output
+    @param  status          PN532 status byte, PN532_STATUS_MI is set when
+                            the target has more data
+
+    @returns true if the exchange succeeded and the data fit into response
+*/
+/**************************************************************************/
+bool pn532_inDataExchangeLink(pn532_t *obj, uint8_t tg, const uint8_t *send, uint16_t sendLength, uint8_t *response, uint16_t *responseLength, uint8_t *status)
+{
+    if (sendLength > PN532_PACKBUFFSIZ - 2)
+    {
+        PN532_DEBUG("APDU length too long for packet buffer\n");
+        return false;
+    }
+
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = tg;
+    if (sendLength)
+        memcpy(obj->_packetbuffer + 2, send, sendLength);
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, sendLength + 2, &frame, 1000))
+    {
+        PN532_DEBUG("Could not send APDU\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    if (frame.payloadLen < 1)
+    {
+        PN532_DEBUG("Response never received for APDU...\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    if ((frame.payload[0] & 0x3f) != 0)
+    {
+        PN532_DEBUG("Status code indicates an error\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    uint16_t length = frame.payloadLen - 1;
+    if (length > *responseLength)
+    {
+        PN532_DEBUG("Response too long (%d bytes)\n", length);
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    memcpy(response, frame.payload + 1, length);
+    *responseLength = length;
+    *status = frame.payload[0];
+
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends raw bytes to the selected target (InCommunicateThru)
+
+    Unlike InDataExchange no protocol handling is done by the PN532 apart
+    from CRC, so card commands it doesn't know (e.g. FAST_READ) get
+    through unchanged.
+
+    @param  send            Pointer to data to send
+    @param  sendLength      Length of the data to send
+    @param  response        Pointer to response data
+    @param  responseLength  Size of response on input, the response data
+                            length on output
+
+    @returns 1 if the target answered, 0 otherwise
+*/
+/**************************************************************************/
+bool pn532_inCommunicateThru(pn532_t *obj, const uint8_t *send, uint16_t sendLength, uint8_t *response, uint16_t *responseLength)
+{
+    if (sendLength > PN532_PACKBUFFSIZ - 1)
+        return false;
+
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INCOMMUNICATETHRU;
+    memcpy(obj->_packetbuffer + 1, send, sendLength);
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, sendLength + 1, &frame, 1000))
+    {
+        PN532_DEBUG("Could not send raw data\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    if (frame.payloadLen < 1 || (frame.payload[0] & 0x3f) != 0)
+    {
+        PN532_DEBUG("Raw exchange failed\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    if (frame.payloadLen - 1 > *responseLength)
+    {
+        PN532_DEBUG("Response doesn't fit the buffer\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    *responseLength = frame.payloadLen - 1;
+    memcpy(response, frame.payload + 1, *responseLength);
+
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  'InLists' a passive target. PN532 acting as reader/initiator,
+            peer acting as card/responder.
+*/
+/**************************************************************************/
+bool pn532_inListPassiveTarget(pn532_t *obj)
+{
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    obj->_packetbuffer[1] = 1;
+    obj->_packetbuffer[2] = 0;
+
+    PN532_DEBUG("About to inList passive target\n");
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 3, &frame, 30000))
+    {
+        PN532_DEBUG("Could not send inlist message\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    if (frame.payloadLen < 2)
+    {
+        PN532_DEBUG("Unexpected response to inlist passive host\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    if (frame.payload[0] != 1)
+    {
+        PN532_DEBUG("Unhandled number of targets inlisted\n");
+        PN532_DEBUG("Number of tags inlisted: %d\n", frame.payload[0]);
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    obj->_inListedTag = frame.payload[1];
+    PN532_DEBUG("Tag number: %d\n", obj->_inListedTag);
+
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Lists up to two ISO14443A targets in one field activation
+
+    Unlike pn532_readPassiveTargetID this does not give up when two cards
+    are presented at once: the PN532 resolves the collision and activates
+    both. Switch between them with pn532_inSelect.
+
+    @param  maxTg     Maximum number of targets (1..PN532_MAX_TARGETS)
+    @param  targets   Array of maxTg targets to fill
+    @param  timeout   Timeout in ms before giving up (0 = wait forever)
+
+    @returns Number of targets found
+*/
+/**************************************************************************/
+uint8_t pn532_inListPassiveTargets(pn532_t *obj, uint8_t maxTg, pn532_target_t *targets, uint16_t timeout)
+{
+    if (maxTg == 0 || maxTg > PN532_MAX_TARGETS)
+        return 0;
+
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    obj->_packetbuffer[1] = maxTg;
+    obj->_packetbuffer[2] = PN532_MIFARE_ISO14443A;
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 3, &frame, timeout))
+    {
+        PN532_DEBUG("No card(s) read\n");
+        PN532_UNLOCK_RETURN(obj, 0);
+    }
+
+    if (frame.payloadLen < 1)
+        PN532_UNLOCK_RETURN(obj, 0);
+
+    /* Payload: number of targets, then per target Tg, SENS_RES (2),
+       SEL_RES, NFCID length, NFCID and the ATS of ISO14443-4 cards */
+
+    uint8_t found = frame.payload[0] > maxTg ? maxTg : frame.payload[0];
+    uint16_t pos = 1;
+    for (uint8_t i = 0; i < found; i++)
+    {
+        uint16_t used = pn532_parsetarget(frame.payload + pos, frame.payloadLen - pos, false, &targets[i]);
+        if (used == 0)
+        {
+            found = i;
+            break;
+        }
+        pos += used;
+    }
+
+    PN532_DEBUG("Found %d tags\n", found);
+    if (found)
+    {
+        obj->_inListedTag = targets[0].tg;
+        pn532_targetfound(obj);
+    }
+
+    PN532_UNLOCK_RETURN(obj, found);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Activates a known ISO14443A target again by its UID
+
+    A MIFARE Classic drops out of the active state after a failed
+    authentication. InListPassiveTarget with the UID as initiator data
+    brings back that very card, even with other cards in the field.
+    Targets activated before are released.
+
+    @param  uid       UID of the target (4 or 7 bytes)
+    @param  uidLen    Length of uid in bytes
+    @param  target    Target filled with the new activation data
+    @param  timeout   Timeout in ms before giving up (0 = wait forever)
+
+    @returns true if the target is active again, false otherwise
+*/
+/**************************************************************************/
+bool pn532_reactivateTarget(pn532_t *obj, const uint8_t *uid, uint8_t uidLen, pn532_target_t *target, uint16_t timeout)
+{
+    uint8_t len = 3;
+
+    if (uidLen != 4 && uidLen != 7)
+        return false;
+
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    obj->_packetbuffer[1] = 1;
+    obj->_packetbuffer[2] = PN532_MIFARE_ISO14443A;
+
+    // a double size UID starts with the cascade tag, as in the anticollision
+    if (uidLen == 7)
+        obj->_packetbuffer[len++] = 0x88;
+    memcpy(obj->_packetbuffer + len, uid, uidLen);
+    len += uidLen;
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, len, &frame, timeout))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    if (frame.payloadLen < 1 || frame.payload[0] != 1 ||
+        !pn532_parsetarget(frame.payload + 1, frame.payloadLen - 1, false, target) ||
+        target->uidLen != uidLen || memcmp(target->uid, uid, uidLen) != 0)
+    {
+        PN532_DEBUG("Target not reactivated\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    obj->_inListedTag = target->tg;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Selects one of the inlisted targets for the following commands
+
+    @param  tg        Logical target number reported when it was inlisted
+
+    @returns 1 if the target was selected, 0 otherwise
+*/
+/**************************************************************************/
+bool pn532_inSelect(pn532_t *obj, uint8_t tg)
+{
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INSELECT;
+    obj->_packetbuffer[1] = tg;
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 2, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    if (frame.payloadLen < 1 || (frame.payload[0] & 0x3f) != 0)
+    {
+        PN532_DEBUG("Could not select target %d\n", tg);
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    obj->_inListedTag = tg;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Changes the bit rates used with an activated target (InPSL)
+
+    @param  tg        Logical target number
+    @param  brIt      Initiator to target rate (PN532_BAUD_*)
+    @param  brTi      Target to initiator rate (PN532_BAUD_*)
+
+    @returns 1 if the target switched, 0 otherwise
+*/
+/**************************************************************************/
+bool pn532_inPSL(pn532_t *obj, uint8_t tg, uint8_t brIt, uint8_t brTi)
+{
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INPSL;
+    obj->_packetbuffer[1] = tg;
+    obj->_packetbuffer[2] = brIt;
+    obj->_packetbuffer[3] = brTi;
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 4, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    if (frame.payloadLen < 1 || (frame.payload[0] & 0x3f) != 0)
     {
-        PN532_DEBUG(" %02x", uid[i]);
+        PN532_DEBUG("PSL to %d/%d failed\n", brIt, brTi);
+        PN532_UNLOCK_RETURN(obj, false);
     }
-    PN532_DEBUG("\n");
 
-    return 1;
+    PN532_UNLOCK_RETURN(obj, true);
 }
 
 /**************************************************************************/
 /*!
-    @brief  Exchanges an APDU with the currently inlisted peer
-
-    @param  send            Pointer to data to send
-    @param  sendLength      Length of the data to send
-    @param  response        Pointer to response data
-    @param  responseLength  Pointer to the response data length
+    @brief  Lets the PN532 poll for targets on its own (InAutoPoll)
+
+    The PN532 cycles through the given target types with the RF field
+    duty-cycled by the chip itself and only raises IRQ/ready once a target
+    is activated (or pollNr rounds found nothing). The task sleeps in
+    waitready meanwhile. The targets found stay inlisted, so data
+    exchange can start right away.
+
+    @param  pollNr      Polling rounds (PN532_AUTOPOLL_ENDLESS = until found)
+    @param  period      Pause between rounds in units of 150 ms (1..15)
+    @param  types       Target types to poll for (PN532_AUTOPOLL_*), in order
+    @param  typesLen    Number of target types (1..PN532_AUTOPOLL_MAX_TYPES)
+    @param  targets     Receives the type and target data of each target
+    @param  maxTargets  Size of targets (up to PN532_MAX_TARGETS are reported)
+    @param  timeout     Timeout in ms before giving up (0 = wait forever)
+
+    @returns Number of targets found
 */
 /**************************************************************************/
-bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8_t *response, uint8_t *responseLength)
+uint8_t pn532_inAutoPoll(pn532_t *obj, uint8_t pollNr, uint8_t period, const uint8_t *types, uint8_t typesLen, pn532_autopoll_t *targets, uint8_t maxTargets, uint16_t timeout)
 {
-    if (sendLength > PN532_PACKBUFFSIZ - 2)
-    {
-        PN532_DEBUG("APDU length too long for packet buffer\n");
-        return false;
-    }
-    uint8_t i;
+    if (typesLen == 0 || typesLen > PN532_AUTOPOLL_MAX_TYPES || maxTargets == 0)
+        return 0;
 
-    pn532_packetbuffer[0] = 0x40; // PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = obj->_inListedTag;
-    for (i = 0; i < sendLength; ++i)
-    {
-        pn532_packetbuffer[i + 2] = send[i];
-    }
+    pn532_lock(obj);
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, sendLength + 2, 1000))
+    obj->_packetbuffer[0] = PN532_COMMAND_INAUTOPOLL;
+    obj->_packetbuffer[1] = pollNr;
+    obj->_packetbuffer[2] = period;
+    memcpy(obj->_packetbuffer + 3, types, typesLen);
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 3 + typesLen, &frame, timeout))
     {
-        PN532_DEBUG("Could not send APDU\n");
-        return false;
+        PN532_DEBUG("No target found\n");
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    if (!pn532_waitready(obj, 1000))
+    if (frame.payloadLen < 1)
     {
-        PN532_DEBUG("Response never received for APDU...\n");
-        return false;
+        PN532_DEBUG("Unexpected response to autopoll\n");
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    pn532_readdata(obj, pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    /* Response payload:
 
-    if (pn532_packetbuffer[0] == 0 && pn532_packetbuffer[1] == 0 && pn532_packetbuffer[2] == 0xff)
+    uint8_t            Description
+    -------------   ------------------------------------------
+    b0              Targets found
+    b1              Type of first target
+    b2              Length of its target data
+    b3..            Target data (same layout as InListPassiveTarget,
+                    starting with Tg), then the next target     */
+
+    PN532_DEBUG("Found %d targets\n", frame.payload[0]);
+    uint8_t found = 0;
+    uint16_t pos = 1;
+    while (found < frame.payload[0] && found < maxTargets)
     {
-        uint8_t length = pn532_packetbuffer[3];
-        if (pn532_packetbuffer[4] != (uint8_t)(~length + 1))
-        {
-            PN532_DEBUG("Length check invalid %02x%02x\n", length, (~length) + 1);
-            return false;
-        }
-        if (pn532_packetbuffer[5] == PN532_PN532TOHOST && pn532_packetbuffer[6] == PN532_RESPONSE_INDATAEXCHANGE)
-        {
-            if ((pn532_packetbuffer[7] & 0x3f) != 0)
-            {
-                PN532_DEBUG("Status code indicates an error\n");
-                return false;
-            }
-
-            length -= 3;
-
-            if (length > *responseLength)
-            {
-                length = *responseLength; // silent truncation...
-            }
-
-            for (i = 0; i < length; ++i)
-            {
-                response[i] = pn532_packetbuffer[8 + i];
-            }
-            *responseLength = length;
-
-            return true;
-        }
-        else
-        {
-            PN532_DEBUG("Don't know how to handle this command: %02x\n", pn532_packetbuffer[6]);
-            return false;
-        }
+        uint8_t len;
+        if (pos + 2 > frame.payloadLen)
+            break;
+        len = frame.payload[pos + 1];
+        if (len < 1 || len > PN532_TARGETDATA_MAX || pos + 2 + len > frame.payloadLen)
+            break;
+
+        targets[found].type = frame.payload[pos];
+        targets[found].dataLen = len;
+        memcpy(targets[found].data, frame.payload + pos + 2, len);
+        PN532_DEBUG("Target type: %02x\n", targets[found].type);
+        pos += 2 + len;
+        found++;
     }
-    else
+
+    if (found)
     {
-        PN532_DEBUG("Preamble missing\n");
-        return false;
+        obj->_inListedTag = targets[0].data[0];
+        pn532_targetfound(obj);
     }
+
+    PN532_UNLOCK_RETURN(obj, found);
 }
 
 /**************************************************************************/
 /*!
-    @brief  'InLists' a passive target. PN532 acting as reader/initiator,
-            peer acting as card/responder.
+    @brief  Decodes an ISO14443A target found by InAutoPoll
+
+    @param  poll      Target returned by pn532_inAutoPoll
+    @param  target    Receives Tg, ATQA, SAK, UID and ATS
+
+    @returns 1 for an ISO14443A target with a valid UID, 0 otherwise
 */
 /**************************************************************************/
-bool pn532_inListPassiveTarget(pn532_t *obj)
+bool pn532_autoPollTarget(const pn532_autopoll_t *poll, pn532_target_t *target)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-    pn532_packetbuffer[1] = 1;
-    pn532_packetbuffer[2] = 0;
-
-    PN532_DEBUG("About to inList passive target\n");
-
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 3, 1000))
-    {
-        PN532_DEBUG("Could not send inlist message\n");
+    if (poll->type != PN532_AUTOPOLL_GENERIC_106 &&
+        poll->type != PN532_AUTOPOLL_MIFARE &&
+        poll->type != PN532_AUTOPOLL_ISO14443_4A)
         return false;
-    }
 
-    if (!pn532_waitready(obj, 30000))
-    {
-        return false;
-    }
+    // Anything after the UID in the reported data is the ATS
+    return pn532_parsetarget(poll->data, poll->dataLen, true, target) != 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decodes ISO14443A target data (Tg, SENS_RES, SEL_RES, NFCID
+            length, NFCID, [ATS])
 
-    pn532_readdata(obj, pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    @param  data      Target data
+    @param  len       Bytes available in data
+    @param  sized     data holds exactly one target, so whatever follows the
+                      NFCID is the ATS; otherwise the ATS is only expected
+                      when SEL_RES announces ISO14443-4 support
+    @param  target    Target to fill
 
-    if (pn532_packetbuffer[0] == 0 && pn532_packetbuffer[1] == 0 && pn532_packetbuffer[2] == 0xff)
-    {
-        uint8_t length = pn532_packetbuffer[3];
-        if (pn532_packetbuffer[4] != (uint8_t)(~length + 1))
-        {
-            PN532_DEBUG("Length check invalid %02x%02x\n", length, (~length) + 1);
-            return false;
-        }
-        if (pn532_packetbuffer[5] == PN532_PN532TOHOST && pn532_packetbuffer[6] == PN532_RESPONSE_INLISTPASSIVETARGET)
-        {
-            if (pn532_packetbuffer[7] != 1)
-            {
-                PN532_DEBUG("Unhandled number of targets inlisted\n");
-                PN532_DEBUG("Number of tags inlisted: %d\n", pn532_packetbuffer[7]);
-                return false;
-            }
+    @returns Number of bytes used, 0 if the data is malformed
+*/
+/**************************************************************************/
+uint16_t pn532_parsetarget(const uint8_t *data, uint16_t len, bool sized, pn532_target_t *target)
+{
+    if (len < 5 || data[4] > sizeof(target->uid) || 5 + data[4] > len)
+        return 0;
 
-            obj->_inListedTag = pn532_packetbuffer[8];
-            PN532_DEBUG("Tag number: %d\n", obj->_inListedTag);
+    target->tg = data[0];
+    target->atqa = ((uint16_t)data[1] << 8) | data[2];
+    target->sak = data[3];
+    target->uidLen = data[4];
+    memcpy(target->uid, data + 5, target->uidLen);
+    target->atsLen = 0;
 
-            return true;
-        }
-        else
-        {
-            PN532_DEBUG("Unexpected response to inlist passive host\n");
-            return false;
-        }
-    }
-    else
+    uint16_t pos = 5 + target->uidLen;
+    bool ats = sized ? pos < len : (target->sak & 0x20) && pos < len;
+    if (ats)
     {
-        PN532_DEBUG("Preamble missing\n");
-        return false;
+        // TL counts itself
+        uint8_t tl = data[pos];
+        if (tl < 1 || pos + tl > len)
+            return 0;
+        target->atsLen = tl > sizeof(target->ats) ? sizeof(target->ats) : tl;
+        memcpy(target->ats, data + pos, target->atsLen);
+        pos += tl;
     }
 
-    return true;
+    PN532_DEBUG("Tg %d ATQA %04x SAK %02x UID len %d ATS len %d\n",
+                target->tg, target->atqa, target->sak, target->uidLen, target->atsLen);
+    return pos;
 }
 
 /***** Mifare Classic Functions ******/
@@ -604,6 +1409,8 @@ bool pn532_mifareclassic_IsTrailerBlock(pn532_t *obj, uint32_t uiBlock)
 /**************************************************************************/
 uint8_t pn532_mifareclassic_AuthenticateBlock(pn532_t *obj, uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, uint8_t *keyData)
 {
+    pn532_lock(obj);
+
     uint8_t i;
 
     // Hang on to the key and uid data
@@ -625,37 +1432,33 @@ uint8_t pn532_mifareclassic_AuthenticateBlock(pn532_t *obj, uint8_t *uid, uint8_
     MIFARE_DEBUG("\n");
 
     // Prepare the authentication command //
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE; /* Data Exchange Header */
-    pn532_packetbuffer[1] = 1;                            /* Max card numbers */
-    pn532_packetbuffer[2] = (keyNumber) ? MIFARE_CMD_AUTH_B : MIFARE_CMD_AUTH_A;
-    pn532_packetbuffer[3] = blockNumber; /* Block Number (1K = 0..63, 4K = 0..255 */
-    memcpy(pn532_packetbuffer + 4, obj->_key, 6);
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE; /* Data Exchange Header */
+    obj->_packetbuffer[1] = obj->_inListedTag;            /* Target number */
+    obj->_packetbuffer[2] = (keyNumber) ? MIFARE_CMD_AUTH_B : MIFARE_CMD_AUTH_A;
+    obj->_packetbuffer[3] = blockNumber; /* Block Number (1K = 0..63, 4K = 0..255 */
+    memcpy(obj->_packetbuffer + 4, obj->_key, 6);
     for (i = 0; i < obj->_uidLen; i++)
     {
-        pn532_packetbuffer[10 + i] = obj->_uid[i]; /* 4 uint8_t card ID */
+        obj->_packetbuffer[10 + i] = obj->_uid[i]; /* 4 uint8_t card ID */
     }
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 10 + obj->_uidLen, 1000))
-        return 0;
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 10 + obj->_uidLen, &frame, 1000))
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Read the response packet
-    pn532_readdata(obj, pn532_packetbuffer, 12);
+    if (frame.payloadLen < 1)
+        PN532_UNLOCK_RETURN(obj, 0);
 
-    // check if the response is valid and we are authenticated???
-    // for an auth success it should be bytes 5-7: 0xD5 0x41 0x00
-    // Mifare auth error is technically uint8_t 7: 0x14 but anything other and 0x00 is not good
-    if (pn532_packetbuffer[6] != 0x00) //CHANGED orig: 7
+    // for an auth success the status byte following 0xD5 0x41 is 0x00
+    // Mifare auth error is technically 0x14 but anything other and 0x00 is not good
+    if (frame.payload[0] != 0x00)
     {
-        MIFARE_DEBUG("Authentification failed\n");
-        for (int i = 0; i < 12; i++)
-    {
-        MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
-    }
-    MIFARE_DEBUG("\n");
-        return 0;
+        MIFARE_DEBUG("Authentification failed, status %02x\n", frame.payload[0]);
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -673,39 +1476,39 @@ uint8_t pn532_mifareclassic_AuthenticateBlock(pn532_t *obj, uint8_t *uid, uint8_
 /**************************************************************************/
 uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uint8_t *data)
 {
+    pn532_lock(obj);
+
     MIFARE_DEBUG("Trying to read 16 bytes from block %d\n", blockNumber);
 
     /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;               /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = blockNumber;     /* Block Number (0..63 for 1K, 0..255 for 4K) */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
+    obj->_packetbuffer[3] = blockNumber;     /* Block Number (0..63 for 1K, 0..255 for 4K) */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 4, &frame, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for read command\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
-
-    /* If uint8_t 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[6] != 0x00) //CHANGED orig: 7
+    /* If the status byte isn't 0x00 we probably have an error */
+    if (frame.payloadLen < 17 || frame.payload[0] != 0x00)
     {
         MIFARE_DEBUG("Unexpected response:");
-        for (int i = 0; i < 26; i++)
+        for (int i = 0; i < frame.payloadLen; i++)
         {
-            MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+            MIFARE_DEBUG(" %02x", frame.payload[i]);
         }
         MIFARE_DEBUG("\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    /* Copy the 16 data bytes to the output buffer        */
-    /* Block content starts at uint8_t 9 of a valid response */
-    memcpy(data, pn532_packetbuffer + 7, 16); //CHANGED orig: 8
+    /* Copy the 16 data bytes to the output buffer           */
+    /* Block content follows the status byte of the response */
+    memcpy(data, frame.payload + 1, 16);
 
 /* Display data for debug if requested */
     MIFARE_DEBUG("Block %d\n", blockNumber);
@@ -715,7 +1518,7 @@ uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uin
     }
     MIFARE_DEBUG("\n");
 
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -732,27 +1535,33 @@ uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uin
 /**************************************************************************/
 uint8_t pn532_mifareclassic_WriteDataBlock(pn532_t *obj, uint8_t blockNumber, uint8_t *data)
 {
+    pn532_lock(obj);
+
     MIFARE_DEBUG("Trying to write 16 bytes to block %d\n", blockNumber);
 
     /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_WRITE; /* Mifare Write command = 0xA0 */
-    pn532_packetbuffer[3] = blockNumber;      /* Block Number (0..63 for 1K, 0..255 for 4K) */
-    memcpy(pn532_packetbuffer + 4, data, 16); /* Data Payload */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_WRITE; /* Mifare Write command = 0xA0 */
+    obj->_packetbuffer[3] = blockNumber;      /* Block Number (0..63 for 1K, 0..255 for 4K) */
+    memcpy(obj->_packetbuffer + 4, data, 16); /* Data Payload */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 20, 1000))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 20, &frame, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
-    PN532_DELAY(10);
 
     /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    if (frame.payloadLen < 1 || frame.payload[0] != 0x00)
+    {
+        MIFARE_DEBUG("Write failed\n");
+        PN532_UNLOCK_RETURN(obj, 0);
+    }
 
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -764,6 +1573,8 @@ uint8_t pn532_mifareclassic_WriteDataBlock(pn532_t *obj, uint8_t blockNumber, ui
 /**************************************************************************/
 uint8_t pn532_mifareclassic_FormatNDEF(pn532_t *obj)
 {
+    pn532_lock(obj);
+
     uint8_t sectorbuffer1[16] = {0x14, 0x01, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1};
     uint8_t sectorbuffer2[16] = {0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1, 0x03, 0xE1};
     uint8_t sectorbuffer3[16] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0x78, 0x77, 0x88, 0xC1, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -773,15 +1584,15 @@ uint8_t pn532_mifareclassic_FormatNDEF(pn532_t *obj)
 
     // Write block 1 and 2 to the card
     if (!(pn532_mifareclassic_WriteDataBlock(obj, 1, sectorbuffer1)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     if (!(pn532_mifareclassic_WriteDataBlock(obj, 2, sectorbuffer2)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     // Write key A and access rights card
     if (!(pn532_mifareclassic_WriteDataBlock(obj, 3, sectorbuffer3)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Seems that everything was OK (?!)
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -804,16 +1615,18 @@ uint8_t pn532_mifareclassic_FormatNDEF(pn532_t *obj)
 /**************************************************************************/
 uint8_t pn532_mifareclassic_WriteNDEFURI(pn532_t *obj, uint8_t sectorNumber, uint8_t uriIdentifier, const char *url)
 {
+    pn532_lock(obj);
+
     // Figure out how long the string is
     uint8_t len = strlen(url);
 
     // Make sure we're within a 1K limit for the sector number
     if ((sectorNumber < 1) || (sectorNumber > 15))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Make sure the URI payload is between 1 and 38 chars
     if ((len < 1) || (len > 38))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Note 0xD3 0xF7 0xD3 0xF7 0xD3 0xF7 must be used for key A
     // in NDEF records
@@ -860,16 +1673,16 @@ uint8_t pn532_mifareclassic_WriteNDEFURI(pn532_t *obj, uint8_t sectorNumber, uin
 
     // Now write all three blocks back to the card
     if (!(pn532_mifareclassic_WriteDataBlock(obj, sectorNumber * 4, sectorbuffer1)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     if (!(pn532_mifareclassic_WriteDataBlock(obj, (sectorNumber * 4) + 1, sectorbuffer2)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     if (!(pn532_mifareclassic_WriteDataBlock(obj, (sectorNumber * 4) + 2, sectorbuffer3)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     if (!(pn532_mifareclassic_WriteDataBlock(obj, (sectorNumber * 4) + 3, sectorbuffer4)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Seems that everything was OK (?!)
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /***** Mifare Ultralight Functions ******/
@@ -885,55 +1698,49 @@ uint8_t pn532_mifareclassic_WriteNDEFURI(pn532_t *obj, uint8_t sectorNumber, uin
 /**************************************************************************/
 uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
 {
+    pn532_lock(obj);
+
     if (page >= 64)
     {
         MIFARE_DEBUG("Page value out of range\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
     MIFARE_DEBUG("Reading page %d\n", page);
 
     /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;               /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
+    obj->_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 4, &frame, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
-        return 0;
-    }
-
-    /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
-    MIFARE_DEBUG("Received:");
-    for (int i = 0; i < 26; i++)
-    {
-        MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+        PN532_UNLOCK_RETURN(obj, 0);
     }
-    MIFARE_DEBUG("\n");
 
-    /* If uint8_t 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[7] == 0x00)
+    /* If the status byte isn't 0x00 we probably have an error */
+    if (frame.payloadLen >= 5 && frame.payload[0] == 0x00)
     {
-        /* Copy the 4 data bytes to the output buffer         */
-        /* Block content starts at uint8_t 9 of a valid response */
+        /* Copy the 4 data bytes to the output buffer            */
+        /* Block content follows the status byte of the response */
         /* Note that the command actually reads 16 uint8_t or 4  */
-        /* pages at a time ... we simply discard the last 12  */
-        /* bytes                                              */
-        memcpy(buffer, pn532_packetbuffer + 8, 4);
+        /* pages at a time ... we simply discard the last 12     */
+        /* bytes                                                 */
+        memcpy(buffer, frame.payload + 1, 4);
     }
     else
     {
         MIFARE_DEBUG("Unexpected response reading block:");
-        for (int i = 0; i < 26; i++)
+        for (int i = 0; i < frame.payloadLen; i++)
         {
-            MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+            MIFARE_DEBUG(" %02x", frame.payload[i]);
         }
         MIFARE_DEBUG("\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
 /* Display data for debug if requested */
@@ -945,7 +1752,7 @@ uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buf
     MIFARE_DEBUG("\n");
 
     // Return OK signal
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -962,37 +1769,42 @@ uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buf
 /**************************************************************************/
 uint8_t pn532_mifareultralight_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
 {
+    pn532_lock(obj);
 
     if (page >= 64)
     {
         MIFARE_DEBUG("Page value out of range\n");
         // Return Failed Signal
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
     MIFARE_DEBUG("Trying to write 4 uint8_t page %d\n", page);
 
     /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                           /* Card number */
-    pn532_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
-    pn532_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
-    memcpy(pn532_packetbuffer + 4, data, 4);             /* Data Payload */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag;           /* Card number */
+    obj->_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
+    obj->_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
+    memcpy(obj->_packetbuffer + 4, data, 4);             /* Data Payload */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 8, 1000))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 8, &frame, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
         // Return Failed Signal
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
-    PN532_DELAY(10);
 
     /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    if (frame.payloadLen < 1 || frame.payload[0] != 0x00)
+    {
+        MIFARE_DEBUG("Write failed\n");
+        PN532_UNLOCK_RETURN(obj, 0);
+    }
 
     // Return OK Signal
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /***** NTAG2xx Functions ******/
@@ -1008,6 +1820,8 @@ uint8_t pn532_mifareultralight_WritePage(pn532_t *obj, uint8_t page, uint8_t *da
 /**************************************************************************/
 uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
 {
+    pn532_lock(obj);
+
     // TAG Type       PAGES   USER START    USER STOP
     // --------       -----   ----------    ---------
     // NTAG 203       42      4             39
@@ -1018,52 +1832,44 @@ uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
     if (page >= 231)
     {
         MIFARE_DEBUG("Page value out of range\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
     MIFARE_DEBUG("Reading page %d\n", page);
 
     /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;               /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
+    obj->_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 4, &frame, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
-    /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
-    MIFARE_DEBUG("Received:");
-    for (int i = 0; i < 26; i++)
-    {
-        MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
-    }
-    MIFARE_DEBUG("\n");
-
-    /* If uint8_t 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[7] == 0x00)
+    /* If the status byte isn't 0x00 we probably have an error */
+    if (frame.payloadLen >= 5 && frame.payload[0] == 0x00)
     {
-        /* Copy the 4 data bytes to the output buffer         */
-        /* Block content starts at uint8_t 9 of a valid response */
+        /* Copy the 4 data bytes to the output buffer            */
+        /* Block content follows the status byte of the response */
         /* Note that the command actually reads 16 uint8_t or 4  */
-        /* pages at a time ... we simply discard the last 12  */
-        /* bytes                                              */
-        memcpy(buffer, pn532_packetbuffer + 8, 4);
+        /* pages at a time ... we simply discard the last 12     */
+        /* bytes                                                 */
+        memcpy(buffer, frame.payload + 1, 4);
     }
     else
     {
         MIFARE_DEBUG("Unexpected response reading block:");
-        for (int i = 0; i < 26; i++)
+        for (int i = 0; i < frame.payloadLen; i++)
         {
-            MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+            MIFARE_DEBUG(" %02x", frame.payload[i]);
         }
         MIFARE_DEBUG("\n");
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
 /* Display data for debug if requested */
@@ -1075,7 +1881,54 @@ uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
     MIFARE_DEBUG("\n");
 
     // Return OK signal
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads a range of pages from an NTAG21x (or Ultralight EV1)
+            tag with FAST_READ
+
+    Each FAST_READ returns up to PN532_FASTREAD_MAX_PAGES pages, so a
+    whole NTAG216 takes four round trips instead of one READ per page.
+    The data goes straight into buffer.
+
+    @param  startPage     First page to read
+    @param  pageCount     Number of pages to read
+    @param  buffer        Output buffer, pageCount * 4 bytes long
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t pn532_ntag2xx_ReadPages(pn532_t *obj, uint8_t startPage, uint8_t pageCount, uint8_t *buffer)
+{
+    if (pageCount == 0 || startPage + pageCount > 231)
+    {
+        MIFARE_DEBUG("Page range out of range\n");
+        return 0;
+    }
+
+    pn532_lock(obj);
+
+    while (pageCount)
+    {
+        uint8_t chunk = pageCount > PN532_FASTREAD_MAX_PAGES ? PN532_FASTREAD_MAX_PAGES : pageCount;
+        uint8_t cmd[3] = {NTAG_CMD_FAST_READ, startPage, startPage + chunk - 1};
+        uint16_t len = chunk * 4;
+
+        MIFARE_DEBUG("Fast reading pages %d..%d\n", cmd[1], cmd[2]);
+        if (!pn532_inCommunicateThru(obj, cmd, sizeof(cmd), buffer, &len) || len != chunk * 4)
+        {
+            MIFARE_DEBUG("FAST_READ of page %d failed\n", startPage);
+            PN532_UNLOCK_RETURN(obj, 0);
+        }
+
+        buffer += len;
+        startPage += chunk;
+        pageCount -= chunk;
+    }
+
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -1092,6 +1945,8 @@ uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
 /**************************************************************************/
 uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
 {
+    pn532_lock(obj);
+
     // TAG Type       PAGES   USER START    USER STOP
     // --------       -----   ----------    ---------
     // NTAG 203       42      4             39
@@ -1103,33 +1958,37 @@ uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
     {
         MIFARE_DEBUG("Page value out of range\n");
         // Return Failed Signal
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
 
     MIFARE_DEBUG("Trying to write 4 uint8_t page %d\n", page);
 
     /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                           /* Card number */
-    pn532_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
-    pn532_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
-    memcpy(pn532_packetbuffer + 4, data, 4);             /* Data Payload */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag;           /* Card number */
+    obj->_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
+    obj->_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
+    memcpy(obj->_packetbuffer + 4, data, 4);             /* Data Payload */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 8, 1000))
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, 8, &frame, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
 
         // Return Failed Signal
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     }
-    PN532_DELAY(10);
 
     /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    if (frame.payloadLen < 1 || frame.payload[0] != 0x00)
+    {
+        MIFARE_DEBUG("Write failed\n");
+        PN532_UNLOCK_RETURN(obj, 0);
+    }
 
     // Return OK Signal
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /**************************************************************************/
@@ -1149,6 +2008,8 @@ uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
 /**************************************************************************/
 uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *url, uint8_t dataLen)
 {
+    pn532_lock(obj);
+
     uint8_t pageBuffer[4] = {0, 0, 0, 0};
 
     // Remove NDEF record overhead from the URI data (pageHeader below)
@@ -1159,7 +2020,7 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
 
     // Make sure the URI payload will fit in dataLen (include 0xFE trailer)
     if ((len < 1) || (len + 1 > (dataLen - wrapperSize)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Setup the record header
     // See NFCForum-TS-Type-2-Tag_1.1.pdf for details
@@ -1184,13 +2045,13 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
     // Write 12 uint8_t header (three pages of data starting at page 4)
     memcpy(pageBuffer, pageHeader, 4);
     if (!(pn532_ntag2xx_WritePage(obj, 4, pageBuffer)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     memcpy(pageBuffer, pageHeader + 4, 4);
     if (!(pn532_ntag2xx_WritePage(obj, 5, pageBuffer)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
     memcpy(pageBuffer, pageHeader + 8, 4);
     if (!(pn532_ntag2xx_WritePage(obj, 6, pageBuffer)))
-        return 0;
+        PN532_UNLOCK_RETURN(obj, 0);
 
     // Write URI (starting at page 7)
     uint8_t currentPage = 7;
@@ -1203,29 +2064,29 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
             memcpy(pageBuffer, urlcopy, len);
             pageBuffer[len] = 0xFE; // NDEF record footer
             if (!(pn532_ntag2xx_WritePage(obj, currentPage, pageBuffer)))
-                return 0;
+                PN532_UNLOCK_RETURN(obj, 0);
             // DONE!
-            return 1;
+            PN532_UNLOCK_RETURN(obj, 1);
         }
         else if (len == 4)
         {
             memcpy(pageBuffer, urlcopy, len);
             if (!(pn532_ntag2xx_WritePage(obj, currentPage, pageBuffer)))
-                return 0;
+                PN532_UNLOCK_RETURN(obj, 0);
             memset(pageBuffer, 0, 4);
             pageBuffer[0] = 0xFE; // NDEF record footer
             currentPage++;
             if (!(pn532_ntag2xx_WritePage(obj, currentPage, pageBuffer)))
-                return 0;
+                PN532_UNLOCK_RETURN(obj, 0);
             // DONE!
-            return 1;
+            PN532_UNLOCK_RETURN(obj, 1);
         }
         else
         {
             // More than one page of data left
             memcpy(pageBuffer, urlcopy, 4);
             if (!(pn532_ntag2xx_WritePage(obj, currentPage, pageBuffer)))
-                return 0;
+                PN532_UNLOCK_RETURN(obj, 0);
             currentPage++;
             urlcopy += 4;
             len -= 4;
@@ -1233,7 +2094,7 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
     }
 
     // Seems that everything was OK (?!)
-    return 1;
+    PN532_UNLOCK_RETURN(obj, 1);
 }
 
 /************** high level communication functions (handles both I2C and SPI) */
@@ -1246,10 +2107,13 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
 bool pn532_readack(pn532_t *obj)
 {
     uint8_t ackbuff[6];
+    pn532_frame_view_t view;
 
     pn532_readdata(obj, ackbuff, 6);
 
-    return (0 == strncmp((char *)ackbuff, (char *)pn532ack, 6));
+    // the preamble is optional, the codec syncs on the start code
+    return pn532_frame_decode(ackbuff, sizeof(ackbuff), &view) == PN532_FRAME_OK &&
+           view.kind == PN532_FRAME_ACK;
 }
 
 /**************************************************************************/
@@ -1259,13 +2123,15 @@ bool pn532_readack(pn532_t *obj)
 /**************************************************************************/
 bool pn532_isready(pn532_t *obj)
 {
-    gpio_set_level(obj->_ss, 0);
-    PN532_DELAY(10);
-    pn532_spi_write(obj, PN532_SPI_STATREAD);
-    // read uint8_t
-    uint8_t x = pn532_spi_read(obj);
+    uint8_t cmd = PN532_SPI_STATREAD;
+    uint8_t x;
 
-    gpio_set_level(obj->_ss, 1);
+    obj->_transport->select(obj->_transportCtx);
+    pn532_delay_us(PN532_CS_WAKEUP_US);
+    obj->_transport->transfer(obj->_transportCtx, &cmd, NULL, 1);
+    // read uint8_t
+    obj->_transport->transfer(obj->_transportCtx, NULL, &x, 1);
+    obj->_transport->deselect(obj->_transportCtx);
 
     // Check if status is ready.
     return x == PN532_SPI_READY;
@@ -1275,22 +2141,52 @@ bool pn532_isready(pn532_t *obj)
 /*!
     @brief  Waits until the PN532 is ready.
 
-    @param  timeout   Timeout before giving up
+    With an IRQ pin configured the task sleeps until the IRQ line goes
+    low, otherwise the SPI status byte is polled once per tick. The
+    timeout is an absolute deadline on the driver clock, so it doesn't
+    grow by a tick per wakeup. Gives up early when the running command
+    is cancelled (_abort).
+
+    @param  timeout   Timeout in ms before giving up (0 = wait forever)
 */
 /**************************************************************************/
 bool pn532_waitready(pn532_t *obj, uint16_t timeout)
 {
-    uint16_t timer = 0;
-    while (!pn532_isready(obj))
+    int64_t deadline = pn532_deadline_ms(timeout);
+
+    if (obj->_irqSem != NULL)
     {
-        if (timeout != 0)
+        // IRQ is active low and stays low until the frame is read, so the
+        // level decides; a stale semaphore only costs one more check
+        while (gpio_get_level(obj->_irq) != 0)
         {
-            timer += 10;
-            if (timer > timeout)
-            {
-                PN532_DEBUG("TIMEOUT!\n");
+            TickType_t wait = portMAX_DELAY;
+            if (obj->_abort)
                 return false;
+            if (deadline != PN532_TIME_FOREVER)
+            {
+                uint32_t left = pn532_deadline_left_us(deadline);
+                if (left == 0)
+                {
+                    PN532_DEBUG("TIMEOUT!\n");
+                    return false;
+                }
+                // round up, the level is checked again on wakeup
+                wait = (left + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
             }
+            xSemaphoreTake(obj->_irqSem, wait);
+        }
+        return true;
+    }
+
+    while (!pn532_isready(obj))
+    {
+        if (obj->_abort)
+            return false;
+        if (pn532_deadline_passed(deadline))
+        {
+            PN532_DEBUG("TIMEOUT!\n");
+            return false;
         }
         PN532_DELAY(10);
     }
@@ -1299,7 +2195,7 @@ bool pn532_waitready(pn532_t *obj, uint16_t timeout)
 
 /**************************************************************************/
 /*!
-    @brief  Reads n bytes of data from the PN532 via SPI or I2C.
+    @brief  Reads n raw bytes of data from the PN532 via SPI.
 
     @param  buff      Pointer to the buffer where data will be written
     @param  n         Number of bytes to be read
@@ -1307,122 +2203,121 @@ bool pn532_waitready(pn532_t *obj, uint16_t timeout)
 /**************************************************************************/
 void pn532_readdata(pn532_t *obj, uint8_t *buff, uint8_t n)
 {
-    gpio_set_level(obj->_ss, 0);
-    PN532_DELAY(10);
-    pn532_spi_write(obj, PN532_SPI_DATAREAD);
+    uint8_t cmd = PN532_SPI_DATAREAD;
+
+    obj->_transport->select(obj->_transportCtx);
+    pn532_delay_us(PN532_CS_WAKEUP_US);
+    obj->_transport->transfer(obj->_transportCtx, &cmd, NULL, 1);
+
+    // the whole frame is clocked in with a single transfer
+    obj->_transport->transfer(obj->_transportCtx, NULL, buff, n);
+    obj->_transport->deselect(obj->_transportCtx);
 
     PN532_DEBUG("Reading:");
-    for (uint8_t i = 0; i < n; i++)
-    {
-        PN532_DELAY(10);
-        buff[i] = pn532_spi_read(obj);
-    }
     for (int i = 0; i < n; i++)
     {
         PN532_DEBUG(" %02x", buff[i]);
     }
     PN532_DEBUG("\n");
-
-    gpio_set_level(obj->_ss, 1);
 }
 
 /**************************************************************************/
 /*!
-    @brief  set the PN532 as iso14443a Target behaving as a SmartCard
-    @param  None
-    #author Salvador Mendoza(salmg.net) new functions:
-    -AsTarget
-    -getDataTarget
-    -setDataTarget
-*/
-/**************************************************************************/
-uint8_t pn532_AsTarget(pn532_t *obj)
-{
-    pn532_packetbuffer[0] = 0x8C;
-    uint8_t target[] = {
-        0x8C,             // INIT AS TARGET
-        0x00,             // MODE -> BITFIELD
-        0x08, 0x00,       //SENS_RES - MIFARE PARAMS
-        0xdc, 0x44, 0x20, //NFCID1T
-        0x60,             //SEL_RES
-        0x01, 0xfe,       //NFCID2T MUST START WITH 01fe - FELICA PARAMS - POL_RES
-        0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
-        0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,                                    //PAD
-        0xff, 0xff,                                                                        //SYSTEM CODE
-        0xaa, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x01, 0x00,            //NFCID3t MAX 47 BYTES ATR_RES
-        0x0d, 0x52, 0x46, 0x49, 0x44, 0x49, 0x4f, 0x74, 0x20, 0x50, 0x4e, 0x35, 0x33, 0x32 //HISTORICAL BYTES
-    };
-    if (!pn532_sendCommandCheckAck(obj, target, sizeof(target), 1000))
-        return false;
+    @brief  Reads one information frame from the PN532
 
-    // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 8);
+    The header is read first to learn LEN, then the rest of the frame
+    (TFI .. PD(n), DCS, postamble) is clocked in with a single burst.
+    Decoding and both checksums are left to the frame codec, normal and
+    extended frames are handled alike.
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x15);
-}
-/**************************************************************************/
-/*!
-    @brief  retrieve response from the emulation mode
+    @param  buff      Buffer receiving the whole frame
+    @param  size      Size of buff in bytes
+    @param  frame     Parsed view of the frame, payload points into buff
 
-    @param  cmd    = data
-    @param  cmdlen = data length
+    @returns true if a valid frame was read, false otherwise
 */
 /**************************************************************************/
-uint8_t pn532_getDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t *cmdlen)
+bool pn532_readframe(pn532_t *obj, uint8_t *buff, uint16_t size, pn532_frame_t *frame)
 {
-    uint8_t length;
-    pn532_packetbuffer[0] = 0x86;
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000))
-    {
-        PN532_DEBUG("Error en ack\n");
+    uint8_t cmd = PN532_SPI_DATAREAD;
+    pn532_frame_view_t view;
+    pn532_frame_status_t status;
+    size_t have = PN532_FRAME_HEADER_READ;
+
+    if (size < have)
         return false;
+
+    obj->_transport->select(obj->_transportCtx);
+    pn532_delay_us(PN532_CS_WAKEUP_US);
+    obj->_transport->transfer(obj->_transportCtx, &cmd, NULL, 1);
+
+    // the header tells the frame size, the rest follows in one burst
+    obj->_transport->transfer(obj->_transportCtx, NULL, buff, have);
+    status = pn532_frame_decode(buff, have, &view);
+    while (status == PN532_FRAME_INCOMPLETE && view.size <= size)
+    {
+        obj->_transport->transfer(obj->_transportCtx, NULL, buff + have, view.size - have);
+        have = view.size;
+        status = pn532_frame_decode(buff, have, &view);
     }
 
-    // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 64);
-    length = pn532_packetbuffer[3] - 3;
+    obj->_transport->deselect(obj->_transportCtx);
 
-    //if (length > *responseLength) {// Bug, should avoid it in the reading target data
-    //  length = *responseLength; // silent truncation...
-    //}
+    PN532_DEBUG("Frame:");
+    for (size_t i = 0; i < have; i++)
+    {
+        PN532_DEBUG(" %02x", buff[i]);
+    }
+    PN532_DEBUG("\n");
 
-    for (int i = 0; i < length; ++i)
+    if (status != PN532_FRAME_OK)
+    {
+        PN532_DEBUG("Invalid frame (%d)\n", status);
+        return false;
+    }
+    if (view.kind == PN532_FRAME_ERROR)
     {
-        cmd[i] = pn532_packetbuffer[8 + i];
+        PN532_DEBUG("Application level error frame\n");
+        return false;
+    }
+    if (view.kind != PN532_FRAME_INFO || view.dataLen < 1)
+    {
+        PN532_DEBUG("Frame too short\n");
+        return false;
     }
-    *cmdlen = length;
+
+    frame->tfi = view.tfi;
+    frame->command = view.data[0];
+    frame->payload = (uint8_t *)view.data + 1;
+    frame->payloadLen = view.dataLen - 1;
     return true;
 }
 
 /**************************************************************************/
 /*!
-    @brief  set data in PN532 in the emulation mode
+    @brief  Reads the response frame to a command and checks that it is
+            addressed to the host and answers the given command
+
+    @param  command   Command code the response belongs to
+    @param  buff      Buffer receiving the frame
+    @param  size      Size of buff in bytes
+    @param  frame     Parsed view of the frame, payload points into buff
 
-    @param  cmd    = data
-    @param  cmdlen = data length
+    @returns true if a matching response was read, false otherwise
 */
 /**************************************************************************/
-uint8_t pn532_setDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen)
+bool pn532_readresponse(pn532_t *obj, uint8_t command, uint8_t *buff, uint16_t size, pn532_frame_t *frame)
 {
-    uint8_t length;
-    //cmd1[0] = 0x8E; Must!
-
-    if (!pn532_sendCommandCheckAck(obj, cmd, cmdlen, 1000))
+    if (!pn532_readframe(obj, buff, size, frame))
         return false;
 
-    // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 8);
-    length = pn532_packetbuffer[3] - 3;
-    for (int i = 0; i < length; ++i)
+    if (frame->tfi != PN532_PN532TOHOST || frame->command != (uint8_t)(command + 1))
     {
-        cmd[i] = pn532_packetbuffer[8 + i];
+        PN532_DEBUG("Don't know how to handle this command: %02x\n", frame->command);
+        return false;
     }
-    //cmdl = 0
-    cmdlen = length;
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x15);
+    return true;
 }
 
 /**************************************************************************/
@@ -1434,96 +2329,31 @@ uint8_t pn532_setDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen)
     @param  cmdlen    Command length in bytes
 */
 /**************************************************************************/
-void pn532_writecommand(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen)
-{
-    uint8_t checksum;
-
-    cmdlen++;
-
-    PN532_DEBUG("Sending:");
-
-    gpio_set_level(obj->_ss, 0);
-    PN532_DELAY(10); // or whatever the PN532_DELAY is for waking up the board
-    pn532_spi_write(obj, PN532_SPI_DATAWRITE);
-
-    checksum = PN532_PREAMBLE + PN532_PREAMBLE + PN532_STARTCODE2;
-    pn532_spi_write(obj, PN532_PREAMBLE);
-    pn532_spi_write(obj, PN532_PREAMBLE);
-    pn532_spi_write(obj, PN532_STARTCODE2);
-
-    pn532_spi_write(obj, cmdlen);
-    pn532_spi_write(obj, ~cmdlen + 1);
-
-    pn532_spi_write(obj, PN532_HOSTTOPN532);
-    checksum += PN532_HOSTTOPN532;
-
-    PN532_DEBUG(" %02x %02x %02x %02x %02x %02x", (uint8_t)PN532_PREAMBLE, (uint8_t)PN532_PREAMBLE, (uint8_t)PN532_STARTCODE2, (uint8_t)cmdlen, (uint8_t)(~cmdlen + 1), (uint8_t)PN532_HOSTTOPN532);
-
-    for (uint8_t i = 0; i < cmdlen - 1; i++)
-    {
-        pn532_spi_write(obj, cmd[i]);
-        checksum += cmd[i];
-        PN532_DEBUG(" %02x", cmd[i]);
-    }
-
-    pn532_spi_write(obj, ~checksum);
-    pn532_spi_write(obj, PN532_POSTAMBLE);
-    gpio_set_level(obj->_ss, 1);
-
-    PN532_DEBUG(" %02x %02x\n", (uint8_t)~checksum, (uint8_t)PN532_POSTAMBLE);
-}
-/************** low level SPI */
-
-/**************************************************************************/
-/*!
-    @brief  Low-level SPI write wrapper
-
-    @param  c       8-bit command to write to the SPI bus
-*/
-/**************************************************************************/
-void pn532_spi_write(pn532_t *obj, uint8_t c)
+void pn532_writecommand(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen)
 {
-    int8_t i;
-    gpio_set_level(obj->_clk, 1);
+    // SPI DW followed by the frame, extended once the command outgrows LEN
+    uint8_t frame[1 + PN532_FRAME_MAX_SIZE];
+    size_t n;
 
-    for (i = 0; i < 8; i++)
+    frame[0] = PN532_SPI_DATAWRITE;
+    n = pn532_frame_encode(frame + 1, sizeof(frame) - 1, PN532_HOSTTOPN532, cmd, cmdlen);
+    if (n == 0)
     {
-        gpio_set_level(obj->_clk, 0);
-        if (c & _BV(i))
-        {
-            gpio_set_level(obj->_mosi, 1);
-        }
-        else
-        {
-            gpio_set_level(obj->_mosi, 0);
-        }
-        gpio_set_level(obj->_clk, 1);
+        PN532_DEBUG("Command too long\n");
+        return;
     }
-}
-
-/**************************************************************************/
-/*!
-    @brief  Low-level SPI read wrapper
-
-    @returns The 8-bit value that was read from the SPI bus
-*/
-/**************************************************************************/
-uint8_t pn532_spi_read(pn532_t *obj)
-{
-    int8_t i, x;
-    x = 0;
-
-    gpio_set_level(obj->_clk, 1);
+    n++;
 
-    for (i = 0; i < 8; i++)
+    PN532_DEBUG("Sending:");
+    for (size_t i = 1; i < n; i++)
     {
-        if (gpio_get_level(obj->_miso))
-        {
-            x |= _BV(i);
-        }
-        gpio_set_level(obj->_clk, 0);
-        gpio_set_level(obj->_clk, 1);
+        PN532_DEBUG(" %02x", frame[i]);
     }
+    PN532_DEBUG("\n");
 
-    return x;
+    // the whole frame goes out in a single transfer
+    obj->_transport->select(obj->_transportCtx);
+    pn532_delay_us(PN532_CS_WAKEUP_US);
+    obj->_transport->transfer(obj->_transportCtx, frame, NULL, n);
+    obj->_transport->deselect(obj->_transportCtx);
 }
@@ -1,6 +1,20 @@
 #ifndef __PN532_H__
 #define __PN532_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "driver/spi_master.h"
+
+#include "pn532_frame.h"
+#include "pn532_time.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -50,6 +64,8 @@ extern "C" {
 #define PN532_RESPONSE_INDATAEXCHANGE       (0x41)
 #define PN532_RESPONSE_INLISTPASSIVETARGET  (0x4B)
 
+#define PN532_ERRORFRAME                    (0x7F)
+
 #define PN532_WAKEUP                        (0x55)
 
 #define PN532_SPI_STATREAD                  (0x02)
@@ -57,6 +73,14 @@ extern "C" {
 #define PN532_SPI_DATAREAD                  (0x03)
 #define PN532_SPI_READY                     (0x01)
 
+#define PN532_SPI_CLOCK_HZ                  (2000000) // PN532 accepts up to 5 MHz
+#define PN532_SPI_DMA_CHAN                  (2)
+#define PN532_SPI_MAX_TRANSFER              (512)
+
+#define PN532_NO_IRQ                        (0xFF)
+
+#define PN532_PACKBUFFSIZ                   (PN532_FRAME_MAX_LEN - 1) // Largest command (LEN minus TFI)
+
 #define PN532_I2C_ADDRESS                   (0x48 >> 1)
 #define PN532_I2C_READBIT                   (0x01)
 #define PN532_I2C_BUSY                      (0x00)
@@ -65,6 +89,83 @@ extern "C" {
 
 #define PN532_MIFARE_ISO14443A              (0x00)
 
+// InAutoPoll target types
+#define PN532_AUTOPOLL_GENERIC_106          (0x00)
+#define PN532_AUTOPOLL_GENERIC_212          (0x01)
+#define PN532_AUTOPOLL_GENERIC_424          (0x02)
+#define PN532_AUTOPOLL_ISO14443_4B_106      (0x03)
+#define PN532_AUTOPOLL_JEWEL                (0x04)
+#define PN532_AUTOPOLL_MIFARE               (0x10)
+#define PN532_AUTOPOLL_FELICA_212           (0x11)
+#define PN532_AUTOPOLL_FELICA_424           (0x12)
+#define PN532_AUTOPOLL_ISO14443_4A          (0x20)
+#define PN532_AUTOPOLL_ISO14443_4B          (0x23)
+#define PN532_AUTOPOLL_ENDLESS              (0xFF)
+#define PN532_AUTOPOLL_MAX_TYPES            (15)
+
+// RFConfiguration items
+#define PN532_RFCFG_FIELD                   (0x01)
+#define PN532_RFCFG_TIMINGS                 (0x02)
+#define PN532_RFCFG_MAXRTYCOM               (0x04)
+#define PN532_RFCFG_MAXRETRIES              (0x05)
+#define PN532_RFCFG_ANALOG_106A             (0x0A)
+#define PN532_RFCFG_ANALOG_212_424          (0x0B)
+#define PN532_RFCFG_ANALOG_TYPEB            (0x0C)
+#define PN532_RFCFG_ANALOG_ISO_DEP          (0x0D)
+#define PN532_RFCFG_MAX_DATA                (11) // Analog settings for 106 kbps type A
+
+// PowerDown wake-up sources
+#define PN532_WAKEUP_INT0                   (0x01)
+#define PN532_WAKEUP_INT1                   (0x02)
+#define PN532_WAKEUP_RF                     (0x08) // RF level detector (external field only)
+#define PN532_WAKEUP_HSU                    (0x10)
+#define PN532_WAKEUP_SPI                    (0x20)
+#define PN532_WAKEUP_GPIO                   (0x40)
+#define PN532_WAKEUP_I2C                    (0x80)
+
+// RF field item bits
+#define PN532_RF_FIELD_ON                   (0x01)
+#define PN532_RF_FIELD_AUTO_RFCA            (0x02)
+
+// MxRty* value meaning "retry forever"
+#define PN532_RF_RETRY_FOREVER              (0xFF)
+
+// InPSL bit rates
+#define PN532_BAUD_106                      (0x00)
+#define PN532_BAUD_212                      (0x01)
+#define PN532_BAUD_424                      (0x02)
+
+// MI (more information) chaining bit, in Tg of InDataExchange and in the status byte
+#define PN532_TG_MI                         (0x40)
+#define PN532_STATUS_MI                     (0x40)
+
+// ISO7816 status words
+#define PN532_SW_OK                         (0x9000)
+#define PN532_SW1_MORE_DATA                 (0x61) // SW2 bytes left, fetched with GET RESPONSE
+#define PN532_SW_DESFIRE_MORE               (0x91AF) // DESFire additional frame
+#define PN532_SW1(sw)                       ((uint8_t)((sw) >> 8))
+#define PN532_SW2(sw)                       ((uint8_t)((sw) & 0xFF))
+
+// TgInitAsTarget mode bits (0 = any)
+#define PN532_TG_MODE_PASSIVE_ONLY          (0x01)
+#define PN532_TG_MODE_DEP_ONLY              (0x02)
+#define PN532_TG_MODE_PICC_ONLY             (0x04)
+
+// Target mode status codes (lower 6 bits of the status byte)
+#define PN532_STATUS_ERROR_MASK             (0x3F)
+#define PN532_STATUS_RELEASED               (0x29) // Released (DESELECT/RLS_REQ) by the initiator
+
+// SEL_RES announced as target
+#define PN532_TG_SEL_RES_PICC               (0x20) // ISO14443-4 card
+#define PN532_TG_SEL_RES_DEP                (0x40) // NFC-DEP peer
+
+#define PN532_TG_GT_MAX                     (47) // General bytes of ATR_RES
+#define PN532_TG_TK_MAX                     (48) // Historical bytes of the ATS
+
+#define PN532_MAX_TARGETS                   (2)  // Targets the PN532 handles at once
+#define PN532_TARGETDATA_MAX                (48)
+#define PN532_ATS_MAX                       (20)
+
 // Mifare Commands
 #define MIFARE_CMD_AUTH_A                   (0x60)
 #define MIFARE_CMD_AUTH_B                   (0x61)
@@ -75,6 +176,10 @@ extern "C" {
 #define MIFARE_CMD_INCREMENT                (0xC1)
 #define MIFARE_CMD_STORE                    (0xC2)
 #define MIFARE_ULTRALIGHT_CMD_WRITE         (0xA2)
+#define NTAG_CMD_FAST_READ                  (0x3A)
+
+// FAST_READ pages per InCommunicateThru, kept to a normal response frame (TFI, code, status, data)
+#define PN532_FASTREAD_MAX_PAGES            ((PN532_FRAME_NORMAL_MAX_LEN - 3) / 4)
 
 // Prefixes for NDEF Records (to identify record type)
 #define NDEF_URIPREFIX_NONE                 (0x00)
@@ -122,6 +227,188 @@ extern "C" {
 #define PN532_GPIO_P34                      (4)
 #define PN532_GPIO_P35                      (5)
 
+/**
+ * Byte transport between the host and the PN532. select/deselect bracket
+ * one bus session (SS low .. SS high) and transfer clocks len bytes in one
+ * go; tx or rx may be NULL when only one direction is used. Bit-banged GPIO,
+ * the spi_master driver and host-side mocks all plug in through this.
+ */
+typedef struct {
+    void (*select)(void *ctx);
+    void (*deselect)(void *ctx);
+    void (*transfer)(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+} pn532_transport_t;
+
+/**
+ * Parsed view of a PN532 information frame. payload points into the
+ * buffer the frame was read into, it is not copied.
+ */
+typedef struct {
+    uint8_t tfi;          // Frame identifier (PN532_PN532TOHOST)
+    uint8_t command;      // Response code (command code + 1)
+    uint8_t *payload;     // Data following the response code
+    uint16_t payloadLen;  // Length of payload in bytes
+} pn532_frame_t;
+
+/**
+ * Target reported by InAutoPoll. data is the raw target data, for
+ * ISO14443A types the InListPassiveTarget layout starting with Tg.
+ */
+typedef struct {
+    uint8_t type;         // Target type (PN532_AUTOPOLL_*)
+    uint8_t dataLen;      // Length of data in bytes
+    uint8_t data[PN532_TARGETDATA_MAX]; // Target data
+} pn532_autopoll_t;
+
+/**
+ * ISO14443A target activated by the PN532
+ */
+typedef struct {
+    uint8_t tg;           // Logical target number used by InSelect/InDataExchange
+    uint16_t atqa;        // SENS_RES
+    uint8_t sak;          // SEL_RES
+    uint8_t uid[7];       // NFCID1
+    uint8_t uidLen;       // Length of uid in bytes
+    uint8_t ats[PN532_ATS_MAX]; // ATS of ISO14443-4 targets, starting with TL
+    uint8_t atsLen;       // Length of ats in bytes (0 = no ATS)
+} pn532_target_t;
+
+/**
+ * What the PN532 answers when it is activated as a target (TgInitAsTarget)
+ */
+typedef struct {
+    uint8_t mode;                    // PN532_TG_MODE_* bits
+    uint16_t sensRes;                // SENS_RES (ATQA)
+    uint8_t nfcid1[3];               // NFCID1t, the PN532 puts 0x08 in front
+    uint8_t selRes;                  // SEL_RES (SAK), PN532_TG_SEL_RES_*
+    uint8_t felica[18];              // FeliCa POL_RES: NFCID2t (01 FE ...), PAD, system code
+    uint8_t nfcid3[10];              // NFCID3t of ATR_RES
+    const uint8_t *generalBytes;     // Gt of ATR_RES (NULL = none)
+    uint8_t generalBytesLen;         // Up to PN532_TG_GT_MAX
+    const uint8_t *historicalBytes;  // Tk of the ATS (NULL = none)
+    uint8_t historicalBytesLen;      // Up to PN532_TG_TK_MAX
+} pn532_tg_config_t;
+
+/**
+ * Answers one command of the initiator in pn532_tg_serve. The response is
+ * written to resp (up to respSize bytes) and its length to respLen.
+ * cmd points into the receive buffer and is only valid during the call.
+ * Returning false ends the session once the response is sent; leaving
+ * respLen at 0 ends it without one.
+ */
+typedef bool (*pn532_tg_handler_t)(void *ctx, const uint8_t *cmd, uint16_t cmdLen, uint8_t *resp, uint16_t respSize, uint16_t *respLen);
+
+/**
+ * RFConfiguration timeout codes (ATR_RES and card response timeouts)
+ */
+typedef enum {
+    PN532_RF_TIMEOUT_NONE = 0x00,
+    PN532_RF_TIMEOUT_100US,
+    PN532_RF_TIMEOUT_200US,
+    PN532_RF_TIMEOUT_400US,
+    PN532_RF_TIMEOUT_800US,
+    PN532_RF_TIMEOUT_1_6MS,
+    PN532_RF_TIMEOUT_3_2MS,
+    PN532_RF_TIMEOUT_6_4MS,
+    PN532_RF_TIMEOUT_12_8MS,
+    PN532_RF_TIMEOUT_25_6MS,
+    PN532_RF_TIMEOUT_51_2MS,    // Card response default
+    PN532_RF_TIMEOUT_102_4MS,   // ATR_RES default
+    PN532_RF_TIMEOUT_204_8MS,
+    PN532_RF_TIMEOUT_409_6MS,
+    PN532_RF_TIMEOUT_819_2MS,
+    PN532_RF_TIMEOUT_1_64S,
+    PN532_RF_TIMEOUT_3_28S,
+} pn532_rf_timeout_t;
+
+/**
+ * CIU analog settings for 106 kbps type A (RFConfiguration item 0x0A).
+ * Defaults: 59 F4 3F 11 4D 85 61 6F 26 62 87
+ */
+typedef struct {
+    uint8_t rfCfg;            // CIU_RFCfg: receiver gain and RF level detector
+    uint8_t gsNOn;            // CIU_GsNOn: N-driver conductance, field on
+    uint8_t cwGsP;            // CIU_CWGsP: P-driver conductance, carrier
+    uint8_t modGsP;           // CIU_ModGsP: P-driver conductance, modulation
+    uint8_t demodWhenRFOn;    // CIU_Demod with own field on
+    uint8_t rxThreshold;      // CIU_RxThreshold: minimum signal and collision levels
+    uint8_t demodWhenRFOff;   // CIU_Demod with own field off
+    uint8_t gsNOff;           // CIU_GsNOff: N-driver conductance, field off
+    uint8_t modWidth;         // CIU_ModWidth: Miller pulse width
+    uint8_t mifNFC;           // CIU_MifNFC
+    uint8_t txBitPhase;       // CIU_TxBitPhase
+} pn532_analog_106a_t;
+
+/**
+ * CIU analog settings for 212/424 kbps (RFConfiguration item 0x0B).
+ * Defaults: 69 FF 3F 11 41 85 61 6F
+ */
+typedef struct {
+    uint8_t rfCfg;
+    uint8_t gsNOn;
+    uint8_t cwGsP;
+    uint8_t modGsP;
+    uint8_t demodWhenRFOn;
+    uint8_t rxThreshold;
+    uint8_t demodWhenRFOff;
+    uint8_t gsNOff;
+} pn532_analog_212_424_t;
+
+/**
+ * RF settings applied together with pn532_setRFConfig. The retry counts
+ * and timeouts decide how fast a detection cycle or a failed activation
+ * gives up.
+ */
+typedef struct {
+    uint8_t mxRtyATR;                  // ATR_REQ retries (DEP), default 0xFF
+    uint8_t mxRtyPSL;                  // PSL_REQ/PPS retries, default 0x01
+    uint8_t mxRtyPassiveActivation;    // InListPassiveTarget retries, default 0xFF
+    uint8_t mxRtyCOM;                  // InCommunicateThru/InDataExchange retries, default 0x00
+    pn532_rf_timeout_t atrResTimeout;  // ATR_RES timeout, default 102.4 ms
+    pn532_rf_timeout_t retryTimeout;   // Card response timeout, default 51.2 ms
+    bool autoRFCA;                     // RF collision avoidance before switching the field on
+    const pn532_analog_106a_t *analog106A;         // NULL keeps the current settings
+    const pn532_analog_212_424_t *analog212_424;   // NULL keeps the current settings
+} pn532_rf_config_t;
+
+/**
+ * Life cycle of a command queued to the driver task
+ */
+typedef enum {
+    PN532_CMD_PENDING = 0,  // Queued, not sent yet
+    PN532_CMD_RUNNING,      // Sent to the PN532
+    PN532_CMD_DONE,         // Response received
+    PN532_CMD_FAILED,       // No ACK, invalid frame or response too long
+    PN532_CMD_TIMEOUT,      // Deadline passed (the PN532 command was aborted)
+    PN532_CMD_CANCELLED,    // Cancelled with pn532_async_cancel
+} pn532_cmd_state_t;
+
+#define PN532_CMD_NO_DEADLINE (PN532_TIME_FOREVER)
+
+typedef struct pn532_cmd pn532_cmd_t;
+typedef void (*pn532_cmd_cb_t)(pn532_cmd_t *cmd, pn532_cmd_state_t state, void *arg);
+
+/**
+ * Command descriptor handed to the driver task. The descriptor and both
+ * buffers are owned by the driver from pn532_async_submit until state is
+ * final; the callback runs before that. With a done semaphore the
+ * descriptor is owned by the driver until the semaphore was taken.
+ */
+struct pn532_cmd {
+    const uint8_t *cmd;       // Command code and parameters
+    uint16_t cmdLen;          // Length of cmd in bytes
+    uint8_t *response;        // Receives the payload following the response code
+    uint16_t responseSize;    // Size of response in bytes
+    uint16_t responseLen;     // Length of the received payload
+    int64_t deadline;         // pn532_time_now() by which the command must complete
+    bool (*run)(void *arg);   // Runs on the driver task instead of sending cmd (optional)
+    void *runArg;             // Argument passed to run
+    pn532_cmd_cb_t callback;  // Called from the driver task on completion (optional)
+    void *callbackArg;
+    SemaphoreHandle_t done;   // Binary semaphore given on completion (optional)
+    volatile pn532_cmd_state_t state;
+    volatile bool cancel;     // Set by pn532_async_cancel
+};
 
 typedef struct {
     uint8_t _clk;
@@ -129,6 +416,27 @@ typedef struct {
     uint8_t _mosi;
     uint8_t _ss;
 
+    const pn532_transport_t *_transport; // Bus backend
+    void *_transportCtx;                 // Backend state handed to _transport
+    spi_device_handle_t _spi;            // Device handle (hardware SPI only)
+    SemaphoreHandle_t _busLock;          // Shared by all PN532s on the same pins
+
+    uint8_t _irq;                        // IRQ pin (valid when _irqSem is set)
+    SemaphoreHandle_t _irqSem;           // Given from the IRQ falling edge ISR
+    SemaphoreHandle_t _lock;             // Recursive device lock (optional)
+
+    QueueHandle_t _asyncQueue;           // Commands waiting for the driver task
+    TaskHandle_t _asyncTask;             // Driver task, NULL while commands run on the caller
+    pn532_cmd_t *_asyncCurrent;          // Command the driver task is running
+    uint8_t *_asyncFrame;                // Driver task receive buffer
+    volatile bool _abort;                // Makes waitready give up (cancel)
+
+    bool _poweredDown;                   // In PowerDown since the last resume
+    int64_t _wakeAt;                     // pn532_resume time, 0 once a target was found
+    uint32_t _wakeLatency;               // Last resume to target time in us
+
+    uint8_t _packetbuffer[PN532_FRAME_MAX_SIZE]; // Command/response buffer, fits a whole frame
+
     uint8_t _uid[7];       // ISO14443A uid
     uint8_t _uidLen;       // uid len
     uint8_t _key[6];       // Mifare Classic key
@@ -137,16 +445,58 @@ typedef struct {
 } pn532_t;
 
 void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss);
+esp_err_t pn532_spi_master_init(pn532_t *obj, spi_host_device_t host, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss);
+void pn532_transport_init(pn532_t *obj, const pn532_transport_t *transport, void *ctx);
+esp_err_t pn532_irq_init(pn532_t *obj, uint8_t irq);
+esp_err_t pn532_lock_init(pn532_t *obj);
+void pn532_lock(pn532_t *obj);
+void pn532_unlock(pn532_t *obj);
 void pn532_begin(pn532_t *obj);
 uint32_t pn532_getFirmwareVersion(pn532_t *obj);
-bool pn532_sendCommandCheckAck(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen, uint16_t timeout);
+bool pn532_sendCommandCheckAck(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint16_t timeout);
+bool pn532_transceive(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint8_t *buff, uint16_t size, pn532_frame_t *frame, uint16_t timeout);
+bool pn532_command(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, pn532_frame_t *frame, uint16_t timeout);
+bool pn532_commandInto(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint8_t *buff, uint16_t size, pn532_frame_t *frame, uint16_t timeout);
+void pn532_abortCommand(pn532_t *obj);
+esp_err_t pn532_async_start(pn532_t *obj, uint8_t queueLen, UBaseType_t priority);
+int64_t pn532_cmd_deadline(uint32_t timeout);
+esp_err_t pn532_async_submit(pn532_t *obj, pn532_cmd_t *cmd);
+bool pn532_async_cancel(pn532_t *obj, pn532_cmd_t *cmd);
+bool pn532_async_cancelRunning(pn532_t *obj);
+bool pn532_async_call(pn532_t *obj, bool (*run)(void *arg), void *arg);
+pn532_cmd_state_t pn532_cmd_wait(pn532_cmd_t *cmd, TickType_t ticks);
+bool pn532_async_command(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint8_t *buff, uint16_t size, pn532_frame_t *frame, uint16_t timeout);
 bool pn532_writeGPIO(pn532_t *obj, uint8_t pinstate);
 uint8_t pn532_readGPIO(pn532_t *obj);
 bool pn532_SAMConfig(pn532_t *obj);
+bool pn532_powerDown(pn532_t *obj, uint8_t wakeUpEnable, bool generateIrq);
+bool pn532_sleep(pn532_t *obj, uint16_t ms);
+void pn532_resume(pn532_t *obj);
+uint32_t pn532_wakeLatency(pn532_t *obj);
 bool pn532_setPassiveActivationRetries(pn532_t *obj, uint8_t maxRetries);
+bool pn532_rfConfiguration(pn532_t *obj, uint8_t item, const uint8_t *data, uint8_t dataLen);
+bool pn532_setRFField(pn532_t *obj, bool on, bool autoRFCA);
+bool pn532_setRFTimings(pn532_t *obj, pn532_rf_timeout_t atrResTimeout, pn532_rf_timeout_t retryTimeout);
+bool pn532_setMaxRetryCom(pn532_t *obj, uint8_t maxRetries);
+bool pn532_setMaxRetries(pn532_t *obj, uint8_t mxRtyATR, uint8_t mxRtyPSL, uint8_t mxRtyPassiveActivation);
+bool pn532_setAnalog106A(pn532_t *obj, const pn532_analog_106a_t *analog);
+bool pn532_setAnalog212_424(pn532_t *obj, const pn532_analog_212_424_t *analog);
+bool pn532_setRFConfig(pn532_t *obj, const pn532_rf_config_t *config);
 bool pn532_readPassiveTargetID(pn532_t *obj, uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout);
-bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8_t *response, uint8_t *responseLength);
+bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint16_t sendLength, uint8_t *response, uint8_t *responseLength);
+bool pn532_inDataExchangeLink(pn532_t *obj, uint8_t tg, const uint8_t *send, uint16_t sendLength, uint8_t *response, uint16_t *responseLength, uint8_t *status);
+bool pn532_inPSL(pn532_t *obj, uint8_t tg, uint8_t brIt, uint8_t brTi);
+bool pn532_isodep_transceive(pn532_t *obj, uint8_t tg, const uint8_t *send, uint16_t sendLength, uint8_t *response, uint16_t responseSize, uint16_t *responseLength);
+bool pn532_apdu(pn532_t *obj, uint8_t tg, const uint8_t *capdu, uint16_t capduLen, uint8_t *data, uint16_t dataSize, uint16_t *dataLen, uint16_t *sw);
+void pn532_isodep_atsBaudRates(const uint8_t *ats, uint8_t atsLen, uint8_t maxRate, uint8_t *brIt, uint8_t *brTi);
+bool pn532_isodep_selectBaudRate(pn532_t *obj, const pn532_target_t *target, uint8_t maxRate);
+bool pn532_inCommunicateThru(pn532_t *obj, const uint8_t *send, uint16_t sendLength, uint8_t *response, uint16_t *responseLength);
 bool pn532_inListPassiveTarget(pn532_t *obj);
+uint8_t pn532_inListPassiveTargets(pn532_t *obj, uint8_t maxTg, pn532_target_t *targets, uint16_t timeout);
+bool pn532_reactivateTarget(pn532_t *obj, const uint8_t *uid, uint8_t uidLen, pn532_target_t *target, uint16_t timeout);
+bool pn532_inSelect(pn532_t *obj, uint8_t tg);
+uint8_t pn532_inAutoPoll(pn532_t *obj, uint8_t pollNr, uint8_t period, const uint8_t *types, uint8_t typesLen, pn532_autopoll_t *targets, uint8_t maxTargets, uint16_t timeout);
+bool pn532_autoPollTarget(const pn532_autopoll_t *poll, pn532_target_t *target);
 bool pn532_mifareclassic_IsFirstBlock(pn532_t *obj, uint32_t uiBlock);
 bool pn532_mifareclassic_IsTrailerBlock(pn532_t *obj, uint32_t uiBlock);
 uint8_t pn532_mifareclassic_AuthenticateBlock(pn532_t *obj, uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, uint8_t *keyData);
@@ -157,14 +507,19 @@ uint8_t pn532_mifareclassic_WriteNDEFURI(pn532_t *obj, uint8_t sectorNumber, uin
 uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer);
 uint8_t pn532_mifareultralight_WritePage(pn532_t *obj, uint8_t page, uint8_t *data);
 uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer);
+uint8_t pn532_ntag2xx_ReadPages(pn532_t *obj, uint8_t startPage, uint8_t pageCount, uint8_t *buffer);
 uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data);
 uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *url, uint8_t dataLen);
+bool pn532_tgInitAsTarget(pn532_t *obj, const pn532_tg_config_t *config, uint8_t *buff, uint16_t size, uint8_t *mode, const uint8_t **initiatorCmd, uint16_t *initiatorCmdLen, uint16_t timeout);
+bool pn532_tgGetData(pn532_t *obj, uint8_t *buff, uint16_t size, const uint8_t **data, uint16_t *dataLen, uint8_t *status, uint16_t timeout);
+bool pn532_tgSetData(pn532_t *obj, const uint8_t *data, uint16_t dataLen, uint16_t timeout);
+uint32_t pn532_tg_serve(pn532_t *obj, const pn532_tg_config_t *config, pn532_tg_handler_t handler, void *ctx, uint8_t *rx, uint16_t rxSize, uint8_t *tx, uint16_t txSize, uint16_t timeout);
 uint8_t pn532_AsTarget(pn532_t *obj);
 uint8_t pn532_getDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t *cmdlen);
-uint8_t pn532_setDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen);
+uint8_t pn532_setDataTarget(pn532_t *obj, const uint8_t *cmd, uint8_t cmdlen);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#include "pn532.h"
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_ASYNC_STACK (4096)
+
+/*
+ * Driver task: once started it is the only task talking to the PN532.
+ * Other tasks hand it command descriptors through a queue and learn about
+ * completion from a callback, a semaphore of their own or by polling state.
+ * The device lock is still taken by the blocking wrappers, so a client
+ * holding it for a card session keeps other clients' commands out.
+ */
+
+static void pn532_async_task(void *arg);
+static void pn532_async_run(pn532_t *obj, pn532_cmd_t *cmd);
+static void pn532_async_complete(pn532_t *obj, pn532_cmd_t *cmd, pn532_cmd_state_t state);
+static bool pn532_async_remaining(const pn532_cmd_t *cmd, uint16_t *timeout);
+
+// Guards state transitions between the driver task and cancelling tasks
+static portMUX_TYPE pn532_async_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**************************************************************************/
+/*!
+    @brief  Starts the driver task that owns the PN532 from now on
+
+    Call after pn532_begin. Driver functions called from any other task
+    are queued to the driver task from then on.
+
+    @param  queueLen  Number of commands that can wait in the queue
+    @param  priority  Priority of the driver task
+
+    @returns ESP_OK, ESP_ERR_INVALID_STATE if already started or
+             ESP_ERR_NO_MEM
+*/
+/**************************************************************************/
+esp_err_t pn532_async_start(pn532_t *obj, uint8_t queueLen, UBaseType_t priority)
+{
+    TaskHandle_t task;
+
+    if (obj->_asyncTask != NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    obj->_asyncQueue = xQueueCreate(queueLen, sizeof(pn532_cmd_t *));
+    obj->_asyncFrame = malloc(PN532_FRAME_MAX_SIZE);
+    if (obj->_asyncQueue == NULL || obj->_asyncFrame == NULL)
+        goto fail;
+
+    if (xTaskCreate(&pn532_async_task, "pn532_task", PN532_ASYNC_STACK, obj, priority, &task) != pdPASS)
+        goto fail;
+
+    obj->_asyncTask = task;
+    return ESP_OK;
+
+fail:
+    if (obj->_asyncQueue != NULL)
+        vQueueDelete(obj->_asyncQueue);
+    free(obj->_asyncFrame);
+    obj->_asyncQueue = NULL;
+    obj->_asyncFrame = NULL;
+    return ESP_ERR_NO_MEM;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Converts a relative timeout to a command deadline
+
+    @param  timeout   Timeout in ms from now (0 = no deadline)
+*/
+/**************************************************************************/
+int64_t pn532_cmd_deadline(uint32_t timeout)
+{
+    return pn532_deadline_ms(timeout);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queues a command to the driver task
+
+    The command is sent once every command queued before it completed.
+    A done semaphore left given by an earlier command is taken first, so
+    it is only given by the completion of this one.
+
+    @param  cmd       Command descriptor, owned by the driver until it
+                      completes
+
+    @returns ESP_OK, ESP_ERR_INVALID_STATE without driver task or
+             ESP_ERR_TIMEOUT if the queue is full
+*/
+/**************************************************************************/
+esp_err_t pn532_async_submit(pn532_t *obj, pn532_cmd_t *cmd)
+{
+    if (obj->_asyncQueue == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    if (cmd->done != NULL)
+        xSemaphoreTake(cmd->done, 0);
+    cmd->responseLen = 0;
+    cmd->cancel = false;
+    cmd->state = PN532_CMD_PENDING;
+
+    if (xQueueSend(obj->_asyncQueue, &cmd, 0) != pdTRUE)
+    {
+        cmd->state = PN532_CMD_FAILED;
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Cancels a queued or running command
+
+    A queued command is never sent, a running one stops waiting for the
+    PN532 and is aborted with an ACK frame. Either way it completes as
+    PN532_CMD_CANCELLED from the driver task, so wait for completion as
+    usual before reusing the descriptor.
+
+    @returns true if the command will complete as cancelled, false if it
+             had already completed
+*/
+/**************************************************************************/
+bool pn532_async_cancel(pn532_t *obj, pn532_cmd_t *cmd)
+{
+    bool cancelled = false;
+    bool running = false;
+
+    // a running command no longer current is completing with its result
+    portENTER_CRITICAL(&pn532_async_mux);
+    if (cmd->state == PN532_CMD_PENDING || (cmd->state == PN532_CMD_RUNNING && obj->_asyncCurrent == cmd))
+    {
+        cmd->cancel = true;
+        cancelled = true;
+        if (obj->_asyncCurrent == cmd)
+        {
+            obj->_abort = true;
+            running = true;
+        }
+    }
+    portEXIT_CRITICAL(&pn532_async_mux);
+
+    // wake a driver task sleeping on the IRQ line
+    if (running && obj->_irqSem != NULL)
+        xSemaphoreGive(obj->_irqSem);
+
+    return cancelled;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Cancels whatever command the driver task is running
+
+    For pn532_abortCommand called from another task: the driver task
+    stops waiting and aborts the command itself. Between commands the
+    PN532 is idle, so there is nothing to abort.
+
+    @returns true if a running command will complete as cancelled
+*/
+/**************************************************************************/
+bool pn532_async_cancelRunning(pn532_t *obj)
+{
+    bool running = false;
+
+    portENTER_CRITICAL(&pn532_async_mux);
+    if (obj->_asyncCurrent != NULL)
+    {
+        obj->_asyncCurrent->cancel = true;
+        obj->_abort = true;
+        running = true;
+    }
+    portEXIT_CRITICAL(&pn532_async_mux);
+
+    if (running && obj->_irqSem != NULL)
+        xSemaphoreGive(obj->_irqSem);
+
+    return running;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Waits for a command submitted with a done semaphore
+
+    @param  cmd       Command descriptor
+    @param  ticks     Ticks to wait at most (portMAX_DELAY = forever)
+
+    @returns The command state, PN532_CMD_PENDING/RUNNING on timeout
+             (the semaphore is given later, don't reuse the descriptor)
+*/
+/**************************************************************************/
+pn532_cmd_state_t pn532_cmd_wait(pn532_cmd_t *cmd, TickType_t ticks)
+{
+    // state is final before done is given
+    if (cmd->done != NULL)
+        xSemaphoreTake(cmd->done, ticks);
+    return cmd->state;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Blocking wrapper: queues a command and sleeps until it completes
+
+    The driver task copies the response payload to buff, so callers see
+    the same frame view as for a command run on their own task. A
+    deadline is enforced by the driver task; without one (timeout 0, e.g.
+    InListPassiveTarget waiting for a card) this blocks until the PN532
+    answers, as the command would on the calling task.
+
+    @param  cmd       Pointer to the command buffer (may be buff)
+    @param  cmdlen    The size of the command in bytes
+    @param  buff      Buffer receiving the response payload
+    @param  size      Size of buff in bytes
+    @param  frame     Parsed view of the response, payload points to buff
+    @param  timeout   Deadline in ms from now (0 = none)
+
+    @returns true if the command was ACKed and answered, false otherwise
+*/
+/**************************************************************************/
+bool pn532_async_command(pn532_t *obj, const uint8_t *cmd, uint16_t cmdlen, uint8_t *buff, uint16_t size, pn532_frame_t *frame, uint16_t timeout)
+{
+    StaticSemaphore_t doneBuffer;
+    pn532_cmd_t req = {
+        .cmd = cmd,
+        .cmdLen = cmdlen,
+        .response = buff,
+        .responseSize = size,
+        .deadline = pn532_cmd_deadline(timeout),
+        .done = xSemaphoreCreateBinaryStatic(&doneBuffer),
+    };
+
+    if (cmdlen == 0 || pn532_async_submit(obj, &req) != ESP_OK)
+        return false;
+
+    // returns once the driver task is done with req (see above for the deadline)
+    if (pn532_cmd_wait(&req, portMAX_DELAY) != PN532_CMD_DONE)
+        return false;
+
+    frame->tfi = PN532_PN532TOHOST;
+    frame->command = cmd[0] + 1;
+    frame->payload = buff;
+    frame->payloadLen = req.responseLen;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queues a function to the driver task and sleeps until it ran
+
+    For driver functions that talk to the PN532 without a command frame
+    (pn532_sleep, pn532_resume), so they run in order with the queued
+    commands.
+
+    @param  run       Function called from the driver task
+    @param  arg       Argument passed to run
+
+    @returns What run returned, false if it couldn't be queued or was
+             cancelled
+*/
+/**************************************************************************/
+bool pn532_async_call(pn532_t *obj, bool (*run)(void *arg), void *arg)
+{
+    StaticSemaphore_t doneBuffer;
+    pn532_cmd_t req = {
+        .run = run,
+        .runArg = arg,
+        .deadline = PN532_CMD_NO_DEADLINE,
+        .done = xSemaphoreCreateBinaryStatic(&doneBuffer),
+    };
+
+    if (pn532_async_submit(obj, &req) != ESP_OK)
+        return false;
+
+    return pn532_cmd_wait(&req, portMAX_DELAY) == PN532_CMD_DONE;
+}
+
+static void pn532_async_task(void *arg)
+{
+    pn532_t *obj = (pn532_t *)arg;
+    pn532_cmd_t *cmd;
+
+    while (1)
+    {
+        if (xQueueReceive(obj->_asyncQueue, &cmd, portMAX_DELAY) == pdTRUE)
+            pn532_async_run(obj, cmd);
+    }
+}
+
+static void pn532_async_run(pn532_t *obj, pn532_cmd_t *cmd)
+{
+    pn532_frame_t frame;
+    pn532_cmd_state_t state;
+    uint16_t timeout;
+    bool ok;
+
+    portENTER_CRITICAL(&pn532_async_mux);
+    if (!cmd->cancel)
+    {
+        cmd->state = PN532_CMD_RUNNING;
+        obj->_asyncCurrent = cmd;
+        obj->_abort = false;
+    }
+    portEXIT_CRITICAL(&pn532_async_mux);
+
+    // cancelled while queued: never sent
+    if (cmd->state != PN532_CMD_RUNNING)
+    {
+        pn532_async_complete(obj, cmd, PN532_CMD_CANCELLED);
+        return;
+    }
+
+    // a function instead of a command frame, it waits on its own
+    if (cmd->run != NULL)
+    {
+        pn532_async_complete(obj, cmd, cmd->run(cmd->runArg) ? PN532_CMD_DONE : PN532_CMD_FAILED);
+        return;
+    }
+
+    // expired while queued: don't bother the PN532
+    if (!pn532_async_remaining(cmd, &timeout))
+    {
+        pn532_async_complete(obj, cmd, PN532_CMD_TIMEOUT);
+        return;
+    }
+
+    ok = pn532_transceive(obj, cmd->cmd, cmd->cmdLen, obj->_asyncFrame, PN532_FRAME_MAX_SIZE, &frame, timeout);
+
+    if (ok)
+    {
+        if (frame.payloadLen > cmd->responseSize)
+        {
+            PN532_DEBUG("Response too long\n");
+            state = PN532_CMD_FAILED;
+        }
+        else
+        {
+            memcpy(cmd->response, frame.payload, frame.payloadLen);
+            cmd->responseLen = frame.payloadLen;
+            state = PN532_CMD_DONE;
+        }
+    }
+    else if (cmd->cancel)
+    {
+        state = PN532_CMD_CANCELLED;
+    }
+    else if (!pn532_async_remaining(cmd, &timeout))
+    {
+        state = PN532_CMD_TIMEOUT;
+    }
+    else
+    {
+        state = PN532_CMD_FAILED;
+    }
+
+    // the PN532 may still be busy with it, stop it before the next command
+    if (state == PN532_CMD_CANCELLED || state == PN532_CMD_TIMEOUT)
+        pn532_abortCommand(obj);
+
+    pn532_async_complete(obj, cmd, state);
+}
+
+static void pn532_async_complete(pn532_t *obj, pn532_cmd_t *cmd, pn532_cmd_state_t state)
+{
+    SemaphoreHandle_t done = cmd->done;
+
+    // no longer current, so it can't be cancelled while the callback runs
+    portENTER_CRITICAL(&pn532_async_mux);
+    obj->_asyncCurrent = NULL;
+    obj->_abort = false;
+    portEXIT_CRITICAL(&pn532_async_mux);
+
+    if (cmd->callback != NULL)
+        cmd->callback(cmd, state, cmd->callbackArg);
+
+    // a poller may reuse cmd as soon as state is final, a waiter once done is given
+    portENTER_CRITICAL(&pn532_async_mux);
+    cmd->state = state;
+    portEXIT_CRITICAL(&pn532_async_mux);
+
+    if (done != NULL)
+        xSemaphoreGive(done);
+}
+
+// Time left until the deadline in ms (0 = no deadline), false once it passed
+static bool pn532_async_remaining(const pn532_cmd_t *cmd, uint16_t *timeout)
+{
+    uint32_t left = pn532_deadline_left_us(cmd->deadline);
+    uint32_t ms;
+
+    *timeout = 0;
+    if (cmd->deadline == PN532_CMD_NO_DEADLINE)
+        return true;
+    if (left == 0)
+        return false;
+
+    // round up so a sub-ms remainder doesn't turn into "forever"
+    ms = (left + 999) / 1000;
+    *timeout = ms > UINT16_MAX ? UINT16_MAX : ms;
+    return true;
+}
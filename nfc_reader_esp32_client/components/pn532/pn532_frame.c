@@ -0,0 +1,232 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pn532_frame.h"
+
+#define FRAME_PREAMBLE    (0x00)
+#define FRAME_STARTCODE1  (0x00)
+#define FRAME_STARTCODE2  (0xFF)
+#define FRAME_POSTAMBLE   (0x00)
+
+static const uint8_t pn532_frame_ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+static const uint8_t pn532_frame_nack[] = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
+static const uint8_t pn532_frame_error[] = {0x00, 0x00, 0xFF, 0x01, 0xFF, PN532_FRAME_ERROR_TFI, 0x81, 0x00};
+
+static size_t pn532_frame_copy(uint8_t *out, size_t outSize, const uint8_t *frame, size_t frameLen);
+
+/**************************************************************************/
+/*!
+    @brief  Builds an information frame
+
+    A normal frame is used when TFI and data fit into an 8-bit LEN,
+    an extended frame otherwise.
+
+    @param  out       Output buffer
+    @param  outSize   Size of the output buffer
+    @param  tfi       Frame identifier (PN532_HOSTTOPN532 for commands)
+    @param  data      PD0..PDn (command code and parameters)
+    @param  dataLen   Length of data in bytes
+
+    @returns Frame size in bytes, 0 if it doesn't fit out or the PN532
+*/
+/**************************************************************************/
+size_t pn532_frame_encode(uint8_t *out, size_t outSize, uint8_t tfi, const uint8_t *data, uint16_t dataLen)
+{
+    uint16_t len = dataLen + 1;
+    bool extended = len > PN532_FRAME_NORMAL_MAX_LEN;
+    size_t size = len + (extended ? PN532_FRAME_OVERHEAD : PN532_FRAME_OVERHEAD - 3);
+    uint8_t checksum;
+    size_t n = 0;
+
+    if (len > PN532_FRAME_MAX_LEN || outSize < size)
+        return 0;
+
+    out[n++] = FRAME_PREAMBLE;
+    out[n++] = FRAME_STARTCODE1;
+    out[n++] = FRAME_STARTCODE2;
+
+    if (extended)
+    {
+        out[n++] = 0xFF;
+        out[n++] = 0xFF;
+        out[n++] = len >> 8;
+        out[n++] = len & 0xFF;
+        out[n++] = (uint8_t)(~((len >> 8) + (len & 0xFF)) + 1);
+    }
+    else
+    {
+        out[n++] = len;
+        out[n++] = (uint8_t)(~len + 1);
+    }
+
+    out[n++] = tfi;
+    checksum = tfi;
+    for (uint16_t i = 0; i < dataLen; i++)
+    {
+        out[n++] = data[i];
+        checksum += data[i];
+    }
+
+    out[n++] = ~checksum + 1;
+    out[n++] = FRAME_POSTAMBLE;
+
+    return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Builds an ACK frame
+
+    @returns Frame size in bytes, 0 if it doesn't fit out
+*/
+/**************************************************************************/
+size_t pn532_frame_encode_ack(uint8_t *out, size_t outSize)
+{
+    return pn532_frame_copy(out, outSize, pn532_frame_ack, sizeof(pn532_frame_ack));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Builds a NACK frame (asks the PN532 to resend its last frame)
+
+    @returns Frame size in bytes, 0 if it doesn't fit out
+*/
+/**************************************************************************/
+size_t pn532_frame_encode_nack(uint8_t *out, size_t outSize)
+{
+    return pn532_frame_copy(out, outSize, pn532_frame_nack, sizeof(pn532_frame_nack));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Builds a syntax error frame as sent by the PN532
+
+    @returns Frame size in bytes, 0 if it doesn't fit out
+*/
+/**************************************************************************/
+size_t pn532_frame_encode_error(uint8_t *out, size_t outSize)
+{
+    return pn532_frame_copy(out, outSize, pn532_frame_error, sizeof(pn532_frame_error));
+}
+
+static size_t pn532_frame_copy(uint8_t *out, size_t outSize, const uint8_t *frame, size_t frameLen)
+{
+    if (outSize < frameLen)
+        return 0;
+    memcpy(out, frame, frameLen);
+    return frameLen;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Decodes the first frame in a byte stream
+
+    Leading bytes up to the 00 FF start code (the optional preamble or
+    line noise) are skipped. Nothing is copied, view->data points into buf.
+
+    On PN532_FRAME_INCOMPLETE view->size is the number of bytes needed
+    to get further (the whole frame once LEN is known). On any other
+    error view->size is the number of bytes that can be dropped before
+    looking for the next frame.
+
+    @param  buf       Received bytes
+    @param  len       Number of bytes in buf
+    @param  view      Decoded frame
+
+    @returns PN532_FRAME_OK or the reason the frame was not decoded
+*/
+/**************************************************************************/
+pn532_frame_status_t pn532_frame_decode(const uint8_t *buf, size_t len, pn532_frame_view_t *view)
+{
+    size_t start;
+    size_t pos;
+    uint16_t flen;
+    uint8_t checksum;
+
+    for (start = 0; start + 1 < len; start++)
+    {
+        if (buf[start] == FRAME_STARTCODE1 && buf[start + 1] == FRAME_STARTCODE2)
+            break;
+    }
+    if (start + 1 >= len)
+    {
+        // a trailing 00 may be the first half of the start code
+        view->size = (len > 0 && buf[len - 1] == FRAME_STARTCODE1) ? len - 1 : len;
+        return PN532_FRAME_NO_START;
+    }
+    pos = start + 2;
+
+    view->tfi = 0;
+    view->data = NULL;
+    view->dataLen = 0;
+
+    if (len < pos + 2)
+    {
+        view->size = pos + 2;
+        return PN532_FRAME_INCOMPLETE;
+    }
+
+    // ACK and NACK: LEN and LCS with no data, then the postamble
+    if ((buf[pos] == 0x00 && buf[pos + 1] == 0xFF) || (buf[pos] == 0xFF && buf[pos + 1] == 0x00))
+    {
+        view->kind = buf[pos] == 0x00 ? PN532_FRAME_ACK : PN532_FRAME_NACK;
+        view->size = pos + 3;
+        return len < view->size ? PN532_FRAME_INCOMPLETE : PN532_FRAME_OK;
+    }
+
+    if (buf[pos] == 0xFF && buf[pos + 1] == 0xFF)
+    {
+        if (len < pos + 5)
+        {
+            view->size = pos + 5;
+            return PN532_FRAME_INCOMPLETE;
+        }
+        if ((uint8_t)(buf[pos + 2] + buf[pos + 3] + buf[pos + 4]) != 0)
+        {
+            view->size = pos;
+            return PN532_FRAME_BAD_LCS;
+        }
+        flen = (buf[pos + 2] << 8) | buf[pos + 3];
+        pos += 5;
+    }
+    else
+    {
+        if ((uint8_t)(buf[pos] + buf[pos + 1]) != 0)
+        {
+            view->size = pos;
+            return PN532_FRAME_BAD_LCS;
+        }
+        flen = buf[pos];
+        pos += 2;
+    }
+
+    if (flen == 0)
+    {
+        view->size = pos;
+        return PN532_FRAME_BAD_LEN;
+    }
+
+    // TFI, data, DCS and the postamble
+    view->size = pos + flen + 2;
+    if (len < view->size)
+        return PN532_FRAME_INCOMPLETE;
+
+    checksum = 0;
+    for (size_t i = 0; i < (size_t)flen + 1; i++)
+    {
+        checksum += buf[pos + i];
+    }
+    if (checksum != 0)
+    {
+        view->size = pos;
+        return PN532_FRAME_BAD_DCS;
+    }
+
+    view->tfi = buf[pos];
+    view->data = buf + pos + 1;
+    view->dataLen = flen - 1;
+    view->kind = (view->tfi == PN532_FRAME_ERROR_TFI && flen == 1) ? PN532_FRAME_ERROR : PN532_FRAME_INFO;
+    return PN532_FRAME_OK;
+}
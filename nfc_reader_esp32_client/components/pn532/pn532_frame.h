@@ -0,0 +1,68 @@
+#ifndef __PN532_FRAME_H__
+#define __PN532_FRAME_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PN532 frame codec. Plain C without FreeRTOS/driver dependencies so it
+ * can be built and exercised on a host.
+ *
+ * Normal information frame:   00 00 FF LEN LCS TFI PD0..PDn DCS 00
+ * Extended information frame: 00 00 FF FF FF LENM LENL LCS TFI PD0..PDn DCS 00
+ * ACK frame:                  00 00 FF 00 FF 00
+ * NACK frame:                 00 00 FF FF 00 00
+ * Error frame:                00 00 FF 01 FF 7F 81 00
+ *
+ * LEN counts TFI and PD0..PDn. The preamble is optional on receive.
+ */
+
+#define PN532_FRAME_MAX_LEN         (265) // Largest LEN the PN532 handles (TFI + 264 bytes)
+#define PN532_FRAME_NORMAL_MAX_LEN  (255)
+#define PN532_FRAME_OVERHEAD        (10)  // Preamble .. LCS of an extended frame, DCS, postamble
+#define PN532_FRAME_MAX_SIZE        (PN532_FRAME_MAX_LEN + PN532_FRAME_OVERHEAD)
+#define PN532_FRAME_ERROR_TFI       (0x7F)
+
+typedef enum {
+    PN532_FRAME_OK = 0,         // Complete, valid frame
+    PN532_FRAME_INCOMPLETE,     // More bytes are needed (see pn532_frame_view_t.size)
+    PN532_FRAME_NO_START,       // No start code in the buffer
+    PN532_FRAME_BAD_LCS,        // Length checksum mismatch
+    PN532_FRAME_BAD_DCS,        // Data checksum mismatch
+    PN532_FRAME_BAD_LEN,        // Zero length information frame
+} pn532_frame_status_t;
+
+typedef enum {
+    PN532_FRAME_INFO,
+    PN532_FRAME_ACK,
+    PN532_FRAME_NACK,
+    PN532_FRAME_ERROR,
+} pn532_frame_kind_t;
+
+/**
+ * Decoded frame. data points into the decoded buffer, nothing is copied.
+ */
+typedef struct {
+    pn532_frame_kind_t kind;
+    uint8_t tfi;          // Frame identifier (information and error frames)
+    const uint8_t *data;  // PD0..PDn
+    uint16_t dataLen;     // Length of data in bytes
+    size_t size;          // Bytes the frame takes in the buffer, including
+                          // anything skipped before the start code
+} pn532_frame_view_t;
+
+size_t pn532_frame_encode(uint8_t *out, size_t outSize, uint8_t tfi, const uint8_t *data, uint16_t dataLen);
+size_t pn532_frame_encode_ack(uint8_t *out, size_t outSize);
+size_t pn532_frame_encode_nack(uint8_t *out, size_t outSize);
+size_t pn532_frame_encode_error(uint8_t *out, size_t outSize);
+pn532_frame_status_t pn532_frame_decode(const uint8_t *buf, size_t len, pn532_frame_view_t *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
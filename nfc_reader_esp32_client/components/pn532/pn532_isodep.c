@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "pn532.h"
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_UNLOCK_RETURN(obj, ret) \
+    do                                \
+    {                                 \
+        pn532_unlock(obj);            \
+        return ret;                   \
+    } while (0)
+
+/*
+ * ISO14443-4 (ISO-DEP) on top of InDataExchange. The PN532 does the
+ * ISO-DEP block framing with the card; what doesn't fit one PN532 frame
+ * is chained with the MI bit: in Tg for commands, in the status byte for
+ * responses.
+ */
+
+// Data bytes per InDataExchange (command code and Tg take the rest)
+#define PN532_ISODEP_CHUNK (PN532_PACKBUFFSIZ - 2)
+
+// ATS interface bytes
+#define ATS_T0_TA          (0x10)  // TA(1) present
+#define ATS_TA_SAME_D      (0x80)  // Same rate in both directions only
+
+static uint8_t pn532_isodep_fastest(uint8_t mask, uint8_t maxRate);
+
+/**************************************************************************/
+/*!
+    @brief  Exchanges data of any length with an ISO-DEP target
+
+    Commands longer than one PN532 frame are sent as a chain, chained
+    responses are collected until the target clears MI.
+
+    @param  tg              Logical target number
+    @param  send            Data to send (e.g. a C-APDU)
+    @param  sendLength      Length of send in bytes
+    @param  response        Buffer receiving the whole response
+    @param  responseSize    Size of response in bytes
+    @param  responseLength  Length of the response
+
+    @returns true on success, false on an error or if the response
+             doesn't fit into response
+*/
+/**************************************************************************/
+bool pn532_isodep_transceive(pn532_t *obj, uint8_t tg, const uint8_t *send, uint16_t sendLength, uint8_t *response, uint16_t responseSize, uint16_t *responseLength)
+{
+    uint16_t pos = 0;
+    uint16_t got = 0;
+    uint16_t n;
+    uint8_t status = 0;
+
+    pn532_lock(obj);
+
+    // command chaining: every chunk but the last carries MI
+    do
+    {
+        uint16_t chunk = sendLength - pos;
+        if (chunk > PN532_ISODEP_CHUNK)
+            chunk = PN532_ISODEP_CHUNK;
+        bool more = pos + chunk < sendLength;
+
+        n = responseSize - got;
+        if (!pn532_inDataExchangeLink(obj, more ? (tg | PN532_TG_MI) : tg, send + pos, chunk, response + got, &n, &status))
+            PN532_UNLOCK_RETURN(obj, false);
+        pos += chunk;
+        got += n;
+    } while (pos < sendLength);
+
+    // response chaining: an empty InDataExchange fetches the next chunk
+    while (status & PN532_STATUS_MI)
+    {
+        n = responseSize - got;
+        if (!pn532_inDataExchangeLink(obj, tg, NULL, 0, response + got, &n, &status))
+            PN532_UNLOCK_RETURN(obj, false);
+        got += n;
+    }
+
+    PN532_DEBUG("ISO-DEP: sent %d, received %d bytes\n", sendLength, got);
+    *responseLength = got;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends a C-APDU and splits the R-APDU into data and status word
+
+    SW1 = 61 (more data available) is handled here with GET RESPONSE, the
+    data of all parts is concatenated. Other status words (e.g. 91 AF of
+    DESFire native commands) are left to the caller.
+
+    @param  tg        Logical target number
+    @param  capdu     Command APDU
+    @param  capduLen  Length of capdu in bytes
+    @param  data      Buffer receiving the response data
+    @param  dataSize  Size of data in bytes, including 2 bytes of room
+                      for the status word
+    @param  dataLen   Length of the response data (without status word)
+    @param  sw        Status word (SW1 SW2)
+
+    @returns true if an R-APDU was received, false otherwise (check sw
+             for the outcome of the command)
+*/
+/**************************************************************************/
+bool pn532_apdu(pn532_t *obj, uint8_t tg, const uint8_t *capdu, uint16_t capduLen, uint8_t *data, uint16_t dataSize, uint16_t *dataLen, uint16_t *sw)
+{
+    uint8_t getResponse[] = {0x00, 0xC0, 0x00, 0x00, 0x00};
+    uint16_t got = 0;
+    uint16_t n;
+
+    pn532_lock(obj);
+
+    if (!pn532_isodep_transceive(obj, tg, capdu, capduLen, data, dataSize, &n))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    while (1)
+    {
+        if (n < 2)
+        {
+            PN532_DEBUG("R-APDU without status word\n");
+            PN532_UNLOCK_RETURN(obj, false);
+        }
+
+        // the status word of each part is overwritten by the next part
+        got += n - 2;
+        *sw = (data[got] << 8) | data[got + 1];
+        if (PN532_SW1(*sw) != PN532_SW1_MORE_DATA)
+            break;
+
+        getResponse[4] = *sw & 0xFF;
+        if (!pn532_isodep_transceive(obj, tg, getResponse, sizeof(getResponse), data + got, dataSize - got, &n))
+            PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    *dataLen = got;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Picks the fastest bit rates a target supports from its ATS
+
+    @param  ats       ATS starting with TL
+    @param  atsLen    Length of ats in bytes
+    @param  maxRate   Fastest rate to use (PN532_BAUD_*)
+    @param  brIt      Initiator to target rate
+    @param  brTi      Target to initiator rate
+*/
+/**************************************************************************/
+void pn532_isodep_atsBaudRates(const uint8_t *ats, uint8_t atsLen, uint8_t maxRate, uint8_t *brIt, uint8_t *brTi)
+{
+    *brIt = PN532_BAUD_106;
+    *brTi = PN532_BAUD_106;
+
+    // TL T0 TA(1): without TA(1) the card only does 106 kbps
+    if (atsLen < 3 || ats[0] < 3 || !(ats[1] & ATS_T0_TA))
+        return;
+
+    uint8_t ta = ats[2];
+    uint8_t dr = ta & 0x07;          // PCD to PICC: 2, 4, 8
+    uint8_t ds = (ta >> 4) & 0x07;   // PICC to PCD: 2, 4, 8
+
+    if (ta & ATS_TA_SAME_D)
+    {
+        *brIt = *brTi = pn532_isodep_fastest(dr & ds, maxRate);
+    }
+    else
+    {
+        *brIt = pn532_isodep_fastest(dr, maxRate);
+        *brTi = pn532_isodep_fastest(ds, maxRate);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Switches an ISO-DEP target to the fastest bit rates it
+            announces in its ATS (InPSL), up to maxRate
+
+    @param  target    Target as activated by the PN532
+    @param  maxRate   Fastest rate to use (PN532_BAUD_212 or _424)
+
+    @returns true if the target runs at the chosen rates (106 kbps when
+             the ATS offers nothing faster), false if InPSL failed
+*/
+/**************************************************************************/
+bool pn532_isodep_selectBaudRate(pn532_t *obj, const pn532_target_t *target, uint8_t maxRate)
+{
+    uint8_t brIt;
+    uint8_t brTi;
+
+    pn532_isodep_atsBaudRates(target->ats, target->atsLen, maxRate, &brIt, &brTi);
+    if (brIt == PN532_BAUD_106 && brTi == PN532_BAUD_106)
+        return true;
+
+    PN532_DEBUG("ISO-DEP: PSL to %d/%d\n", brIt, brTi);
+    return pn532_inPSL(obj, target->tg, brIt, brTi);
+}
+
+// Fastest PN532 rate in a DS/DR mask (bit 0 = 212, bit 1 = 424, bit 2 = 848)
+static uint8_t pn532_isodep_fastest(uint8_t mask, uint8_t maxRate)
+{
+    if (maxRate >= PN532_BAUD_424 && (mask & 0x02))
+        return PN532_BAUD_424;
+    if (maxRate >= PN532_BAUD_212 && (mask & 0x01))
+        return PN532_BAUD_212;
+    return PN532_BAUD_106;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "pn532.h"
+#include "pn532_ndef.h"
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_UNLOCK_RETURN(obj, ret) \
+    do                                \
+    {                                 \
+        pn532_unlock(obj);            \
+        return ret;                   \
+    } while (0)
+
+// Asks the caller for more data if the buffer ends before pos + n
+#define PN532_NDEF_NEED(parser, pos, n, len)            \
+    do                                                  \
+    {                                                   \
+        if ((uint32_t)(pos) + (n) > (len))              \
+        {                                               \
+            (parser)->need = (uint32_t)(pos) + (n);     \
+            return PN532_NDEF_MORE;                     \
+        }                                               \
+    } while (0)
+
+#define PN532_NDEF_MIN_READ_PAGES   (4)   // Pages fetched at least per FAST_READ, as much as one READ returns
+#define PN532_NDEF_PAGE_SIZE        (4)
+#define PN532_NDEF_BLOCK_SIZE       (16)
+#define PN532_NDEF_CLASSIC_SECTORS  (40)  // MIFARE Classic 4K
+#define PN532_NDEF_MAD2_SECTOR      (16)  // MAD2 of a 4K card, MAD key instead of the NDEF key
+
+static uint8_t pn532_ndef_sectorFirstBlock(uint8_t sector);
+static uint8_t pn532_ndef_sectorBlocks(uint8_t sector);
+
+/**************************************************************************/
+/*!
+    @brief  Starts parsing a new data area
+*/
+/**************************************************************************/
+void pn532_ndef_init(pn532_ndef_parser_t *parser)
+{
+    parser->pos = 0;
+    parser->msgEnd = 0;
+    parser->need = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Parses the next NDEF record of the first NDEF message TLV
+
+    Call again with the same buffer holding more data after
+    PN532_NDEF_MORE; nothing is consumed until a record is complete.
+    Lock control, memory control and proprietary TLVs are skipped.
+
+    @param  buff      Data area of the tag as read so far
+    @param  len       Bytes in buff
+    @param  record    Parsed record, pointing into buff
+
+    @returns PN532_NDEF_RECORD for a record, PN532_NDEF_MORE if buff has
+             to hold at least need bytes to go on, PN532_NDEF_END after
+             the last record and PN532_NDEF_ERROR for malformed data
+*/
+/**************************************************************************/
+pn532_ndef_result_t pn532_ndef_next(pn532_ndef_parser_t *parser, const uint8_t *buff, uint16_t len, pn532_ndef_record_t *record)
+{
+    while (1)
+    {
+        uint32_t p = parser->pos;
+
+        if (parser->msgEnd)
+        {
+            if (p >= parser->msgEnd)
+                return PN532_NDEF_END;
+
+            // flags, TYPE_LENGTH, PAYLOAD_LENGTH (1 or 4), ID_LENGTH, TYPE, ID, PAYLOAD
+            PN532_NDEF_NEED(parser, p, 3, len);
+            uint8_t flags = buff[p];
+            uint8_t typeLen = buff[p + 1];
+            uint32_t payloadLen;
+            uint8_t idLen = 0;
+            p += 2;
+
+            if (flags & PN532_NDEF_SR)
+            {
+                payloadLen = buff[p++];
+            }
+            else
+            {
+                PN532_NDEF_NEED(parser, p, 4, len);
+                payloadLen = ((uint32_t)buff[p] << 24) | ((uint32_t)buff[p + 1] << 16) | (buff[p + 2] << 8) | buff[p + 3];
+                p += 4;
+            }
+            if (flags & PN532_NDEF_IL)
+            {
+                PN532_NDEF_NEED(parser, p, 1, len);
+                idLen = buff[p++];
+            }
+
+            if (payloadLen > parser->msgEnd || p + typeLen + idLen + payloadLen > parser->msgEnd)
+            {
+                PN532_DEBUG("NDEF: record exceeds the message\n");
+                return PN532_NDEF_ERROR;
+            }
+            PN532_NDEF_NEED(parser, p, typeLen + idLen + payloadLen, len);
+
+            record->flags = flags & ~PN532_NDEF_TNF_MASK;
+            record->tnf = flags & PN532_NDEF_TNF_MASK;
+            record->type = buff + p;
+            record->typeLen = typeLen;
+            record->id = buff + p + typeLen;
+            record->idLen = idLen;
+            record->payload = buff + p + typeLen + idLen;
+            record->payloadLen = payloadLen;
+            parser->pos = p + typeLen + idLen + payloadLen;
+            return PN532_NDEF_RECORD;
+        }
+
+        PN532_NDEF_NEED(parser, p, 1, len);
+        uint8_t t = buff[p++];
+        if (t == PN532_NDEF_TLV_NULL)
+        {
+            parser->pos = p;
+            continue;
+        }
+        if (t == PN532_NDEF_TLV_TERMINATOR)
+            return PN532_NDEF_END;
+
+        // L is one byte, or 0xFF and two bytes
+        PN532_NDEF_NEED(parser, p, 1, len);
+        uint32_t l = buff[p++];
+        if (l == 0xFF)
+        {
+            PN532_NDEF_NEED(parser, p, 2, len);
+            l = (buff[p] << 8) | buff[p + 1];
+            p += 2;
+        }
+        if (p + l > UINT16_MAX)
+            return PN532_NDEF_ERROR;
+
+        if (t == PN532_NDEF_TLV_MESSAGE)
+        {
+            PN532_DEBUG("NDEF: message of %u bytes at %u\n", (unsigned)l, (unsigned)p);
+            parser->msgEnd = p + l;
+            parser->pos = p;
+            if (l == 0)
+                return PN532_NDEF_END;
+            continue;
+        }
+
+        parser->pos = p + l;
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Checks the type of a record, e.g. (PN532_NDEF_TNF_WELL_KNOWN,
+            "U") for a URI or (PN532_NDEF_TNF_EXTERNAL, "example.com:id")
+*/
+/**************************************************************************/
+bool pn532_ndef_isType(const pn532_ndef_record_t *record, uint8_t tnf, const char *type)
+{
+    size_t len = strlen(type);
+
+    return record->tnf == tnf && record->typeLen == len && memcmp(record->type, type, len) == 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads NDEF records of an NTAG21x/Type 2 tag up to the first
+            one that matches
+
+    The capability container and the first pages come with one
+    FAST_READ; later reads fetch only what the parser needs to complete
+    the next TLV or record header or the record itself.
+
+    @param  buff      Buffer receiving the CC page and the data area
+    @param  size      Size of buff in bytes
+    @param  match     Picks the wanted record (NULL = first record)
+    @param  ctx       Passed to match
+    @param  record    Matching record, pointing into buff
+
+    @returns true if a record matched, false if none did, the tag isn't
+             NDEF formatted or the record doesn't fit into buff
+*/
+/**************************************************************************/
+bool pn532_ndef_readNtag(pn532_t *obj, uint8_t *buff, uint16_t size, pn532_ndef_match_t match, void *ctx, pn532_ndef_record_t *record)
+{
+    pn532_ndef_parser_t parser;
+    uint16_t got;
+    uint16_t end;
+    uint16_t pages;
+
+    // buff[0..3] is the CC page, the data area starts at page 4
+    pages = size / PN532_NDEF_PAGE_SIZE;
+    if (pages < 2)
+        return false;
+    if (pages > PN532_NDEF_MIN_READ_PAGES)
+        pages = PN532_NDEF_MIN_READ_PAGES;
+
+    pn532_lock(obj);
+
+    if (!pn532_ntag2xx_ReadPages(obj, PN532_NDEF_CC_PAGE, pages, buff))
+        PN532_UNLOCK_RETURN(obj, false);
+    got = pages * PN532_NDEF_PAGE_SIZE;
+
+    if (buff[0] != PN532_NDEF_CC_MAGIC)
+    {
+        PN532_DEBUG("NDEF: no capability container\n");
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+    end = PN532_NDEF_PAGE_SIZE + buff[2] * 8;
+    if (end > size)
+        end = size - size % PN532_NDEF_PAGE_SIZE;
+
+    pn532_ndef_init(&parser);
+    while (1)
+    {
+        switch (pn532_ndef_next(&parser, buff + PN532_NDEF_PAGE_SIZE, got - PN532_NDEF_PAGE_SIZE, record))
+        {
+        case PN532_NDEF_RECORD:
+            if (match == NULL || match(ctx, record))
+                PN532_UNLOCK_RETURN(obj, true);
+            continue;
+        case PN532_NDEF_MORE:
+            break;
+        default:
+            PN532_UNLOCK_RETURN(obj, false);
+        }
+
+        uint32_t need = PN532_NDEF_PAGE_SIZE + parser.need;
+        if (need > end)
+        {
+            PN532_DEBUG("NDEF: %u bytes needed, %u available\n", (unsigned)need, end);
+            PN532_UNLOCK_RETURN(obj, false);
+        }
+
+        pages = (need - got + PN532_NDEF_PAGE_SIZE - 1) / PN532_NDEF_PAGE_SIZE;
+        if (pages < PN532_NDEF_MIN_READ_PAGES)
+            pages = PN532_NDEF_MIN_READ_PAGES;
+        if (pages > (end - got) / PN532_NDEF_PAGE_SIZE)
+            pages = (end - got) / PN532_NDEF_PAGE_SIZE;
+
+        if (!pn532_ntag2xx_ReadPages(obj, PN532_NDEF_CC_PAGE + got / PN532_NDEF_PAGE_SIZE, pages, buff + got))
+            PN532_UNLOCK_RETURN(obj, false);
+        got += pages * PN532_NDEF_PAGE_SIZE;
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads NDEF records of a MIFARE Classic tag up to the first one
+            that matches
+
+    The data blocks of consecutive sectors are read block by block into
+    buff without the sector trailers, each sector is authenticated with
+    key A when reading enters it. The MAD2 sector of a 4K card (16) is
+    skipped.
+
+    @param  uid          UID of the card
+    @param  uidLen       Length of uid in bytes
+    @param  key          Key A of the NDEF sectors (PN532_NDEF_CLASSIC_KEY)
+    @param  firstSector  First NDEF sector, 1 after the MAD
+    @param  buff         Buffer receiving the data blocks
+    @param  size         Size of buff in bytes
+    @param  match        Picks the wanted record (NULL = first record)
+    @param  ctx          Passed to match
+    @param  record       Matching record, pointing into buff
+
+    @returns true if a record matched, false if none did, a sector failed
+             to authenticate or the record doesn't fit into buff
+*/
+/**************************************************************************/
+bool pn532_ndef_readClassic(pn532_t *obj, const uint8_t *uid, uint8_t uidLen, const uint8_t *key, uint8_t firstSector, uint8_t *buff, uint16_t size, pn532_ndef_match_t match, void *ctx, pn532_ndef_record_t *record)
+{
+    pn532_ndef_parser_t parser;
+    uint16_t got = 0;
+    uint8_t sector = firstSector;
+    uint8_t block = 0;   // Data block within sector
+
+    pn532_lock(obj);
+
+    pn532_ndef_init(&parser);
+    while (1)
+    {
+        switch (pn532_ndef_next(&parser, buff, got, record))
+        {
+        case PN532_NDEF_RECORD:
+            if (match == NULL || match(ctx, record))
+                PN532_UNLOCK_RETURN(obj, true);
+            continue;
+        case PN532_NDEF_MORE:
+            break;
+        default:
+            PN532_UNLOCK_RETURN(obj, false);
+        }
+
+        while (got < parser.need)
+        {
+            if (got + PN532_NDEF_BLOCK_SIZE > size || sector >= PN532_NDEF_CLASSIC_SECTORS)
+                PN532_UNLOCK_RETURN(obj, false);
+
+            uint8_t first = pn532_ndef_sectorFirstBlock(sector);
+            if (block == 0 && !pn532_mifareclassic_AuthenticateBlock(obj, (uint8_t *)uid, uidLen, first, 0, (uint8_t *)key))
+            {
+                PN532_DEBUG("NDEF: sector %d auth failed\n", sector);
+                PN532_UNLOCK_RETURN(obj, false);
+            }
+            if (!pn532_mifareclassic_ReadDataBlock(obj, first + block, buff + got))
+                PN532_UNLOCK_RETURN(obj, false);
+            got += PN532_NDEF_BLOCK_SIZE;
+
+            // the last block is the sector trailer
+            if (++block == pn532_ndef_sectorBlocks(sector) - 1)
+            {
+                block = 0;
+                sector++;
+                // NDEF data goes on behind the MAD2, as it does behind the MAD in sector 0
+                if (sector == PN532_NDEF_MAD2_SECTOR)
+                    sector++;
+            }
+        }
+    }
+}
+
+// Sectors 0-31 have 4 blocks, sectors 32-39 (4K) have 16
+static uint8_t pn532_ndef_sectorFirstBlock(uint8_t sector)
+{
+    return sector < 32 ? sector * 4 : 128 + (sector - 32) * 16;
+}
+
+static uint8_t pn532_ndef_sectorBlocks(uint8_t sector)
+{
+    return sector < 32 ? 4 : 16;
+}
@@ -0,0 +1,88 @@
+#ifndef __PN532_NDEF_H__
+#define __PN532_NDEF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pn532.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Incremental NDEF reader. The parser walks the TLV blocks and NDEF record
+ * headers of a tag's data area as it is read into one buffer; it keeps no
+ * copy of anything and hands out records as slices of that buffer. The tag
+ * readers fetch only as much as the parser asks for and stop at the first
+ * record that matches.
+ */
+
+// TLV types (NFC Forum Type 2 tag / MIFARE Classic mapping)
+#define PN532_NDEF_TLV_NULL         (0x00)
+#define PN532_NDEF_TLV_MESSAGE      (0x03)
+#define PN532_NDEF_TLV_TERMINATOR   (0xFE)
+
+// Record header flags
+#define PN532_NDEF_MB               (0x80)  // Message begin
+#define PN532_NDEF_ME               (0x40)  // Message end
+#define PN532_NDEF_CF               (0x20)  // Chunked record
+#define PN532_NDEF_SR               (0x10)  // Short record (1 byte payload length)
+#define PN532_NDEF_IL               (0x08)  // ID length present
+#define PN532_NDEF_TNF_MASK         (0x07)
+
+// Type name formats
+#define PN532_NDEF_TNF_EMPTY        (0x00)
+#define PN532_NDEF_TNF_WELL_KNOWN   (0x01)
+#define PN532_NDEF_TNF_MIME         (0x02)
+#define PN532_NDEF_TNF_URI          (0x03)
+#define PN532_NDEF_TNF_EXTERNAL     (0x04)
+
+// Capability container of a Type 2 tag (page 3)
+#define PN532_NDEF_CC_PAGE          (3)
+#define PN532_NDEF_CC_MAGIC         (0xE1)
+
+// Public key A of NFC Forum formatted MIFARE Classic sectors
+#define PN532_NDEF_CLASSIC_KEY      { 0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7 }
+
+typedef enum {
+    PN532_NDEF_MORE,     // Need more bytes, see need
+    PN532_NDEF_RECORD,   // A whole record is in the buffer
+    PN532_NDEF_END,      // Terminator TLV or end of the NDEF message
+    PN532_NDEF_ERROR,    // Malformed TLV or record
+} pn532_ndef_result_t;
+
+/**
+ * NDEF record, all pointers into the read buffer
+ */
+typedef struct {
+    uint8_t flags;           // PN532_NDEF_MB/ME/CF/SR/IL
+    uint8_t tnf;             // PN532_NDEF_TNF_*
+    const uint8_t *type;
+    uint8_t typeLen;
+    const uint8_t *id;
+    uint8_t idLen;
+    const uint8_t *payload;
+    uint32_t payloadLen;
+} pn532_ndef_record_t;
+
+typedef struct {
+    uint16_t pos;            // Next byte to parse
+    uint16_t msgEnd;         // End of the NDEF message TLV, 0 outside of it
+    uint16_t need;           // Bytes the buffer must hold to go on (PN532_NDEF_MORE)
+} pn532_ndef_parser_t;
+
+// Picks the record a tag reader stops at
+typedef bool (*pn532_ndef_match_t)(void *ctx, const pn532_ndef_record_t *record);
+
+void pn532_ndef_init(pn532_ndef_parser_t *parser);
+pn532_ndef_result_t pn532_ndef_next(pn532_ndef_parser_t *parser, const uint8_t *buff, uint16_t len, pn532_ndef_record_t *record);
+bool pn532_ndef_isType(const pn532_ndef_record_t *record, uint8_t tnf, const char *type);
+bool pn532_ndef_readNtag(pn532_t *obj, uint8_t *buff, uint16_t size, pn532_ndef_match_t match, void *ctx, pn532_ndef_record_t *record);
+bool pn532_ndef_readClassic(pn532_t *obj, const uint8_t *uid, uint8_t uidLen, const uint8_t *key, uint8_t firstSector, uint8_t *buff, uint16_t size, pn532_ndef_match_t match, void *ctx, pn532_ndef_record_t *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
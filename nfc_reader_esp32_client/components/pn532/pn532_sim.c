@@ -0,0 +1,727 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pn532_sim.h"
+
+// PN532 status codes reported for card exchanges
+#define SIM_STATUS_OK           (0x00)
+#define SIM_STATUS_TIMEOUT      (0x01)
+#define SIM_STATUS_AUTH_ERROR   (0x14)
+#define SIM_STATUS_WRONG_CTX    (0x27)
+
+// Largest data part of a chained ISO-DEP response, keeps normal frames
+#define SIM_ISODEP_CHUNK        (PN532_FRAME_NORMAL_MAX_LEN - 3)
+
+#define SIM_CLASSIC_SMALL_SECTORS (32)
+
+static void pn532_sim_select(void *ctx);
+static void pn532_sim_deselect(void *ctx);
+static void pn532_sim_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+static bool pn532_sim_ready(pn532_sim_t *sim);
+static void pn532_sim_startread(pn532_sim_t *sim);
+static void pn532_sim_command(pn532_sim_t *sim);
+static void pn532_sim_respond(pn532_sim_t *sim, const uint8_t *payload, uint16_t len, uint32_t cost);
+static bool pn532_sim_activate(pn532_sim_t *sim, bool final);
+static uint8_t pn532_sim_list(pn532_sim_t *sim, uint8_t maxTg, const uint8_t *uid, uint8_t uidLen, bool autopoll, uint8_t *out, uint16_t *outLen, uint32_t *cost);
+static void pn532_sim_exchange(pn532_sim_t *sim, const uint8_t *data, uint16_t len, uint8_t *out, uint16_t *outLen, uint32_t *cost);
+static void pn532_sim_thru(pn532_sim_t *sim, const uint8_t *data, uint16_t len, uint8_t *out, uint16_t *outLen, uint32_t *cost);
+static uint8_t pn532_sim_classic(pn532_sim_card_t *card, const uint8_t *d, uint16_t n, uint8_t *out, uint16_t *outLen);
+static uint8_t pn532_sim_ntag(pn532_sim_card_t *card, const uint8_t *d, uint16_t n, uint8_t *out, uint16_t *outLen);
+static uint8_t pn532_sim_isodep(pn532_sim_t *sim, pn532_sim_card_t *card, bool more, const uint8_t *d, uint16_t n, uint8_t *out, uint16_t *outLen);
+static uint16_t pn532_sim_apdu(pn532_sim_card_t *card, const uint8_t *c, uint16_t n, uint8_t *r);
+static pn532_sim_card_t *pn532_sim_target(pn532_sim_t *sim, uint8_t tg);
+static uint16_t pn532_sim_sector(uint16_t block, uint16_t *trailer);
+
+static const pn532_transport_t pn532_sim_transport = {
+    .select = pn532_sim_select,
+    .deselect = pn532_sim_deselect,
+    .transfer = pn532_sim_transfer,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Puts a simulated PN532 behind the device descriptor
+
+    @param  sim       Simulator state
+    @param  timing    Timing model (NULL = PN532_SIM_TIMING_DEFAULT)
+*/
+/**************************************************************************/
+void pn532_sim_init(pn532_t *obj, pn532_sim_t *sim, const pn532_sim_timing_t *timing)
+{
+    static const pn532_sim_timing_t defaults = PN532_SIM_TIMING_DEFAULT;
+
+    memset(sim, 0, sizeof(*sim));
+    sim->timing = timing != NULL ? *timing : defaults;
+    sim->activationRetries = PN532_RF_RETRY_FOREVER;
+    pn532_frame_encode_ack(sim->_ack, sizeof(sim->_ack));
+    pn532_transport_init(obj, &pn532_sim_transport, sim);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sets up a virtual card with blank (transport) contents
+
+    Classic sector trailers get key A = key B = FF FF FF FF FF FF, NTAG
+    pages 0..3 get the UID and a capability container.
+
+    @param  card        Card to set up
+    @param  type        Card type
+    @param  uid         UID (4 or 7 bytes, NTAG always 7)
+    @param  uidLen      Length of uid in bytes
+    @param  memory      Card memory: 1024 (1K) or 4096 (4K) bytes for a
+                        Classic, 180/540/924 bytes for NTAG213/215/216,
+                        the file contents for ISO-DEP
+    @param  memorySize  Size of memory in bytes
+*/
+/**************************************************************************/
+void pn532_sim_card_init(pn532_sim_card_t *card, pn532_sim_card_type_t type, const uint8_t *uid, uint8_t uidLen, uint8_t *memory, uint16_t memorySize)
+{
+    static const uint8_t trailer[16] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x80, 0x69, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t ats[] = {0x06, 0x77, 0x77, 0x81, 0x02, 0x80};
+
+    memset(card, 0, sizeof(*card));
+    card->type = type;
+    card->uidLen = uidLen > sizeof(card->uid) ? sizeof(card->uid) : uidLen;
+    memcpy(card->uid, uid, card->uidLen);
+    card->memory = memory;
+    card->memorySize = memorySize;
+    card->_authSector = -1;
+
+    switch (type)
+    {
+    case PN532_SIM_CLASSIC_1K:
+    case PN532_SIM_CLASSIC_4K:
+        card->atqa = type == PN532_SIM_CLASSIC_1K ? 0x0004 : 0x0002;
+        card->sak = type == PN532_SIM_CLASSIC_1K ? 0x08 : 0x18;
+        if (card->uidLen == 7)
+            card->atqa |= 0x0040;
+        memset(memory, 0, memorySize);
+        for (uint16_t block = 0; block * 16 < memorySize; block++)
+        {
+            uint16_t last;
+            pn532_sim_sector(block, &last);
+            if (block == last)
+                memcpy(memory + block * 16, trailer, sizeof(trailer));
+        }
+        memcpy(memory, card->uid, card->uidLen);
+        break;
+    case PN532_SIM_NTAG213:
+    case PN532_SIM_NTAG215:
+    case PN532_SIM_NTAG216:
+        card->atqa = 0x0044;
+        card->sak = 0x00;
+        memset(memory, 0, memorySize);
+        // UID with its check bytes in pages 0..2, capability container in page 3
+        memcpy(memory, card->uid, 3);
+        memory[3] = 0x88 ^ card->uid[0] ^ card->uid[1] ^ card->uid[2];
+        memcpy(memory + 4, card->uid + 3, 4);
+        memory[8] = card->uid[3] ^ card->uid[4] ^ card->uid[5] ^ card->uid[6];
+        memory[12] = 0xE1;
+        memory[13] = 0x10;
+        memory[14] = (memorySize - 16) / 8;
+        break;
+    case PN532_SIM_ISODEP:
+        card->atqa = card->uidLen == 7 ? 0x0344 : 0x0304;
+        card->sak = 0x20;
+        memcpy(card->ats, ats, sizeof(ats));
+        card->atsLen = sizeof(ats);
+        break;
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Brings a card into the field
+
+    @returns false if the field is full
+*/
+/**************************************************************************/
+bool pn532_sim_present(pn532_sim_t *sim, pn532_sim_card_t *card)
+{
+    for (int i = 0; i < PN532_SIM_FIELD_MAX; i++)
+    {
+        if (sim->field[i] == card)
+            return true;
+    }
+    for (int i = 0; i < PN532_SIM_FIELD_MAX; i++)
+    {
+        if (sim->field[i] == NULL)
+        {
+            card->_active = false;
+            card->_authSector = -1;
+            card->_appSelected = false;
+            sim->field[i] = card;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Takes a card out of the field, exchanges with it time out
+*/
+/**************************************************************************/
+void pn532_sim_remove(pn532_sim_t *sim, pn532_sim_card_t *card)
+{
+    for (int i = 0; i < PN532_SIM_FIELD_MAX; i++)
+    {
+        if (sim->field[i] == card)
+            sim->field[i] = NULL;
+    }
+    card->_active = false;
+}
+
+static void pn532_sim_select(void *ctx)
+{
+    pn532_sim_t *sim = (pn532_sim_t *)ctx;
+
+    // SS low wakes the chip from PowerDown
+    sim->poweredDown = false;
+    sim->_opSeen = false;
+    sim->_inLen = 0;
+    sim->_out = NULL;
+}
+
+static void pn532_sim_deselect(void *ctx)
+{
+    pn532_sim_t *sim = (pn532_sim_t *)ctx;
+
+    if (!sim->_opSeen)
+        return;
+
+    if (sim->_op == PN532_SPI_DATAWRITE)
+    {
+        pn532_sim_command(sim);
+    }
+    else if (sim->_op == PN532_SPI_DATAREAD && sim->_outPos > 0)
+    {
+        // whatever was started is consumed, like on the chip
+        if (sim->_out == sim->_ack)
+            sim->_ackPending = false;
+        else if (sim->_out == sim->_response)
+            sim->_responsePending = false;
+    }
+}
+
+static void pn532_sim_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    pn532_sim_t *sim = (pn532_sim_t *)ctx;
+
+#ifdef PN532_VIRTUAL_CLOCK
+    pn532_time_advance((uint32_t)((uint64_t)len * 8 * 1000000 / sim->timing.spiHz));
+#endif
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!sim->_opSeen)
+        {
+            sim->_op = tx != NULL ? tx[i] : 0;
+            sim->_opSeen = true;
+            if (sim->_op == PN532_SPI_DATAREAD)
+                pn532_sim_startread(sim);
+            continue;
+        }
+
+        switch (sim->_op)
+        {
+        case PN532_SPI_DATAWRITE:
+            if (tx != NULL && sim->_inLen < sizeof(sim->_in))
+                sim->_in[sim->_inLen++] = tx[i];
+            break;
+        case PN532_SPI_STATREAD:
+            if (rx != NULL)
+                rx[i] = pn532_sim_ready(sim) ? PN532_SPI_READY : 0x00;
+            break;
+        case PN532_SPI_DATAREAD:
+            if (rx != NULL)
+                rx[i] = sim->_outPos < sim->_outLen ? sim->_out[sim->_outPos++] : 0x00;
+            break;
+        default:
+            if (rx != NULL)
+                rx[i] = 0x00;
+            break;
+        }
+    }
+}
+
+static bool pn532_sim_ready(pn532_sim_t *sim)
+{
+    if (sim->_waiting)
+        pn532_sim_activate(sim, pn532_deadline_passed(sim->_waitUntil));
+
+    return sim->_ackPending || (sim->_responsePending && pn532_time_now() >= sim->_readyAt);
+}
+
+static void pn532_sim_startread(pn532_sim_t *sim)
+{
+    sim->_outPos = 0;
+    sim->_outLen = 0;
+    if (sim->_ackPending)
+    {
+        sim->_out = sim->_ack;
+        sim->_outLen = sizeof(sim->_ack);
+    }
+    else if (pn532_sim_ready(sim))
+    {
+        sim->_out = sim->_response;
+        sim->_outLen = sim->_responseLen;
+    }
+}
+
+// Handles a frame written by the host
+static void pn532_sim_command(pn532_sim_t *sim)
+{
+    pn532_frame_view_t view;
+    uint8_t out[PN532_FRAME_MAX_LEN];
+    uint16_t outLen = 0;
+    uint32_t cost = sim->timing.processUs;
+
+    if (pn532_frame_decode(sim->_in, sim->_inLen, &view) != PN532_FRAME_OK)
+        return;
+
+    // an ACK from the host aborts the running command
+    if (view.kind == PN532_FRAME_ACK)
+    {
+        sim->_ackPending = false;
+        sim->_responsePending = false;
+        sim->_waiting = false;
+        return;
+    }
+    if (view.kind != PN532_FRAME_INFO || view.tfi != PN532_HOSTTOPN532 || view.dataLen == 0)
+        return;
+
+    const uint8_t *d = view.data + 1;
+    uint16_t n = view.dataLen - 1;
+
+    sim->commands++;
+    sim->_cmd = view.data[0];
+    sim->_ackPending = true;
+    sim->_responsePending = false;
+    sim->_waiting = false;
+
+    switch (view.data[0])
+    {
+    case PN532_COMMAND_GETFIRMWAREVERSION:
+        out[outLen++] = 0x32;
+        out[outLen++] = 0x01;
+        out[outLen++] = 0x06;
+        out[outLen++] = 0x07;
+        break;
+    case PN532_COMMAND_GETGENERALSTATUS:
+        out[outLen++] = 0x00;
+        out[outLen++] = sim->rfOn;
+        out[outLen++] = sim->targetCount;
+        out[outLen++] = 0x00;
+        break;
+    case PN532_COMMAND_READREGISTER:
+        while (outLen < n / 2)
+            out[outLen++] = 0x00;
+        break;
+    case PN532_COMMAND_POWERDOWN:
+        out[outLen++] = SIM_STATUS_OK;
+        sim->poweredDown = true;
+        break;
+    case PN532_COMMAND_RFCONFIGURATION:
+        if (n >= 2 && d[0] == PN532_RFCFG_FIELD)
+        {
+            sim->rfOn = d[1] & PN532_RF_FIELD_ON;
+            // cards lose power with the field
+            for (int i = 0; !sim->rfOn && i < sim->targetCount; i++)
+                sim->targets[i]->_active = false;
+        }
+        if (n >= 4 && d[0] == PN532_RFCFG_MAXRETRIES)
+            sim->activationRetries = d[3];
+        break;
+    case PN532_COMMAND_INLISTPASSIVETARGET:
+    case PN532_COMMAND_INAUTOPOLL:
+        // answered once cards are found or the retries run out
+        memcpy(sim->_request, view.data, view.dataLen);
+        sim->_requestLen = view.dataLen;
+        sim->_waiting = true;
+        sim->_waitUntil = PN532_TIME_FOREVER;
+        if (view.data[0] == PN532_COMMAND_INLISTPASSIVETARGET && sim->activationRetries != PN532_RF_RETRY_FOREVER)
+            sim->_waitUntil = pn532_time_now() + (int64_t)(sim->activationRetries + 1) * sim->timing.activationUs;
+        if (view.data[0] == PN532_COMMAND_INAUTOPOLL && n >= 3 && d[0] != PN532_AUTOPOLL_ENDLESS)
+            sim->_waitUntil = pn532_time_now() + (int64_t)d[0] * (n - 2) * d[1] * 150000;
+        pn532_sim_activate(sim, false);
+        return;
+    case PN532_COMMAND_INDATAEXCHANGE:
+        pn532_sim_exchange(sim, d, n, out, &outLen, &cost);
+        break;
+    case PN532_COMMAND_INCOMMUNICATETHRU:
+        pn532_sim_thru(sim, d, n, out, &outLen, &cost);
+        break;
+    case PN532_COMMAND_INSELECT:
+        if (n >= 1 && pn532_sim_target(sim, d[0]) != NULL)
+        {
+            sim->current = d[0];
+            out[outLen++] = SIM_STATUS_OK;
+        }
+        else
+        {
+            out[outLen++] = SIM_STATUS_WRONG_CTX;
+        }
+        break;
+    case PN532_COMMAND_INDESELECT:
+    case PN532_COMMAND_INRELEASE:
+        sim->targetCount = 0;
+        sim->current = 0;
+        out[outLen++] = SIM_STATUS_OK;
+        break;
+    case PN532_COMMAND_INPSL:
+        if (n >= 3 && pn532_sim_target(sim, d[0]) != NULL)
+        {
+            sim->rate[d[0] - 1] = d[1] < d[2] ? d[1] : d[2];
+            out[outLen++] = SIM_STATUS_OK;
+        }
+        else
+        {
+            out[outLen++] = SIM_STATUS_WRONG_CTX;
+        }
+        break;
+    default:
+        // SAMConfiguration, SetParameters, WriteRegister, ...: nothing to model
+        break;
+    }
+
+    pn532_sim_respond(sim, out, outLen, cost);
+}
+
+// Prepares the response frame, ready cost us from now
+static void pn532_sim_respond(pn532_sim_t *sim, const uint8_t *payload, uint16_t len, uint32_t cost)
+{
+    uint8_t data[PN532_FRAME_MAX_LEN];
+
+    data[0] = sim->_cmd + 1;
+    memcpy(data + 1, payload, len);
+    sim->_responseLen = pn532_frame_encode(sim->_response, sizeof(sim->_response), PN532_PN532TOHOST, data, len + 1);
+    sim->_responsePending = true;
+    sim->_readyAt = pn532_time_now() + cost;
+}
+
+// Answers a waiting InListPassiveTarget/InAutoPoll if cards are there or final
+static bool pn532_sim_activate(pn532_sim_t *sim, bool final)
+{
+    uint8_t out[PN532_FRAME_MAX_LEN];
+    uint16_t outLen = 0;
+    uint32_t cost = sim->timing.processUs;
+    const uint8_t *d = sim->_request + 1;
+    uint16_t n = sim->_requestLen - 1;
+    uint8_t found;
+
+    if (sim->_request[0] == PN532_COMMAND_INLISTPASSIVETARGET)
+    {
+        if (n < 2 || d[1] != PN532_MIFARE_ISO14443A)
+            final = true;
+        // initiator data: UID of the one card to activate, with cascade tag
+        const uint8_t *uid = n > 2 ? d + 2 : NULL;
+        uint8_t uidLen = n > 2 ? n - 2 : 0;
+        if (uidLen == 8 && uid[0] == 0x88)
+        {
+            uid++;
+            uidLen--;
+        }
+        found = pn532_sim_list(sim, d[0], uid, uidLen, false, out, &outLen, &cost);
+    }
+    else
+    {
+        found = pn532_sim_list(sim, PN532_MAX_TARGETS, NULL, 0, true, out, &outLen, &cost);
+    }
+
+    if (!found && !final)
+        return false;
+
+    sim->_waiting = false;
+    pn532_sim_respond(sim, out, found ? outLen : 1, cost);
+    return true;
+}
+
+// Activates up to maxTg cards in the field, writes NbTg and the target data
+static uint8_t pn532_sim_list(pn532_sim_t *sim, uint8_t maxTg, const uint8_t *uid, uint8_t uidLen, bool autopoll, uint8_t *out, uint16_t *outLen, uint32_t *cost)
+{
+    uint16_t len = 1;
+    uint8_t found = 0;
+
+    if (maxTg > PN532_MAX_TARGETS)
+        maxTg = PN532_MAX_TARGETS;
+
+    // earlier targets are released
+    sim->targetCount = 0;
+    sim->rfOn = true;
+    out[0] = 0;
+
+    for (int i = 0; i < PN532_SIM_FIELD_MAX && found < maxTg; i++)
+    {
+        pn532_sim_card_t *card = sim->field[i];
+        if (card == NULL || (uid != NULL && (uidLen != card->uidLen || memcmp(uid, card->uid, uidLen) != 0)))
+            continue;
+
+        bool isodep = card->sak & 0x20;
+        uint16_t start = len;
+        if (autopoll)
+            len += 2; // type, length
+
+        out[len++] = found + 1;
+        out[len++] = card->atqa >> 8;
+        out[len++] = card->atqa & 0xFF;
+        out[len++] = card->sak;
+        out[len++] = card->uidLen;
+        memcpy(out + len, card->uid, card->uidLen);
+        len += card->uidLen;
+        if (isodep)
+        {
+            memcpy(out + len, card->ats, card->atsLen);
+            len += card->atsLen;
+            *cost += sim->timing.ratsUs;
+        }
+        if (autopoll)
+        {
+            out[start] = isodep ? PN532_AUTOPOLL_ISO14443_4A : PN532_AUTOPOLL_MIFARE;
+            out[start + 1] = len - start - 2;
+        }
+
+        card->_active = true;
+        card->_authSector = -1;
+        card->_appSelected = false;
+        sim->targets[found] = card;
+        sim->rate[found] = PN532_BAUD_106;
+        *cost += sim->timing.activationUs;
+        found++;
+    }
+
+    sim->targetCount = found;
+    sim->current = found ? 1 : 0;
+    out[0] = found;
+    *outLen = len;
+    return found;
+}
+
+static void pn532_sim_exchange(pn532_sim_t *sim, const uint8_t *data, uint16_t len, uint8_t *out, uint16_t *outLen, uint32_t *cost)
+{
+    pn532_sim_card_t *card = len >= 1 ? pn532_sim_target(sim, data[0] & 0x3F) : NULL;
+    uint16_t n = 0;
+
+    if (card == NULL || !card->_active)
+    {
+        out[(*outLen)++] = card == NULL ? SIM_STATUS_WRONG_CTX : SIM_STATUS_TIMEOUT;
+        if (card != NULL)
+            *cost += sim->timing.rfTimeoutUs;
+        return;
+    }
+
+    uint8_t tg = data[0] & 0x3F;
+    const uint8_t *d = data + 1;
+    uint16_t dn = len - 1;
+    uint8_t status;
+
+    sim->current = tg;
+    if (card->type == PN532_SIM_ISODEP)
+        status = pn532_sim_isodep(sim, card, data[0] & PN532_TG_MI, d, dn, out + 1, &n);
+    else if (card->type == PN532_SIM_CLASSIC_1K || card->type == PN532_SIM_CLASSIC_4K)
+        status = pn532_sim_classic(card, d, dn, out + 1, &n);
+    else
+        status = pn532_sim_ntag(card, d, dn, out + 1, &n);
+
+    out[0] = status;
+    *outLen = 1 + n;
+
+    // RF time: bytes both ways at the target's bit rate, plus the frame delay
+    *cost += sim->timing.exchangeUs + (uint32_t)(dn + n) * sim->timing.byteUs / (1 << sim->rate[tg - 1]);
+    if (dn > 0 && (d[0] == MIFARE_CMD_AUTH_A || d[0] == MIFARE_CMD_AUTH_B) && card->type != PN532_SIM_ISODEP)
+        *cost += sim->timing.exchangeUs; // three pass authentication
+    if (status == SIM_STATUS_TIMEOUT || status == SIM_STATUS_AUTH_ERROR)
+        *cost += sim->timing.rfTimeoutUs;
+}
+
+static void pn532_sim_thru(pn532_sim_t *sim, const uint8_t *data, uint16_t len, uint8_t *out, uint16_t *outLen, uint32_t *cost)
+{
+    pn532_sim_card_t *card = pn532_sim_target(sim, sim->current);
+    uint16_t n = 0;
+
+    if (card == NULL || !card->_active || card->type == PN532_SIM_ISODEP ||
+        card->type == PN532_SIM_CLASSIC_1K || card->type == PN532_SIM_CLASSIC_4K)
+    {
+        out[(*outLen)++] = SIM_STATUS_TIMEOUT;
+        *cost += sim->timing.rfTimeoutUs;
+        return;
+    }
+
+    out[0] = pn532_sim_ntag(card, data, len, out + 1, &n);
+    *outLen = 1 + n;
+    *cost += sim->timing.exchangeUs + (uint32_t)(len + n) * sim->timing.byteUs;
+}
+
+static uint8_t pn532_sim_classic(pn532_sim_card_t *card, const uint8_t *d, uint16_t n, uint8_t *out, uint16_t *outLen)
+{
+    uint16_t blocks = card->memorySize / 16;
+    uint16_t trailer;
+
+    if (n < 2 || d[1] >= blocks)
+        return SIM_STATUS_TIMEOUT;
+
+    uint16_t sector = pn532_sim_sector(d[1], &trailer);
+    uint8_t *mem = card->memory;
+
+    switch (d[0])
+    {
+    case MIFARE_CMD_AUTH_A:
+    case MIFARE_CMD_AUTH_B:
+        if (n >= 8 && memcmp(d + 2, mem + trailer * 16 + (d[0] == MIFARE_CMD_AUTH_A ? 0 : 10), 6) == 0)
+        {
+            card->_authSector = sector;
+            return SIM_STATUS_OK;
+        }
+        // the card drops out and has to be activated again
+        card->_authSector = -1;
+        card->_active = false;
+        return SIM_STATUS_AUTH_ERROR;
+    case MIFARE_CMD_READ:
+        if (card->_authSector != sector)
+            return SIM_STATUS_AUTH_ERROR;
+        memcpy(out, mem + d[1] * 16, 16);
+        // key A never reads back
+        if (d[1] == trailer)
+            memset(out, 0, 6);
+        *outLen = 16;
+        return SIM_STATUS_OK;
+    case MIFARE_CMD_WRITE:
+        if (card->_authSector != sector || n < 18 || d[1] == 0)
+            return SIM_STATUS_AUTH_ERROR;
+        memcpy(mem + d[1] * 16, d + 2, 16);
+        return SIM_STATUS_OK;
+    default:
+        return SIM_STATUS_TIMEOUT;
+    }
+}
+
+static uint8_t pn532_sim_ntag(pn532_sim_card_t *card, const uint8_t *d, uint16_t n, uint8_t *out, uint16_t *outLen)
+{
+    static const uint8_t storage[] = {0x0F, 0x11, 0x13}; // NTAG213/215/216
+    uint16_t pages = card->memorySize / 4;
+
+    if (n < 1)
+        return SIM_STATUS_TIMEOUT;
+
+    switch (d[0])
+    {
+    case 0x60: // GET_VERSION
+        out[0] = 0x00;
+        out[1] = 0x04;
+        out[2] = 0x04;
+        out[3] = 0x02;
+        out[4] = 0x01;
+        out[5] = 0x00;
+        out[6] = storage[card->type - PN532_SIM_NTAG213];
+        out[7] = 0x03;
+        *outLen = 8;
+        return SIM_STATUS_OK;
+    case MIFARE_CMD_READ:
+        if (n < 2 || d[1] >= pages)
+            return SIM_STATUS_TIMEOUT;
+        // four pages, rolling over to page 0
+        for (int i = 0; i < 16; i++)
+            out[i] = card->memory[((d[1] + i / 4) % pages) * 4 + i % 4];
+        *outLen = 16;
+        return SIM_STATUS_OK;
+    case NTAG_CMD_FAST_READ:
+        if (n < 3 || d[1] > d[2] || d[2] >= pages)
+            return SIM_STATUS_TIMEOUT;
+        *outLen = (d[2] - d[1] + 1) * 4;
+        memcpy(out, card->memory + d[1] * 4, *outLen);
+        return SIM_STATUS_OK;
+    case MIFARE_ULTRALIGHT_CMD_WRITE:
+        if (n < 6 || d[1] < 4 || d[1] >= pages)
+            return SIM_STATUS_TIMEOUT;
+        memcpy(card->memory + d[1] * 4, d + 2, 4);
+        return SIM_STATUS_OK;
+    default:
+        return SIM_STATUS_TIMEOUT;
+    }
+}
+
+// ISO-DEP block exchange with command and response chaining
+static uint8_t pn532_sim_isodep(pn532_sim_t *sim, pn532_sim_card_t *card, bool more, const uint8_t *d, uint16_t n, uint8_t *out, uint16_t *outLen)
+{
+    uint8_t status = SIM_STATUS_OK;
+
+    // an empty exchange fetches the next part of a chained response
+    if (n == 0 && !more && sim->_rapduPos < sim->_rapduLen)
+        goto chunk;
+
+    if (sim->_capduLen + n > sizeof(sim->_capdu))
+        return SIM_STATUS_TIMEOUT;
+    memcpy(sim->_capdu + sim->_capduLen, d, n);
+    sim->_capduLen += n;
+    if (more)
+        return SIM_STATUS_OK;
+
+    sim->_rapduLen = pn532_sim_apdu(card, sim->_capdu, sim->_capduLen, sim->_rapdu);
+    sim->_rapduPos = 0;
+    sim->_capduLen = 0;
+
+chunk:
+    *outLen = sim->_rapduLen - sim->_rapduPos;
+    if (*outLen > SIM_ISODEP_CHUNK)
+    {
+        *outLen = SIM_ISODEP_CHUNK;
+        status |= PN532_STATUS_MI;
+    }
+    memcpy(out, sim->_rapdu + sim->_rapduPos, *outLen);
+    sim->_rapduPos += *outLen;
+    return status;
+}
+
+// SELECT by AID and READ BINARY on the card's file, returns the R-APDU length
+static uint16_t pn532_sim_apdu(pn532_sim_card_t *card, const uint8_t *c, uint16_t n, uint8_t *r)
+{
+    uint16_t sw = 0x6D00;
+    uint16_t len = 0;
+
+    if (n >= 5 && c[1] == 0xA4 && c[2] == 0x04)
+    {
+        card->_appSelected = c[4] == card->aidLen && n >= 5 + c[4] && memcmp(c + 5, card->aid, card->aidLen) == 0;
+        sw = card->_appSelected ? PN532_SW_OK : 0x6A82;
+    }
+    else if (n >= 4 && c[1] == 0xB0)
+    {
+        uint16_t offset = (c[2] << 8) | c[3];
+        uint16_t le = (n >= 5 && c[4]) ? c[4] : 256;
+
+        if (!card->_appSelected)
+            sw = 0x6985;
+        else if (offset > card->memorySize)
+            sw = 0x6B00;
+        else
+        {
+            len = card->memorySize - offset < le ? card->memorySize - offset : le;
+            memcpy(r, card->memory + offset, len);
+            sw = PN532_SW_OK;
+        }
+    }
+
+    r[len++] = sw >> 8;
+    r[len++] = sw & 0xFF;
+    return len;
+}
+
+static pn532_sim_card_t *pn532_sim_target(pn532_sim_t *sim, uint8_t tg)
+{
+    if (tg == 0 || tg > sim->targetCount)
+        return NULL;
+    return sim->targets[tg - 1];
+}
+
+// Sector of a Classic block and the block number of its trailer
+static uint16_t pn532_sim_sector(uint16_t block, uint16_t *trailer)
+{
+    if (block < SIM_CLASSIC_SMALL_SECTORS * 4)
+    {
+        *trailer = block | 3;
+        return block / 4;
+    }
+    *trailer = block | 15;
+    return SIM_CLASSIC_SMALL_SECTORS + (block - SIM_CLASSIC_SMALL_SECTORS * 4) / 16;
+}
@@ -0,0 +1,125 @@
+#ifndef __PN532_SIM_H__
+#define __PN532_SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pn532.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Simulated PN532 behind the transport interface. It answers the SPI
+ * protocol (status, ACK, frames) and the reader commands the driver uses
+ * for virtual cards in its field: MIFARE Classic 1K/4K, NTAG21x and an
+ * ISO-DEP card with one application holding a binary file.
+ *
+ * Responses become ready after the time the real chip would need (command
+ * processing, card activation, RF exchange), so callers waiting on the
+ * status byte see realistic latencies. Built with PN532_VIRTUAL_CLOCK the
+ * SPI transfer times are added to the virtual clock as well.
+ */
+
+#define PN532_SIM_FIELD_MAX     (4)     // Cards that can be in the field at once
+#define PN532_SIM_APDU_MAX      (512)   // Longest chained C-APDU/R-APDU
+
+typedef enum {
+    PN532_SIM_CLASSIC_1K,
+    PN532_SIM_CLASSIC_4K,
+    PN532_SIM_NTAG213,
+    PN532_SIM_NTAG215,
+    PN532_SIM_NTAG216,
+    PN532_SIM_ISODEP,
+} pn532_sim_card_type_t;
+
+typedef struct {
+    pn532_sim_card_type_t type;
+    uint8_t uid[7];
+    uint8_t uidLen;
+    uint16_t atqa;
+    uint8_t sak;
+    uint8_t ats[PN532_ATS_MAX];  // ISO-DEP only, starting with TL
+    uint8_t atsLen;
+    uint8_t *memory;             // Classic: 16 bytes per block, NTAG: 4 bytes per page, ISO-DEP: the file
+    uint16_t memorySize;
+    const uint8_t *aid;          // ISO-DEP application holding the file
+    uint8_t aidLen;
+
+    bool _active;                // Answers exchanges (activated and not dropped out)
+    int16_t _authSector;         // Classic sector authenticated, -1 for none
+    bool _appSelected;           // ISO-DEP application selected
+} pn532_sim_card_t;
+
+typedef struct {
+    uint32_t spiHz;          // SPI clock
+    uint32_t processUs;      // Firmware time per command
+    uint32_t activationUs;   // REQA to SAK of one card
+    uint32_t ratsUs;         // RATS/ATS of an ISO-DEP card
+    uint32_t exchangeUs;     // Fixed cost of a card exchange (frame delay time)
+    uint32_t byteUs;         // RF time per byte at 106 kbps
+    uint32_t rfTimeoutUs;    // Card response timeout
+} pn532_sim_timing_t;
+
+// Typical PN532 at 1 MHz SPI with cards at 106 kbps
+#define PN532_SIM_TIMING_DEFAULT { \
+    .spiHz = 1000000,              \
+    .processUs = 300,              \
+    .activationUs = 2500,          \
+    .ratsUs = 1500,                \
+    .exchangeUs = 400,             \
+    .byteUs = 85,                  \
+    .rfTimeoutUs = 51200,          \
+}
+
+typedef struct {
+    pn532_sim_timing_t timing;
+    pn532_sim_card_t *field[PN532_SIM_FIELD_MAX];    // Cards in the field
+    pn532_sim_card_t *targets[PN532_MAX_TARGETS];    // Activated cards, Tg = index + 1
+    uint8_t targetCount;
+    uint8_t current;                                 // Tg of the selected target
+    uint8_t rate[PN532_MAX_TARGETS];                 // Bit rate after InPSL (PN532_BAUD_*)
+    uint8_t activationRetries;                       // MxRtyPassiveActivation
+    bool rfOn;
+    bool poweredDown;
+    uint32_t commands;                               // Commands processed
+
+    // SPI side
+    uint8_t _op;                                     // Operation byte of the SS low period
+    bool _opSeen;
+    uint8_t _in[PN532_FRAME_MAX_SIZE];               // Frame being written
+    uint16_t _inLen;
+    const uint8_t *_out;                             // Bytes being read
+    uint16_t _outLen;
+    uint16_t _outPos;
+    bool _ackPending;
+    bool _responsePending;
+    int64_t _readyAt;
+    uint8_t _request[PN532_FRAME_MAX_SIZE];          // Command waiting for a card
+    uint16_t _requestLen;
+    bool _waiting;
+    int64_t _waitUntil;
+    uint8_t _response[PN532_FRAME_MAX_SIZE];
+    uint16_t _responseLen;
+    uint8_t _ack[6];
+    uint8_t _cmd;                                    // Command being answered
+
+    // ISO-DEP chaining
+    uint8_t _capdu[PN532_SIM_APDU_MAX];
+    uint16_t _capduLen;
+    uint8_t _rapdu[PN532_SIM_APDU_MAX];
+    uint16_t _rapduLen;
+    uint16_t _rapduPos;
+} pn532_sim_t;
+
+void pn532_sim_init(pn532_t *obj, pn532_sim_t *sim, const pn532_sim_timing_t *timing);
+void pn532_sim_card_init(pn532_sim_card_t *card, pn532_sim_card_type_t type, const uint8_t *uid, uint8_t uidLen, uint8_t *memory, uint16_t memorySize);
+bool pn532_sim_present(pn532_sim_t *sim, pn532_sim_card_t *card);
+void pn532_sim_remove(pn532_sim_t *sim, pn532_sim_card_t *card);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
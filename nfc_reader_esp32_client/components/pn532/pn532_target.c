@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "pn532.h"
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_UNLOCK_RETURN(obj, ret) \
+    do                                \
+    {                                 \
+        pn532_unlock(obj);            \
+        return ret;                   \
+    } while (0)
+
+/*
+ * Target mode: the PN532 answers an initiator (e.g. a phone) as a card or
+ * NFC-DEP peer. TgInitAsTarget waits for the activation, then every
+ * command of the initiator is fetched with TgGetData and answered with
+ * TgSetData. Responses are read into caller buffers, so a session doesn't
+ * copy the exchanged data through _packetbuffer.
+ */
+
+#define PN532_TG_DEFAULT_TIMEOUT (1000)
+
+// Descriptor pn532_AsTarget has always announced
+static const uint8_t pn532_tg_legacyGt[] = {0x00};
+static const uint8_t pn532_tg_legacyTk[] = {'R', 'F', 'I', 'D', 'I', 'O', 't', ' ', 'P', 'N', '5', '3', '2'};
+static const pn532_tg_config_t pn532_tg_legacy = {
+    .mode = 0x00,
+    .sensRes = 0x0800,
+    .nfcid1 = {0xdc, 0x44, 0x20},
+    .selRes = 0x60,
+    .felica = {0x01, 0xfe, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,    // NFCID2t
+               0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,    // PAD
+               0xff, 0xff},                                       // system code
+    .nfcid3 = {0xaa, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11},
+    .generalBytes = pn532_tg_legacyGt,
+    .generalBytesLen = sizeof(pn532_tg_legacyGt),
+    .historicalBytes = pn532_tg_legacyTk,
+    .historicalBytesLen = sizeof(pn532_tg_legacyTk),
+};
+
+/**************************************************************************/
+/*!
+    @brief  Configures the PN532 as target and waits for an initiator to
+            activate it (TgInitAsTarget)
+
+    @param  config           NFCID, SEL_RES, ATR_RES general bytes and ATS
+                             historical bytes to announce
+    @param  buff             Buffer receiving the response
+    @param  size             Size of buff in bytes
+    @param  mode             Mode the PN532 was activated in (baud rate,
+                             ISO14443-4 PICC, DEP)
+    @param  initiatorCmd     First command of the initiator (RATS or
+                             ATR_REQ), points into buff; may be NULL
+    @param  initiatorCmdLen  Length of initiatorCmd in bytes; may be NULL
+    @param  timeout          Time in ms to wait for an initiator (0 = forever)
+
+    @returns true once activated, false on a bad config, a timeout or if
+             the response doesn't fit into buff
+*/
+/**************************************************************************/
+bool pn532_tgInitAsTarget(pn532_t *obj, const pn532_tg_config_t *config, uint8_t *buff, uint16_t size, uint8_t *mode, const uint8_t **initiatorCmd, uint16_t *initiatorCmdLen, uint16_t timeout)
+{
+    if (config->generalBytesLen > PN532_TG_GT_MAX || config->historicalBytesLen > PN532_TG_TK_MAX)
+        return false;
+
+    pn532_lock(obj);
+
+    uint8_t *cmd = obj->_packetbuffer;
+    uint16_t n = 0;
+
+    cmd[n++] = PN532_COMMAND_TGINITASTARGET;
+    cmd[n++] = config->mode;
+    cmd[n++] = config->sensRes >> 8;   // same byte order as InListPassiveTarget reports
+    cmd[n++] = config->sensRes & 0xFF;
+    memcpy(cmd + n, config->nfcid1, sizeof(config->nfcid1));
+    n += sizeof(config->nfcid1);
+    cmd[n++] = config->selRes;
+    memcpy(cmd + n, config->felica, sizeof(config->felica));
+    n += sizeof(config->felica);
+    memcpy(cmd + n, config->nfcid3, sizeof(config->nfcid3));
+    n += sizeof(config->nfcid3);
+    cmd[n++] = config->generalBytesLen;
+    if (config->generalBytesLen)
+        memcpy(cmd + n, config->generalBytes, config->generalBytesLen);
+    n += config->generalBytesLen;
+    cmd[n++] = config->historicalBytesLen;
+    if (config->historicalBytesLen)
+        memcpy(cmd + n, config->historicalBytes, config->historicalBytesLen);
+    n += config->historicalBytesLen;
+
+    pn532_frame_t frame;
+    if (!pn532_commandInto(obj, cmd, n, buff, size, &frame, timeout) || frame.payloadLen < 1)
+        PN532_UNLOCK_RETURN(obj, false);
+
+    PN532_DEBUG("Target: activated, mode %02x\n", frame.payload[0]);
+    *mode = frame.payload[0];
+    if (initiatorCmd)
+        *initiatorCmd = frame.payload + 1;
+    if (initiatorCmdLen)
+        *initiatorCmdLen = frame.payloadLen - 1;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Receives the next command of the initiator (TgGetData)
+
+    @param  buff      Buffer receiving the response; a command that
+                      doesn't fit fails instead of being truncated
+    @param  size      Size of buff in bytes
+    @param  data      Command of the initiator, points into buff
+    @param  dataLen   Length of data in bytes
+    @param  status    Status byte; PN532_STATUS_MI set if the initiator
+                      chains the command
+    @param  timeout   Time in ms to wait for the command (0 = forever)
+
+    @returns true if a command was received, false on an error (check
+             status, e.g. PN532_STATUS_RELEASED once the initiator left)
+*/
+/**************************************************************************/
+bool pn532_tgGetData(pn532_t *obj, uint8_t *buff, uint16_t size, const uint8_t **data, uint16_t *dataLen, uint8_t *status, uint16_t timeout)
+{
+    uint8_t cmd = PN532_COMMAND_TGGETDATA;
+    pn532_frame_t frame;
+
+    *status = PN532_STATUS_ERROR_MASK;
+
+    pn532_lock(obj);
+
+    if (!pn532_commandInto(obj, &cmd, 1, buff, size, &frame, timeout) || frame.payloadLen < 1)
+        PN532_UNLOCK_RETURN(obj, false);
+
+    *status = frame.payload[0];
+    if (*status & PN532_STATUS_ERROR_MASK)
+    {
+        PN532_DEBUG("Target: TgGetData status %02x\n", *status);
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    *data = frame.payload + 1;
+    *dataLen = frame.payloadLen - 1;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends the response to the last command of the initiator
+            (TgSetData)
+
+    @param  data      Response (e.g. an R-APDU)
+    @param  dataLen   Length of data in bytes, up to PN532_PACKBUFFSIZ - 1
+    @param  timeout   Timeout in ms
+
+    @returns true if the PN532 sent the response, false otherwise
+*/
+/**************************************************************************/
+bool pn532_tgSetData(pn532_t *obj, const uint8_t *data, uint16_t dataLen, uint16_t timeout)
+{
+    if (dataLen > PN532_PACKBUFFSIZ - 1)
+        return false;
+
+    pn532_lock(obj);
+
+    obj->_packetbuffer[0] = PN532_COMMAND_TGSETDATA;
+    memmove(obj->_packetbuffer + 1, data, dataLen); // data may already be in _packetbuffer
+
+    pn532_frame_t frame;
+    if (!pn532_command(obj, obj->_packetbuffer, dataLen + 1, &frame, timeout) || frame.payloadLen < 1)
+        PN532_UNLOCK_RETURN(obj, false);
+
+    PN532_UNLOCK_RETURN(obj, (frame.payload[0] & PN532_STATUS_ERROR_MASK) == 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs a target session: activation, then one request/response
+            exchange per initiator command until the initiator leaves
+
+    Commands are received into rx and handed to handler in place, the
+    handler writes its response behind the TgSetData command code in tx,
+    so no exchange copies data. The device lock is held for the session.
+    Chained commands (MI) and empty responses end the session.
+
+    @param  config    What to announce as target
+    @param  handler   Answers each command
+    @param  ctx       Passed to handler
+    @param  rx        Buffer receiving the commands, a whole PN532 frame
+                      (PN532_FRAME_MAX_SIZE) takes any command
+    @param  rxSize    Size of rx in bytes
+    @param  tx        Buffer for the responses, one byte more than the
+                      longest response
+    @param  txSize    Size of tx in bytes
+    @param  timeout   Time in ms to wait for the activation and for each
+                      command (0 = forever)
+
+    @returns Number of commands answered
+*/
+/**************************************************************************/
+uint32_t pn532_tg_serve(pn532_t *obj, const pn532_tg_config_t *config, pn532_tg_handler_t handler, void *ctx, uint8_t *rx, uint16_t rxSize, uint8_t *tx, uint16_t txSize, uint16_t timeout)
+{
+    const uint8_t *cmd;
+    uint16_t cmdLen;
+    uint16_t respLen;
+    uint8_t status;
+    uint8_t mode;
+    uint32_t served = 0;
+    bool more = true;
+    pn532_frame_t frame;
+
+    if (txSize < 1)
+        return 0;
+
+    pn532_lock(obj);
+
+    if (!pn532_tgInitAsTarget(obj, config, rx, rxSize, &mode, NULL, NULL, timeout))
+        PN532_UNLOCK_RETURN(obj, 0);
+
+    tx[0] = PN532_COMMAND_TGSETDATA;
+    while (more)
+    {
+        if (!pn532_tgGetData(obj, rx, rxSize, &cmd, &cmdLen, &status, timeout))
+            break;
+        if (status & PN532_STATUS_MI)
+        {
+            PN532_DEBUG("Target: chained command not supported\n");
+            break;
+        }
+
+        respLen = 0;
+        more = handler(ctx, cmd, cmdLen, tx + 1, txSize - 1, &respLen);
+        // the initiator waits for a response, without one the session is over
+        if (respLen == 0 || respLen > txSize - 1 || respLen > PN532_PACKBUFFSIZ - 1)
+            break;
+
+        // the TgSetData status lands in rx, cmd is no longer needed
+        if (!pn532_commandInto(obj, tx, respLen + 1, rx, rxSize, &frame, timeout) || frame.payloadLen < 1 ||
+            (frame.payload[0] & PN532_STATUS_ERROR_MASK))
+            break;
+        served++;
+    }
+
+    PN532_DEBUG("Target: session ended after %u commands\n", (unsigned)served);
+    PN532_UNLOCK_RETURN(obj, served);
+}
+
+/**************************************************************************/
+/*!
+    @brief  set the PN532 as iso14443a Target behaving as a SmartCard
+    @param  None
+    #author Salvador Mendoza(salmg.net) new functions:
+    -AsTarget
+    -getDataTarget
+    -setDataTarget
+*/
+/**************************************************************************/
+uint8_t pn532_AsTarget(pn532_t *obj)
+{
+    uint8_t mode;
+
+    return pn532_tgInitAsTarget(obj, &pn532_tg_legacy, obj->_packetbuffer, sizeof(obj->_packetbuffer), &mode, NULL, NULL, PN532_TG_DEFAULT_TIMEOUT);
+}
+
+/**************************************************************************/
+/*!
+    @brief  retrieve response from the emulation mode
+
+    @param  cmd    = data
+    @param  cmdlen = size of cmd on input, data length on output; data
+                     that doesn't fit fails the call
+*/
+/**************************************************************************/
+uint8_t pn532_getDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t *cmdlen)
+{
+    const uint8_t *data;
+    uint16_t length;
+    uint8_t status;
+
+    pn532_lock(obj);
+
+    if (!pn532_tgGetData(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer), &data, &length, &status, PN532_TG_DEFAULT_TIMEOUT))
+        PN532_UNLOCK_RETURN(obj, false);
+
+    if (length > *cmdlen)
+    {
+        PN532_DEBUG("Target: %d bytes don't fit into %d\n", length, *cmdlen);
+        PN532_UNLOCK_RETURN(obj, false);
+    }
+
+    memcpy(cmd, data, length);
+    *cmdlen = length;
+    PN532_UNLOCK_RETURN(obj, true);
+}
+
+/**************************************************************************/
+/*!
+    @brief  set data in PN532 in the emulation mode
+
+    @param  cmd    = TgSetData command: cmd[0] = 0x8E, then the data
+    @param  cmdlen = command length
+*/
+/**************************************************************************/
+uint8_t pn532_setDataTarget(pn532_t *obj, const uint8_t *cmd, uint8_t cmdlen)
+{
+    if (cmdlen < 1 || cmd[0] != PN532_COMMAND_TGSETDATA)
+        return false;
+
+    return pn532_tgSetData(obj, cmd + 1, cmdlen - 1, PN532_TG_DEFAULT_TIMEOUT);
+}
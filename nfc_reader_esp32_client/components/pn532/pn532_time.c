@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pn532_time.h"
+
+#ifndef PN532_VIRTUAL_CLOCK
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+
+#define PN532_TICK_US (portTICK_PERIOD_MS * 1000)
+#else
+static volatile int64_t pn532_virtual_now;
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Current driver time in microseconds
+*/
+/**************************************************************************/
+int64_t pn532_time_now(void)
+{
+#ifdef PN532_VIRTUAL_CLOCK
+    return pn532_virtual_now;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Waits at least us microseconds
+
+    Below one tick the CPU busy-waits, so short guard times (SS to the
+    first clock) cost what the PN532 needs instead of a whole tick.
+    Longer delays sleep whole ticks, rounded up.
+*/
+/**************************************************************************/
+void pn532_delay_us(uint32_t us)
+{
+#ifdef PN532_VIRTUAL_CLOCK
+    pn532_virtual_now += us;
+#else
+    if (us < PN532_TICK_US)
+    {
+        esp_rom_delay_us(us);
+        return;
+    }
+
+    // vTaskDelay(n) returns up to a tick early, one more keeps it from being short
+    vTaskDelay((us + PN532_TICK_US - 1) / PN532_TICK_US + 1);
+#endif
+}
+
+#ifdef PN532_VIRTUAL_CLOCK
+/**************************************************************************/
+/*!
+    @brief  Moves the virtual clock forward (host builds)
+*/
+/**************************************************************************/
+void pn532_time_advance(uint32_t us)
+{
+    pn532_virtual_now += us;
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  Deadline timeout microseconds from now
+
+    @param  timeout   Timeout in us (0 = no deadline)
+*/
+/**************************************************************************/
+int64_t pn532_deadline_us(uint32_t timeout)
+{
+    if (timeout == 0)
+        return PN532_TIME_FOREVER;
+
+    return pn532_time_now() + timeout;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Deadline timeout milliseconds from now
+
+    @param  timeout   Timeout in ms (0 = no deadline)
+*/
+/**************************************************************************/
+int64_t pn532_deadline_ms(uint32_t timeout)
+{
+    if (timeout == 0)
+        return PN532_TIME_FOREVER;
+
+    return pn532_time_now() + (int64_t)timeout * 1000;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Checks whether a deadline has passed
+*/
+/**************************************************************************/
+bool pn532_deadline_passed(int64_t deadline)
+{
+    return deadline != PN532_TIME_FOREVER && pn532_time_now() >= deadline;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Time left until a deadline
+
+    @returns Microseconds left (0 once passed, UINT32_MAX for no deadline
+             or more than UINT32_MAX us)
+*/
+/**************************************************************************/
+uint32_t pn532_deadline_left_us(int64_t deadline)
+{
+    int64_t left;
+
+    if (deadline == PN532_TIME_FOREVER)
+        return UINT32_MAX;
+
+    left = deadline - pn532_time_now();
+    if (left <= 0)
+        return 0;
+    return left > UINT32_MAX ? UINT32_MAX : (uint32_t)left;
+}
@@ -0,0 +1,38 @@
+#ifndef __PN532_TIME_H__
+#define __PN532_TIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Driver time base in microseconds. On the ESP32 it runs on esp_timer:
+ * delays shorter than a FreeRTOS tick are busy-waited, longer ones sleep.
+ * Timeouts are absolute deadlines on the same clock, so they don't drift
+ * by a tick per loop.
+ *
+ * Built with PN532_VIRTUAL_CLOCK (host builds) the clock only moves when
+ * the driver delays or pn532_time_advance is called.
+ */
+
+#define PN532_TIME_FOREVER (INT64_MAX) // Deadline that never passes
+
+int64_t pn532_time_now(void);
+void pn532_delay_us(uint32_t us);
+int64_t pn532_deadline_us(uint32_t timeout);
+int64_t pn532_deadline_ms(uint32_t timeout);
+bool pn532_deadline_passed(int64_t deadline);
+uint32_t pn532_deadline_left_us(int64_t deadline);
+
+#ifdef PN532_VIRTUAL_CLOCK
+void pn532_time_advance(uint32_t us);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
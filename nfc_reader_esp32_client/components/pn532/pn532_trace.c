@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "pn532_trace.h"
+
+// Record layout in the ring: time (8), duration (4), len (2), bytes
+#define PN532_TRACE_HDR_SIZE (14)
+
+static void pn532_trace_select(void *ctx);
+static void pn532_trace_deselect(void *ctx);
+static void pn532_trace_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+static void pn532_replay_select(void *ctx);
+static void pn532_replay_deselect(void *ctx);
+static void pn532_replay_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+static void pn532_replay_start(pn532_trace_replay_t *replay, uint8_t op);
+static void pn532_trace_write(pn532_trace_t *trace, const void *src, size_t n);
+static void pn532_trace_read(const pn532_trace_t *trace, size_t offset, void *dst, size_t n);
+static void pn532_trace_vcd_byte(FILE *out, char id, uint8_t value);
+
+// Guards the ring between the recording driver and a dumping task
+static portMUX_TYPE pn532_trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const pn532_transport_t pn532_trace_transport = {
+    .select = pn532_trace_select,
+    .deselect = pn532_trace_deselect,
+    .transfer = pn532_trace_transfer,
+};
+
+static const pn532_transport_t pn532_replay_transport = {
+    .select = pn532_replay_select,
+    .deselect = pn532_replay_deselect,
+    .transfer = pn532_replay_transfer,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Empties a trace
+*/
+/**************************************************************************/
+void pn532_trace_init(pn532_trace_t *trace)
+{
+    portENTER_CRITICAL(&pn532_trace_mux);
+    trace->head = 0;
+    trace->tail = 0;
+    trace->used = 0;
+    trace->count = 0;
+    trace->dropped = 0;
+    trace->paused = false;
+    portEXIT_CRITICAL(&pn532_trace_mux);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Starts recording the bus traffic of a PN532
+
+    Call after the transport is set up (pn532_spi_init and friends).
+
+    @param  trace     Trace to record into, initialized with
+                      pn532_trace_init
+*/
+/**************************************************************************/
+void pn532_trace_attach(pn532_t *obj, pn532_trace_t *trace)
+{
+    pn532_lock(obj);
+    trace->_inner = obj->_transport;
+    trace->_innerCtx = obj->_transportCtx;
+    pn532_transport_init(obj, &pn532_trace_transport, trace);
+    pn532_unlock(obj);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Stops recording and puts the traced transport back
+*/
+/**************************************************************************/
+void pn532_trace_detach(pn532_t *obj, pn532_trace_t *trace)
+{
+    pn532_lock(obj);
+    if (obj->_transportCtx == trace)
+        pn532_transport_init(obj, trace->_inner, trace->_innerCtx);
+    pn532_unlock(obj);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Appends a frame, overwriting the oldest frames if needed
+
+    @param  rec       Time, duration and length of the frame
+    @param  data      rec->len bytes, starting with the operation byte
+*/
+/**************************************************************************/
+void pn532_trace_add(pn532_trace_t *trace, const pn532_trace_rec_t *rec, const uint8_t *data)
+{
+    size_t need = PN532_TRACE_HDR_SIZE + rec->len;
+
+    portENTER_CRITICAL(&pn532_trace_mux);
+    if (trace->paused || need > PN532_TRACE_RING_SIZE)
+    {
+        trace->dropped++;
+        portEXIT_CRITICAL(&pn532_trace_mux);
+        return;
+    }
+
+    while (PN532_TRACE_RING_SIZE - trace->used < need)
+    {
+        uint16_t len;
+        pn532_trace_read(trace, trace->tail + 12, &len, sizeof(len));
+        trace->tail = (trace->tail + PN532_TRACE_HDR_SIZE + len) % PN532_TRACE_RING_SIZE;
+        trace->used -= PN532_TRACE_HDR_SIZE + len;
+        trace->count--;
+    }
+
+    pn532_trace_write(trace, &rec->time, sizeof(rec->time));
+    pn532_trace_write(trace, &rec->duration, sizeof(rec->duration));
+    pn532_trace_write(trace, &rec->len, sizeof(rec->len));
+    pn532_trace_write(trace, data, rec->len);
+    trace->used += need;
+    trace->count++;
+    portEXIT_CRITICAL(&pn532_trace_mux);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Positions an iterator on the oldest frame
+
+    The ring must not change while iterating: pause it, detach it or
+    iterate from the recording task.
+*/
+/**************************************************************************/
+void pn532_trace_begin(const pn532_trace_t *trace, pn532_trace_iter_t *it)
+{
+    it->offset = trace->tail;
+    it->index = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads the next frame, oldest first
+
+    @param  it        Iterator set up with pn532_trace_begin
+    @param  rec       Time, duration and length of the frame
+    @param  data      Buffer receiving the frame bytes (may be NULL)
+    @param  size      Size of data, longer frames are cut
+
+    @returns true if a frame was read, false past the newest frame
+*/
+/**************************************************************************/
+bool pn532_trace_next(const pn532_trace_t *trace, pn532_trace_iter_t *it, pn532_trace_rec_t *rec, uint8_t *data, uint16_t size)
+{
+    if (it->index >= trace->count)
+        return false;
+
+    pn532_trace_read(trace, it->offset, &rec->time, sizeof(rec->time));
+    pn532_trace_read(trace, it->offset + 8, &rec->duration, sizeof(rec->duration));
+    pn532_trace_read(trace, it->offset + 12, &rec->len, sizeof(rec->len));
+    if (data != NULL)
+        pn532_trace_read(trace, it->offset + PN532_TRACE_HDR_SIZE, data, rec->len < size ? rec->len : size);
+
+    it->offset = (it->offset + PN532_TRACE_HDR_SIZE + rec->len) % PN532_TRACE_RING_SIZE;
+    it->index++;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Prints all frames to the console, one line per frame:
+            PN532T <time us> <duration us> <hex bytes>
+
+    Recording is paused meanwhile, frames on the bus are counted as
+    dropped. The lines can be fed back to pn532_trace_load.
+*/
+/**************************************************************************/
+void pn532_trace_dump(pn532_trace_t *trace)
+{
+    pn532_trace_iter_t it;
+    pn532_trace_rec_t rec;
+    uint8_t b;
+
+    portENTER_CRITICAL(&pn532_trace_mux);
+    trace->paused = true;
+    portEXIT_CRITICAL(&pn532_trace_mux);
+
+    printf("PN532 trace: %u frames, %u dropped\n", (unsigned)trace->count, (unsigned)trace->dropped);
+    pn532_trace_begin(trace, &it);
+    while (pn532_trace_next(trace, &it, &rec, NULL, 0))
+    {
+        printf(PN532_TRACE_DUMP_PREFIX " %lld %u ", (long long)rec.time, (unsigned)rec.duration);
+        // the frame bytes follow the header in the ring
+        for (uint16_t i = 0; i < rec.len; i++)
+        {
+            pn532_trace_read(trace, it.offset + PN532_TRACE_RING_SIZE - rec.len + i, &b, 1);
+            printf("%02x", b);
+        }
+        printf("\n");
+    }
+
+    portENTER_CRITICAL(&pn532_trace_mux);
+    trace->paused = false;
+    portEXIT_CRITICAL(&pn532_trace_mux);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Adds a frame from a dumped line (host side)
+
+    Anything before PN532T, e.g. a log or terminal prefix, is skipped.
+
+    @param  line      One line of pn532_trace_dump output
+
+    @returns true if the line held a frame
+*/
+/**************************************************************************/
+bool pn532_trace_load(pn532_trace_t *trace, const char *line)
+{
+    static uint8_t data[PN532_TRACE_FRAME_MAX];
+    pn532_trace_rec_t rec = {0};
+    const char *p = strstr(line, PN532_TRACE_DUMP_PREFIX " ");
+    char *end;
+
+    if (p == NULL)
+        return false;
+    p += sizeof(PN532_TRACE_DUMP_PREFIX);
+
+    rec.time = strtoll(p, &end, 10);
+    if (end == p)
+        return false;
+    p = end;
+    rec.duration = strtoul(p, &end, 10);
+    if (end == p)
+        return false;
+    p = end;
+    while (*p == ' ')
+        p++;
+
+    while (rec.len < sizeof(data) && p[0] && p[1] && p[0] != '\n' && p[0] != '\r')
+    {
+        char hex[3] = {p[0], p[1], 0};
+        data[rec.len++] = strtoul(hex, &end, 16);
+        if (end != hex + 2)
+            return false;
+        p += 2;
+    }
+
+    pn532_trace_add(trace, &rec, data);
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Writes a trace as VCD for comparison with logic analyser
+            captures
+
+    Signals: ss (low while a frame is on the bus), mosi and miso (the
+    byte on each line). Bytes are spread evenly over the SS low time,
+    times are relative to the first frame.
+
+    @param  out       Output stream
+*/
+/**************************************************************************/
+void pn532_trace_vcd(const pn532_trace_t *trace, FILE *out)
+{
+    static uint8_t data[PN532_TRACE_FRAME_MAX];
+    pn532_trace_iter_t it;
+    pn532_trace_rec_t rec;
+    int64_t origin = -1;
+    int64_t last = -1;
+
+    fprintf(out, "$timescale 1us $end\n");
+    fprintf(out, "$scope module pn532 $end\n");
+    fprintf(out, "$var wire 1 s ss $end\n");
+    fprintf(out, "$var wire 8 m mosi $end\n");
+    fprintf(out, "$var wire 8 i miso $end\n");
+    fprintf(out, "$upscope $end\n");
+    fprintf(out, "$enddefinitions $end\n");
+    fprintf(out, "$dumpvars\n1s\nbx m\nbx i\n$end\n");
+
+    pn532_trace_begin(trace, &it);
+    while (pn532_trace_next(trace, &it, &rec, data, sizeof(data)))
+    {
+        uint16_t len = rec.len < sizeof(data) ? rec.len : sizeof(data);
+
+        if (origin < 0)
+            origin = rec.time;
+
+        int64_t t = rec.time - origin;
+        if (t <= last)
+            t = last + 1;
+        fprintf(out, "#%lld\n0s\n", (long long)t);
+        last = t;
+
+        for (uint16_t i = 0; i < len; i++)
+        {
+            int64_t bt = rec.time - origin + (int64_t)rec.duration * i / len;
+            if (bt > last)
+            {
+                fprintf(out, "#%lld\n", (long long)bt);
+                last = bt;
+            }
+            // after the operation byte only DW keeps driving MOSI
+            pn532_trace_vcd_byte(out, (i == 0 || data[0] == PN532_SPI_DATAWRITE) ? 'm' : 'i', data[i]);
+        }
+
+        t = rec.time - origin + rec.duration;
+        if (t <= last)
+            t = last + 1;
+        fprintf(out, "#%lld\n1s\nbx m\nbx i\n", (long long)t);
+        last = t;
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Plays a trace back to the driver instead of a PN532
+
+    Frames read by the driver (SR, DR) come from the trace in order,
+    written frames are compared with it. Status polls that don't line up
+    with the trace (e.g. recorded with IRQ, replayed polling) are answered
+    ready; the mismatch counter tells how far the replay diverged.
+
+    @param  replay    Replay state
+    @param  trace     Recorded trace
+*/
+/**************************************************************************/
+void pn532_trace_replay(pn532_t *obj, pn532_trace_replay_t *replay, const pn532_trace_t *trace)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->trace = trace;
+    pn532_trace_begin(trace, &replay->it);
+    pn532_transport_init(obj, &pn532_replay_transport, replay);
+}
+
+static void pn532_trace_select(void *ctx)
+{
+    pn532_trace_t *trace = (pn532_trace_t *)ctx;
+
+    trace->_inner->select(trace->_innerCtx);
+    trace->_rec.time = pn532_time_now();
+    trace->_rec.len = 0;
+}
+
+static void pn532_trace_deselect(void *ctx)
+{
+    pn532_trace_t *trace = (pn532_trace_t *)ctx;
+
+    trace->_inner->deselect(trace->_innerCtx);
+    trace->_rec.duration = pn532_time_now() - trace->_rec.time;
+    pn532_trace_add(trace, &trace->_rec, trace->_frame);
+}
+
+static void pn532_trace_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    pn532_trace_t *trace = (pn532_trace_t *)ctx;
+    const uint8_t *bytes = rx != NULL ? rx : tx;
+
+    trace->_inner->transfer(trace->_innerCtx, tx, rx, len);
+
+    // the driver transfers one direction at a time: op byte, then frame
+    if (len > (size_t)(PN532_TRACE_FRAME_MAX - trace->_rec.len))
+        len = PN532_TRACE_FRAME_MAX - trace->_rec.len;
+    if (bytes != NULL)
+    {
+        memcpy(trace->_frame + trace->_rec.len, bytes, len);
+        trace->_rec.len += len;
+    }
+}
+
+static void pn532_replay_select(void *ctx)
+{
+    pn532_trace_replay_t *replay = (pn532_trace_replay_t *)ctx;
+
+    replay->started = false;
+}
+
+static void pn532_replay_deselect(void *ctx)
+{
+    (void)ctx;
+}
+
+static void pn532_replay_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    pn532_trace_replay_t *replay = (pn532_trace_replay_t *)ctx;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!replay->started)
+        {
+            pn532_replay_start(replay, tx != NULL ? tx[i] : 0);
+            continue;
+        }
+
+        bool recorded = replay->pos < replay->rec.len;
+        uint8_t b = recorded ? replay->frame[replay->pos++] : 0;
+
+        if (rx != NULL)
+            rx[i] = b;
+        if (!recorded || (rx == NULL && tx != NULL && tx[i] != b))
+            replay->mismatches++;
+    }
+}
+
+// Picks the recorded frame for the operation the driver starts
+static void pn532_replay_start(pn532_trace_replay_t *replay, uint8_t op)
+{
+    pn532_trace_iter_t it = replay->it;
+    pn532_trace_rec_t rec;
+
+    replay->started = true;
+    replay->pos = 1;
+
+    // skip status polls and SS pulses the driver doesn't repeat
+    while (pn532_trace_next(replay->trace, &it, &rec, replay->frame, sizeof(replay->frame)))
+    {
+        if (rec.len > 0 && replay->frame[0] == op)
+        {
+            replay->rec = rec;
+            if (replay->rec.len > sizeof(replay->frame))
+                replay->rec.len = sizeof(replay->frame);
+            replay->it = it;
+            replay->frames++;
+            return;
+        }
+        if (rec.len > 0 && replay->frame[0] != PN532_SPI_STATREAD)
+            break;
+    }
+
+    // nothing recorded for it: a status poll gets ready, anything else zeros
+    replay->rec.len = 2;
+    replay->frame[0] = op;
+    replay->frame[1] = 0x01;
+    if (op != PN532_SPI_STATREAD)
+    {
+        replay->rec.len = 1;
+        replay->mismatches++;
+    }
+}
+
+// Copies into the ring at head, wrapping around its end
+static void pn532_trace_write(pn532_trace_t *trace, const void *src, size_t n)
+{
+    const uint8_t *p = (const uint8_t *)src;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        trace->ring[trace->head] = p[i];
+        trace->head = (trace->head + 1) % PN532_TRACE_RING_SIZE;
+    }
+}
+
+// Copies out of the ring from offset, wrapping around its end
+static void pn532_trace_read(const pn532_trace_t *trace, size_t offset, void *dst, size_t n)
+{
+    uint8_t *p = (uint8_t *)dst;
+
+    for (size_t i = 0; i < n; i++)
+        p[i] = trace->ring[(offset + i) % PN532_TRACE_RING_SIZE];
+}
+
+static void pn532_trace_vcd_byte(FILE *out, char id, uint8_t value)
+{
+    fputc('b', out);
+    for (int bit = 7; bit >= 0; bit--)
+        fputc((value >> bit) & 1 ? '1' : '0', out);
+    fprintf(out, " %c\n", id);
+}
@@ -0,0 +1,83 @@
+#ifndef __PN532_TRACE_H__
+#define __PN532_TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pn532.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bus trace: a transport wrapper that records every SS low period (one
+ * status read, frame write or frame read) with its start time, duration
+ * and bytes into a fixed RAM ring. The oldest frames are overwritten.
+ *
+ * The first byte of a recorded frame is the SPI operation (DW, SR, DR),
+ * the rest is what was written (DW) or read (SR, DR).
+ *
+ * Dumped traces can be loaded back on the host, replayed against the
+ * driver through the replay transport, or exported as VCD.
+ */
+
+#define PN532_TRACE_RING_SIZE   (4096)                      // Bytes of frame records kept
+#define PN532_TRACE_FRAME_MAX   (PN532_FRAME_MAX_SIZE + 1)  // Longest recorded frame incl. operation byte
+#define PN532_TRACE_DUMP_PREFIX "PN532T"                    // Starts every dumped frame line
+
+typedef struct {
+    int64_t time;        // pn532_time_now() when SS went low
+    uint32_t duration;   // SS low time in us
+    uint16_t len;        // Recorded bytes, starting with the operation byte
+} pn532_trace_rec_t;
+
+typedef struct {
+    uint8_t ring[PN532_TRACE_RING_SIZE];
+    size_t head;                         // Next byte written
+    size_t tail;                         // Oldest record
+    size_t used;                         // Bytes in use
+    size_t count;                        // Records in the ring
+    uint32_t dropped;                    // Frames lost while paused or too long
+    volatile bool paused;                // Set while the ring is dumped
+
+    const pn532_transport_t *_inner;     // Transport being traced
+    void *_innerCtx;
+    pn532_trace_rec_t _rec;              // Frame being recorded
+    uint8_t _frame[PN532_TRACE_FRAME_MAX];
+} pn532_trace_t;
+
+typedef struct {
+    size_t offset;
+    size_t index;
+} pn532_trace_iter_t;
+
+typedef struct {
+    const pn532_trace_t *trace;
+    pn532_trace_iter_t it;
+    pn532_trace_rec_t rec;               // Frame served for the current SS low period
+    uint8_t frame[PN532_TRACE_FRAME_MAX];
+    uint16_t pos;                        // Next byte of frame
+    bool started;                        // Operation byte seen for this SS low period
+    uint32_t frames;                     // Recorded frames replayed
+    uint32_t mismatches;                 // Written bytes or operations that differ from the trace
+} pn532_trace_replay_t;
+
+void pn532_trace_init(pn532_trace_t *trace);
+void pn532_trace_attach(pn532_t *obj, pn532_trace_t *trace);
+void pn532_trace_detach(pn532_t *obj, pn532_trace_t *trace);
+void pn532_trace_add(pn532_trace_t *trace, const pn532_trace_rec_t *rec, const uint8_t *data);
+void pn532_trace_begin(const pn532_trace_t *trace, pn532_trace_iter_t *it);
+bool pn532_trace_next(const pn532_trace_t *trace, pn532_trace_iter_t *it, pn532_trace_rec_t *rec, uint8_t *data, uint16_t size);
+void pn532_trace_dump(pn532_trace_t *trace);
+bool pn532_trace_load(pn532_trace_t *trace, const char *line);
+void pn532_trace_vcd(const pn532_trace_t *trace, FILE *out);
+void pn532_trace_replay(pn532_t *obj, pn532_trace_replay_t *replay, const pn532_trace_t *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#include "esp_attr.h"
+
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "pn532.h"
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+// Transfers up to this size are clocked out with the CPU polling the
+// peripheral, longer ones are queued to the DMA engine and the task sleeps
+#define PN532_SPI_POLLING_MAX (32)
+
+static void pn532_bitbang_select(void *ctx);
+static void pn532_bitbang_deselect(void *ctx);
+static void pn532_bitbang_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+static void pn532_spi_write(pn532_t *obj, uint8_t c);
+static uint8_t pn532_spi_read(pn532_t *obj);
+
+static void pn532_irq_isr(void *arg);
+
+static esp_err_t pn532_spi_master_bus_init(spi_host_device_t host, uint8_t clk, uint8_t miso, uint8_t mosi);
+static void pn532_spi_master_select(void *ctx);
+static void pn532_spi_master_deselect(void *ctx);
+static void pn532_spi_master_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len);
+
+// Number of SPI hosts a PN532 can be attached to (SPI1, HSPI, VSPI)
+#define PN532_SPI_HOSTS (3)
+
+// PN532s on the same pins share a bus lock so that the SS low periods of
+// different devices never overlap. All bit-banged PN532s share one set of
+// clock/data pins, PN532s on a SPI host also share one device handle
+// (SS is driven per PN532) so the host's CS slots don't limit their count.
+static SemaphoreHandle_t pn532_bitbang_bus = NULL;
+static SemaphoreHandle_t pn532_spi_bus[PN532_SPI_HOSTS];
+static spi_device_handle_t pn532_spi_devices[PN532_SPI_HOSTS];
+
+static const pn532_transport_t pn532_bitbang_transport = {
+    .select = pn532_bitbang_select,
+    .deselect = pn532_bitbang_deselect,
+    .transfer = pn532_bitbang_transfer,
+};
+
+static const pn532_transport_t pn532_spi_master_transport = {
+    .select = pn532_spi_master_select,
+    .deselect = pn532_spi_master_deselect,
+    .transfer = pn532_spi_master_transfer,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Attaches an arbitrary transport (e.g. a host-side mock) to
+            the device descriptor
+
+    @param  transport   Transport callbacks
+    @param  ctx         Opaque pointer handed to every callback
+*/
+/**************************************************************************/
+void pn532_transport_init(pn532_t *obj, const pn532_transport_t *transport, void *ctx)
+{
+    obj->_transport = transport;
+    obj->_transportCtx = ctx;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Configures the pins for a bit-banged SPI bus
+*/
+/**************************************************************************/
+void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss)
+{
+    obj->_clk = clk;
+    obj->_miso = miso;
+    obj->_mosi = mosi;
+    obj->_ss = ss;
+
+    gpio_pad_select_gpio(obj->_clk);
+    gpio_pad_select_gpio(obj->_miso);
+    gpio_pad_select_gpio(obj->_mosi);
+    gpio_pad_select_gpio(obj->_ss);
+
+    gpio_set_direction(obj->_ss, GPIO_MODE_OUTPUT);
+    gpio_set_level(obj->_ss, 1);
+    gpio_set_direction(obj->_clk, GPIO_MODE_OUTPUT);
+    gpio_set_direction(obj->_mosi, GPIO_MODE_OUTPUT);
+    gpio_set_direction(obj->_miso, GPIO_MODE_INPUT);
+
+    if (pn532_bitbang_bus == NULL)
+        pn532_bitbang_bus = xSemaphoreCreateMutex();
+    obj->_busLock = pn532_bitbang_bus;
+
+    pn532_transport_init(obj, &pn532_bitbang_transport, obj);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Configures the PN532 as a device on a hardware SPI host
+
+    The bus is set up with DMA on first use and shared by every PN532
+    added to the same host afterwards. SS is driven by the driver itself
+    so that a whole frame read can span several transactions, which also
+    lets any number of PN532s share the host on separate SS pins.
+
+    @param  host      SPI host the PN532 is wired to (HSPI_HOST or VSPI_HOST)
+
+    @returns ESP_OK or the error reported by the spi_master driver
+*/
+/**************************************************************************/
+esp_err_t pn532_spi_master_init(pn532_t *obj, spi_host_device_t host, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss)
+{
+    obj->_clk = clk;
+    obj->_miso = miso;
+    obj->_mosi = mosi;
+    obj->_ss = ss;
+
+    if (host >= PN532_SPI_HOSTS)
+        return ESP_ERR_INVALID_ARG;
+
+    if (pn532_spi_devices[host] == NULL)
+    {
+        esp_err_t err = pn532_spi_master_bus_init(host, clk, miso, mosi);
+        if (err != ESP_OK)
+            return err;
+    }
+    obj->_spi = pn532_spi_devices[host];
+    obj->_busLock = pn532_spi_bus[host];
+
+    gpio_pad_select_gpio(obj->_ss);
+    gpio_set_direction(obj->_ss, GPIO_MODE_OUTPUT);
+    gpio_set_level(obj->_ss, 1);
+
+    pn532_transport_init(obj, &pn532_spi_master_transport, obj);
+
+    return ESP_OK;
+}
+
+static esp_err_t pn532_spi_master_bus_init(spi_host_device_t host, uint8_t clk, uint8_t miso, uint8_t mosi)
+{
+    spi_bus_config_t buscfg = {
+        .mosi_io_num = mosi,
+        .miso_io_num = miso,
+        .sclk_io_num = clk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = PN532_SPI_MAX_TRANSFER,
+    };
+    esp_err_t err = spi_bus_initialize(host, &buscfg, PN532_SPI_DMA_CHAN);
+    // Bus already initialised by another driver on the same host
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+        return err;
+
+    // PN532 SPI is mode 0, LSB first
+    spi_device_interface_config_t devcfg = {
+        .mode = 0,
+        .clock_speed_hz = PN532_SPI_CLOCK_HZ,
+        .spics_io_num = -1,
+        .flags = SPI_DEVICE_BIT_LSBFIRST,
+        .queue_size = 1,
+    };
+    pn532_spi_bus[host] = xSemaphoreCreateMutex();
+    if (pn532_spi_bus[host] == NULL)
+        return ESP_ERR_NO_MEM;
+
+    err = spi_bus_add_device(host, &devcfg, &pn532_spi_devices[host]);
+    if (err != ESP_OK)
+    {
+        vSemaphoreDelete(pn532_spi_bus[host]);
+        pn532_spi_bus[host] = NULL;
+    }
+    return err;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Routes the PN532 IRQ line to a GPIO interrupt
+
+    Once set up, waiting for the chip blocks on a semaphore given from
+    the falling edge of IRQ instead of polling the SPI status byte.
+    Without this call the driver keeps polling.
+
+    @param  irq       GPIO connected to the PN532 P70_IRQ output
+
+    @returns ESP_OK or the error reported by the GPIO driver
+*/
+/**************************************************************************/
+esp_err_t pn532_irq_init(pn532_t *obj, uint8_t irq)
+{
+    obj->_irqSem = xSemaphoreCreateBinary();
+    if (obj->_irqSem == NULL)
+        return ESP_ERR_NO_MEM;
+    obj->_irq = irq;
+
+    gpio_pad_select_gpio(irq);
+    gpio_set_direction(irq, GPIO_MODE_INPUT);
+    gpio_set_pull_mode(irq, GPIO_PULLUP_ONLY);
+    gpio_set_intr_type(irq, GPIO_INTR_NEGEDGE);
+
+    // The ISR service may already be installed by another PN532
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err == ESP_OK || err == ESP_ERR_INVALID_STATE)
+        err = gpio_isr_handler_add(irq, pn532_irq_isr, obj);
+
+    if (err != ESP_OK)
+    {
+        vSemaphoreDelete(obj->_irqSem);
+        obj->_irqSem = NULL;
+    }
+    return err;
+}
+
+static void IRAM_ATTR pn532_irq_isr(void *arg)
+{
+    pn532_t *obj = arg;
+    BaseType_t woken = pdFALSE;
+
+    xSemaphoreGiveFromISR(obj->_irqSem, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
+
+/************** hardware SPI */
+
+static void pn532_spi_master_select(void *ctx)
+{
+    pn532_t *obj = ctx;
+
+    // Keep other PN532s and other devices off the bus for the whole SS low period
+    xSemaphoreTake(obj->_busLock, portMAX_DELAY);
+    spi_device_acquire_bus(obj->_spi, portMAX_DELAY);
+    gpio_set_level(obj->_ss, 0);
+}
+
+static void pn532_spi_master_deselect(void *ctx)
+{
+    pn532_t *obj = ctx;
+
+    gpio_set_level(obj->_ss, 1);
+    spi_device_release_bus(obj->_spi);
+    xSemaphoreGive(obj->_busLock);
+}
+
+static void pn532_spi_master_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    pn532_t *obj = ctx;
+
+    while (len)
+    {
+        size_t chunk = len > PN532_SPI_MAX_TRANSFER ? PN532_SPI_MAX_TRANSFER : len;
+        spi_transaction_t t = {
+            .length = chunk * 8,
+            .tx_buffer = tx,
+            .rx_buffer = rx,
+        };
+
+        if (chunk <= PN532_SPI_POLLING_MAX)
+            spi_device_polling_transmit(obj->_spi, &t);
+        else
+            spi_device_transmit(obj->_spi, &t);
+
+        if (tx)
+            tx += chunk;
+        if (rx)
+            rx += chunk;
+        len -= chunk;
+    }
+}
+
+/************** bit-banged SPI */
+
+static void pn532_bitbang_select(void *ctx)
+{
+    pn532_t *obj = ctx;
+
+    xSemaphoreTake(obj->_busLock, portMAX_DELAY);
+    gpio_set_level(obj->_ss, 0);
+}
+
+static void pn532_bitbang_deselect(void *ctx)
+{
+    pn532_t *obj = ctx;
+
+    gpio_set_level(obj->_ss, 1);
+    xSemaphoreGive(obj->_busLock);
+}
+
+// The bit-banged bus is half duplex: bytes are either written or read
+static void pn532_bitbang_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    pn532_t *obj = ctx;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (rx)
+            rx[i] = pn532_spi_read(obj);
+        else
+            pn532_spi_write(obj, tx[i]);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Low-level SPI write wrapper
+
+    @param  c       8-bit command to write to the SPI bus
+*/
+/**************************************************************************/
+static void pn532_spi_write(pn532_t *obj, uint8_t c)
+{
+    int8_t i;
+    gpio_set_level(obj->_clk, 1);
+
+    for (i = 0; i < 8; i++)
+    {
+        gpio_set_level(obj->_clk, 0);
+        if (c & _BV(i))
+        {
+            gpio_set_level(obj->_mosi, 1);
+        }
+        else
+        {
+            gpio_set_level(obj->_mosi, 0);
+        }
+        gpio_set_level(obj->_clk, 1);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Low-level SPI read wrapper
+
+    @returns The 8-bit value that was read from the SPI bus
+*/
+/**************************************************************************/
+static uint8_t pn532_spi_read(pn532_t *obj)
+{
+    int8_t i, x;
+    x = 0;
+
+    gpio_set_level(obj->_clk, 1);
+
+    for (i = 0; i < 8; i++)
+    {
+        if (gpio_get_level(obj->_miso))
+        {
+            x |= _BV(i);
+        }
+        gpio_set_level(obj->_clk, 0);
+        gpio_set_level(obj->_clk, 1);
+    }
+
+    return x;
+}
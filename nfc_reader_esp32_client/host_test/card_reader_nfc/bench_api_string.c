@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pn532.h"
+#include "card_reader_nfc.h"
+#include "esp_log.h"
+
+/*
+ * REST API string encoders against the sprintf implementation they
+ * replaced, which is kept below for the comparison. Checks that both give
+ * the same string, then prints ns per call:
+ *   bench_api_string [iterations]
+ */
+
+#define BENCH_ITERATIONS_DEFAULT (1000000)
+#define BENCH_URL_BUFFER         (500)   // MAX_HTTP_URL_BUFFER, the card log query buffer
+#define BENCH_READER_KEY_LEN     (32)    // READER_KEY_LEN in main.c
+
+// Previous encoder: sprintf per byte, prefix copied in front of the field
+static char *old_arrayToApiString(const char *prefix, const char *key, const uint8_t *array, size_t arrayLen, char *destination)
+{
+    int n = 0;
+
+    if (prefix != NULL)
+    {
+        n += sprintf(&destination[n], "%s", prefix);
+        n += sprintf(&destination[n], "&");
+    }
+    n += sprintf(&destination[n], "%s", key);
+    n += sprintf(&destination[n], "=0x");
+    for (size_t i = 0; i < arrayLen; ++i)
+        n += sprintf(&destination[n], "%02hhx", array[i]);
+    return destination;
+}
+
+// The old version passed destination as its own prefix; copying between
+// two buffers costs the same without the overlapping sprintf
+static char *old_logDataToApiString(const log_data_t *logData, char *destination)
+{
+    static char tmp[BENCH_URL_BUFFER];
+
+    old_arrayToApiString(NULL, "rid", logData->rid, READER_ID_LEN, destination);
+    old_arrayToApiString(destination, "cid", logData->cid, CARD_ID_LEN, tmp);
+    return old_arrayToApiString(tmp, "data", logData->data, CARD_DATA_LEN, destination);
+}
+
+static uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Keeps the compiler from dropping the encoded strings
+static volatile char bench_sink;
+
+int main(int argc, char **argv)
+{
+    static char oldStr[BENCH_URL_BUFFER], newStr[BENCH_URL_BUFFER];
+    long iterations = argc > 1 ? atol(argv[1]) : BENCH_ITERATIONS_DEFAULT;
+    uint8_t rkey[BENCH_READER_KEY_LEN];
+    log_data_t logData = {0};
+    uint64_t start, oldLog, newLog, oldKey, newKey;
+
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    for (int i = 0; i < READER_ID_LEN; i++)
+        logData.rid[i] = i * 37 + 1;
+    for (int i = 0; i < CARD_ID_LEN; i++)
+        logData.cid[i] = i * 53 + 7;
+    for (int i = 0; i < CARD_DATA_LEN; i++)
+        logData.data[i] = i * 11 + 0xA0;
+    for (int i = 0; i < BENCH_READER_KEY_LEN; i++)
+        rkey[i] = 0xFF - i;
+
+    // Same output, byte for byte
+    old_logDataToApiString(&logData, oldStr);
+    if (nfc_logDataToApiString(&logData, newStr, sizeof(newStr)) == NULL || strcmp(oldStr, newStr) != 0)
+    {
+        fprintf(stderr, "log data differs:\n%s\n%s\n", oldStr, newStr);
+        return 1;
+    }
+    old_arrayToApiString(NULL, "rkey", rkey, sizeof(rkey), oldStr);
+    if (nfc_arrayToApiString("rkey", rkey, sizeof(rkey), newStr, sizeof(newStr)) == NULL || strcmp(oldStr, newStr) != 0)
+    {
+        fprintf(stderr, "rkey differs:\n%s\n%s\n", oldStr, newStr);
+        return 1;
+    }
+
+    start = bench_ns();
+    for (long i = 0; i < iterations; i++)
+        bench_sink = old_logDataToApiString(&logData, oldStr)[i % 16];
+    oldLog = bench_ns() - start;
+
+    start = bench_ns();
+    for (long i = 0; i < iterations; i++)
+        bench_sink = nfc_logDataToApiString(&logData, newStr, sizeof(newStr))[i % 16];
+    newLog = bench_ns() - start;
+
+    start = bench_ns();
+    for (long i = 0; i < iterations; i++)
+        bench_sink = old_arrayToApiString(NULL, "rkey", rkey, sizeof(rkey), oldStr)[i % 16];
+    oldKey = bench_ns() - start;
+
+    start = bench_ns();
+    for (long i = 0; i < iterations; i++)
+        bench_sink = nfc_arrayToApiString("rkey", rkey, sizeof(rkey), newStr, sizeof(newStr))[i % 16];
+    newKey = bench_ns() - start;
+
+    printf("%ld iterations, ns per call\n", iterations);
+    printf("%-24s %8s %8s\n", "encoder", "sprintf", "table");
+    printf("%-24s %8.1f %8.1f\n", "nfc_logDataToApiString", (double)oldLog / iterations, (double)newLog / iterations);
+    printf("%-24s %8.1f %8.1f\n", "nfc_arrayToApiString", (double)oldKey / iterations, (double)newKey / iterations);
+    return 0;
+}
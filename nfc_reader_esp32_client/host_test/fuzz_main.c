@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Stand-in for libFuzzer. With file arguments every file is passed to the
+ * fuzz target once (crash reproduction), otherwise FUZZ_RUNS generated
+ * inputs are. Inputs are random bytes, often behind a PN532 start code (with
+ * boundary lengths in extended headers) and now and then longer than any
+ * extended frame, so the targets get past their first checks.
+ */
+
+#define FUZZ_RUNS     (200000)
+#define FUZZ_MAX_LEN  (70000)
+#define FUZZ_SEED     (0x2545F491)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint32_t fuzz_state = FUZZ_SEED;
+
+static uint32_t fuzz_random(void)
+{
+    // xorshift32, the same sequence on every run
+    fuzz_state ^= fuzz_state << 13;
+    fuzz_state ^= fuzz_state >> 17;
+    fuzz_state ^= fuzz_state << 5;
+    return fuzz_state;
+}
+
+static int fuzz_file(const char *path, uint8_t *buf)
+{
+    FILE *f = fopen(path, "rb");
+    size_t len;
+
+    if (f == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    len = fread(buf, 1, FUZZ_MAX_LEN, f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(buf, len);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[FUZZ_MAX_LEN];
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (fuzz_file(argv[i], buf))
+                return 1;
+        }
+        return 0;
+    }
+
+    for (uint32_t run = 0; run < FUZZ_RUNS; run++)
+    {
+        uint32_t shape = fuzz_random();
+        size_t len = (shape & 0xFF) == 0 ? FUZZ_MAX_LEN - fuzz_random() % 4096 : fuzz_random() % 300;
+        size_t pos = 0;
+
+        for (size_t i = 0; i < len; i++)
+            buf[i] = fuzz_random();
+
+        // Start code, optionally an extended frame header with a valid LCS
+        if ((shape & 0x300) && len >= 8)
+        {
+            buf[pos++] = 0x00;
+            buf[pos++] = 0xFF;
+            if (shape & 0x400)
+            {
+                buf[pos++] = 0xFF;
+                buf[pos++] = 0xFF;
+                if (shape & 0x800)
+                {
+                    buf[pos] = 0xFF;
+                    buf[pos + 1] = (shape & 0x1000) ? 0xFF : 0x00;
+                }
+                pos += 2;
+                buf[pos] = (uint8_t)-(buf[pos - 2] + buf[pos - 1]);
+            }
+        }
+        LLVMFuzzerTestOneInput(buf, len);
+    }
+    printf("%d runs\n", FUZZ_RUNS);
+    return 0;
+}
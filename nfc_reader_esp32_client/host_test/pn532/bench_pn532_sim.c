@@ -0,0 +1,211 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pn532.h"
+#include "pn532_sim.h"
+#include "card_reader_nfc.h"
+#include "esp_log.h"
+
+/*
+ * Tap-to-data benchmark on the simulated PN532. For every driver
+ * configuration and card type a card enters the field at a random time of
+ * the reader's detection cycle (polling, power down), and the time until
+ * nfc_logCard returns its data is taken from the virtual clock. Prints
+ * p50/p99 per row:
+ *   bench_pn532_sim [taps per row]
+ */
+
+#define BENCH_TAPS_DEFAULT  (1000)
+#define BENCH_ARRIVAL_US    (1000000) // Arrivals spread over more than a detection cycle
+#define BENCH_SEED          (0x9E3779B9)
+
+typedef struct {
+    const char *name;
+    uint32_t spiHz;
+    bool async;          // Commands go through the driver task
+} bench_config_t;
+
+typedef struct {
+    const char *name;
+    pn532_sim_card_type_t type;
+    uint16_t memorySize;
+    uint16_t dataOffset;   // Where nfc_logCard reads the card data
+} bench_card_t;
+
+// Puts the card into the field once the virtual clock reaches arriveAt
+typedef struct {
+    const pn532_transport_t *inner;
+    void *innerCtx;
+    pn532_sim_t *sim;
+    pn532_sim_card_t *card;
+    int64_t arriveAt;
+} bench_arrival_t;
+
+static const bench_config_t configs[] = {
+    {"spi 1 MHz", 1000000, false},
+    {"spi 5 MHz", 5000000, false},
+    {"driver task", 1000000, true},
+};
+
+static const bench_card_t cards[] = {
+    {"classic 1k", PN532_SIM_CLASSIC_1K, 1024, CARD_DATA_FIRST_BLOCK * 16},
+    {"ntag215", PN532_SIM_NTAG215, 540, NFC_NTAG_DATA_FIRST_PAGE * 4},
+    {"iso-dep", PN532_SIM_ISODEP, 64, 0},
+};
+
+static const uint8_t uid[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t aid[] = NFC_ISODEP_AID;
+static const nfc_key_t candidates[] = {{NFC_KEY_A, {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}}};
+static const nfc_sector_keys_t sectorKeys[] = {{0, 39, candidates, 1}};
+static const nfc_key_table_t keys = {sectorKeys, 1};
+
+static uint32_t bench_state = BENCH_SEED;
+
+static uint32_t bench_random(void)
+{
+    // xorshift32, the same taps on every run
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 17;
+    bench_state ^= bench_state << 5;
+    return bench_state;
+}
+
+static void bench_arrive(bench_arrival_t *arrival)
+{
+    if (arrival->card != NULL && pn532_time_now() >= arrival->arriveAt)
+    {
+        pn532_sim_present(arrival->sim, arrival->card);
+        arrival->card = NULL;
+    }
+}
+
+static void bench_select(void *ctx)
+{
+    bench_arrival_t *arrival = ctx;
+
+    bench_arrive(arrival);
+    arrival->inner->select(arrival->innerCtx);
+}
+
+static void bench_deselect(void *ctx)
+{
+    bench_arrival_t *arrival = ctx;
+
+    arrival->inner->deselect(arrival->innerCtx);
+}
+
+static void bench_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    bench_arrival_t *arrival = ctx;
+
+    arrival->inner->transfer(arrival->innerCtx, tx, rx, len);
+}
+
+static const pn532_transport_t bench_transport = {
+    .select = bench_select,
+    .deselect = bench_deselect,
+    .transfer = bench_transfer,
+};
+
+static int bench_compare(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double bench_percentile(const int64_t *sorted, int n, int p)
+{
+    return sorted[(int64_t)(n - 1) * p / 100] / 1000.0;
+}
+
+static bool bench_row(const bench_config_t *config, const bench_card_t *type, int taps, int64_t *latency)
+{
+    static uint8_t memory[4096];
+    static uint8_t readerId[READER_ID_LEN] = {1};
+    pn532_sim_timing_t timing = PN532_SIM_TIMING_DEFAULT;
+    // Each row gets a device of its own, a driver task can't be stopped
+    pn532_t *obj = calloc(1, sizeof(pn532_t));
+    pn532_sim_t *sim = calloc(1, sizeof(pn532_sim_t));
+    bench_arrival_t arrival = {0};
+    pn532_sim_card_t card;
+
+    if (obj == NULL || sim == NULL)
+        return false;
+
+    timing.spiHz = config->spiHz;
+    pn532_sim_init(obj, sim, &timing);
+    arrival.inner = obj->_transport;
+    arrival.innerCtx = obj->_transportCtx;
+    arrival.sim = sim;
+    pn532_transport_init(obj, &bench_transport, &arrival);
+
+    pn532_begin(obj);
+    if (!pn532_getFirmwareVersion(obj) || !pn532_SAMConfig(obj))
+        return false;
+    // With the lock, as nfc_setupReader sets up the driver task
+    if (config->async && (pn532_lock_init(obj) != ESP_OK || pn532_async_start(obj, 4, 6) != ESP_OK))
+        return false;
+
+    pn532_sim_card_init(&card, type->type, uid, type->type == PN532_SIM_CLASSIC_1K ? 4 : 7, memory, type->memorySize);
+    memset(&memory[type->dataOffset], 0x5A, CARD_DATA_LEN);
+    card.aid = aid;
+    card.aidLen = sizeof(aid);
+    nfc_clearKeyCache();
+
+    for (int i = 0; i < taps; i++)
+    {
+        log_data_t logData[NFC_MAX_CARDS];
+        uint8_t count;
+
+        nfc_clearTapCache();
+        arrival.card = &card;
+        arrival.arriveAt = pn532_time_now() + bench_random() % BENCH_ARRIVAL_US;
+
+        if (nfc_logCard(obj, logData, &count, readerId, &keys) || count != 1)
+        {
+            fprintf(stderr, "%s, %s: tap %d failed\n", config->name, type->name, i);
+            return false;
+        }
+        latency[i] = pn532_time_now() - arrival.arriveAt;
+        pn532_sim_remove(sim, &card);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int taps = argc > 1 ? atoi(argv[1]) : BENCH_TAPS_DEFAULT;
+    int64_t *latency;
+
+    if (taps <= 0)
+    {
+        fprintf(stderr, "usage: %s [taps per row]\n", argv[0]);
+        return 2;
+    }
+    latency = malloc(sizeof(*latency) * taps);
+    if (latency == NULL)
+        return 1;
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    printf("%d taps per row, tap-to-data in ms\n", taps);
+    printf("%-12s %-12s %8s %8s\n", "config", "card", "p50", "p99");
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++)
+    {
+        for (size_t t = 0; t < sizeof(cards) / sizeof(cards[0]); t++)
+        {
+            if (!bench_row(&configs[c], &cards[t], taps, latency))
+                return 1;
+            qsort(latency, taps, sizeof(*latency), bench_compare);
+            printf("%-12s %-12s %8.1f %8.1f\n", configs[c].name, cards[t].name,
+                   bench_percentile(latency, taps, 50), bench_percentile(latency, taps, 99));
+        }
+    }
+
+    free(latency);
+    return 0;
+}
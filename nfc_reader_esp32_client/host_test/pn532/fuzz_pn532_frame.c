@@ -0,0 +1,56 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pn532_frame.h"
+
+/*
+ * Decodes the input as a received byte stream, frame after frame, and
+ * checks what the driver relies on: a decoded frame lies inside the input,
+ * errors always drop at least one byte or ask for more, and every
+ * information frame encodes back to itself.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static uint8_t frame[PN532_FRAME_MAX_SIZE];
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        pn532_frame_view_t view;
+        pn532_frame_status_t status = pn532_frame_decode(data + pos, size - pos, &view);
+
+        if (status == PN532_FRAME_INCOMPLETE)
+        {
+            if (view.size <= size - pos)
+                abort();
+            break;
+        }
+        if (view.size > size - pos)
+            abort();
+
+        if (status == PN532_FRAME_OK && view.kind == PN532_FRAME_INFO)
+        {
+            pn532_frame_view_t again;
+            size_t len;
+
+            if (view.data < data + pos || view.data + view.dataLen > data + pos + view.size)
+                abort();
+            len = pn532_frame_encode(frame, sizeof(frame), view.tfi, view.data, view.dataLen);
+            if (len > 0 && (pn532_frame_decode(frame, len, &again) != PN532_FRAME_OK ||
+                            again.tfi != view.tfi || again.dataLen != view.dataLen ||
+                            memcmp(again.data, view.data, view.dataLen)))
+                abort();
+        }
+
+        if (view.size == 0)
+        {
+            // Only a lone start code half can be kept; nothing else follows it
+            if (status != PN532_FRAME_NO_START)
+                abort();
+            break;
+        }
+        pos += view.size;
+    }
+    return 0;
+}
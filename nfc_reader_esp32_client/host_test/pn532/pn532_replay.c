@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pn532.h"
+#include "pn532_frame.h"
+#include "pn532_trace.h"
+#include "esp_log.h"
+
+/*
+ * Replays a dumped bus trace (pn532_trace_dump output, e.g. a saved serial
+ * log) on the host:
+ *   pn532_replay <trace.txt> [out.vcd]
+ *
+ * Every recorded frame is decoded with the frame codec, and the commands
+ * the host wrote are sent again through the driver on the replay
+ * transport, which answers from the trace and counts written bytes that
+ * differ from it. Exits non-zero when the driver diverged from the trace.
+ * With out.vcd the trace is also exported for a waveform viewer.
+ */
+
+#define REPLAY_DECODE_RUNS  (1000)  // Passes over the trace for the decode timing
+#define REPLAY_TIMEOUT_MS   (1000)
+
+static pn532_trace_t trace;
+static uint8_t frame[PN532_TRACE_FRAME_MAX];
+
+static uint64_t replay_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Decodes the frame after the operation byte of a DW or DR record
+static bool replay_decode(const pn532_trace_rec_t *rec, pn532_frame_view_t *view, pn532_frame_status_t *status)
+{
+    if (rec->len < 2 || (frame[0] != PN532_SPI_DATAWRITE && frame[0] != PN532_SPI_DATAREAD))
+        return false;
+
+    *status = pn532_frame_decode(frame + 1, rec->len - 1, view);
+    return true;
+}
+
+static void replay_codec(void)
+{
+    uint32_t counts[PN532_FRAME_BAD_LEN + 1] = {0};
+    uint32_t frames = 0;
+    pn532_trace_iter_t it;
+    pn532_trace_rec_t rec;
+    pn532_frame_view_t view;
+    pn532_frame_status_t status;
+    uint64_t start;
+
+    pn532_trace_begin(&trace, &it);
+    while (pn532_trace_next(&trace, &it, &rec, frame, sizeof(frame)))
+    {
+        if (replay_decode(&rec, &view, &status))
+        {
+            counts[status]++;
+            frames++;
+        }
+    }
+
+    start = replay_ns();
+    for (int run = 0; run < REPLAY_DECODE_RUNS; run++)
+    {
+        pn532_trace_begin(&trace, &it);
+        while (pn532_trace_next(&trace, &it, &rec, frame, sizeof(frame)))
+            replay_decode(&rec, &view, &status);
+    }
+
+    printf("codec: %u frames, %u ok, %u incomplete, %u without start code, %u bad\n",
+           (unsigned)frames, (unsigned)counts[PN532_FRAME_OK], (unsigned)counts[PN532_FRAME_INCOMPLETE],
+           (unsigned)counts[PN532_FRAME_NO_START],
+           (unsigned)(counts[PN532_FRAME_BAD_LCS] + counts[PN532_FRAME_BAD_DCS] + counts[PN532_FRAME_BAD_LEN]));
+    if (frames > 0)
+        printf("codec: %.1f ns per frame (trace walk included)\n",
+               (double)(replay_ns() - start) / ((double)frames * REPLAY_DECODE_RUNS));
+}
+
+static bool replay_driver(void)
+{
+    static pn532_t obj;
+    static uint8_t cmds[PN532_TRACE_RING_SIZE];
+    pn532_trace_replay_t replay;
+    pn532_trace_iter_t it;
+    pn532_trace_rec_t rec;
+    pn532_frame_view_t view;
+    pn532_frame_status_t status;
+    pn532_frame_t response;
+    size_t used = 0;
+    uint32_t sent = 0;
+    uint32_t failed = 0;
+
+    // Collect the host commands first, the replay reads the trace itself
+    pn532_trace_begin(&trace, &it);
+    while (pn532_trace_next(&trace, &it, &rec, frame, sizeof(frame)))
+    {
+        if (frame[0] != PN532_SPI_DATAWRITE || !replay_decode(&rec, &view, &status))
+            continue;
+        if (status != PN532_FRAME_OK || view.kind != PN532_FRAME_INFO || view.tfi != PN532_HOSTTOPN532)
+            continue;
+        if (view.dataLen == 0 || used + 2 + view.dataLen > sizeof(cmds))
+            continue;
+        cmds[used++] = view.dataLen & 0xFF;
+        cmds[used++] = view.dataLen >> 8;
+        memcpy(&cmds[used], view.data, view.dataLen);
+        used += view.dataLen;
+    }
+
+    pn532_trace_replay(&obj, &replay, &trace);
+    for (size_t pos = 0; pos < used;)
+    {
+        uint16_t len = cmds[pos] | (cmds[pos + 1] << 8);
+
+        if (!pn532_command(&obj, &cmds[pos + 2], len, &response, REPLAY_TIMEOUT_MS))
+        {
+            printf("driver: command %02x failed\n", cmds[pos + 2]);
+            failed++;
+        }
+        sent++;
+        pos += 2 + len;
+    }
+
+    printf("driver: %u commands, %u failed, %u frames replayed, %u mismatches\n",
+           (unsigned)sent, (unsigned)failed, (unsigned)replay.frames, (unsigned)replay.mismatches);
+    return replay.mismatches == 0;
+}
+
+int main(int argc, char **argv)
+{
+    static char line[2 * PN532_TRACE_FRAME_MAX + 64];
+    FILE *in;
+    bool ok;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s <trace.txt> [out.vcd]\n", argv[0]);
+        return 2;
+    }
+    in = fopen(argv[1], "r");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    pn532_trace_init(&trace);
+    while (fgets(line, sizeof(line), in) != NULL)
+        pn532_trace_load(&trace, line);
+    fclose(in);
+    printf("trace: %u frames\n", (unsigned)trace.count);
+
+    replay_codec();
+    ok = replay_driver();
+
+    if (argc == 3)
+    {
+        FILE *out = fopen(argv[2], "w");
+
+        if (out == NULL)
+        {
+            perror(argv[2]);
+            return 1;
+        }
+        pn532_trace_vcd(&trace, out);
+        fclose(out);
+    }
+
+    return ok ? 0 : 1;
+}
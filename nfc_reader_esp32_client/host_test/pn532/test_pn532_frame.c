@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "pn532_frame.h"
+#include "host_test.h"
+
+static void test_roundtrip(uint16_t dataLen)
+{
+    static uint8_t data[PN532_FRAME_MAX_LEN];
+    static uint8_t frame[PN532_FRAME_MAX_SIZE];
+    pn532_frame_view_t view;
+    size_t size;
+
+    for (uint16_t i = 0; i < dataLen; i++)
+        data[i] = i * 7 + 3;
+
+    size = pn532_frame_encode(frame, sizeof(frame), 0xD4, data, dataLen);
+    CHECK(size > 0);
+    CHECK_EQ(frame[3] == 0xFF && frame[4] == 0xFF, dataLen + 1 > PN532_FRAME_NORMAL_MAX_LEN);
+
+    CHECK_EQ(pn532_frame_decode(frame, size, &view), PN532_FRAME_OK);
+    CHECK_EQ(view.kind, PN532_FRAME_INFO);
+    CHECK_EQ(view.tfi, 0xD4);
+    CHECK_EQ(view.dataLen, dataLen);
+    CHECK_EQ(view.size, size);
+    CHECK(memcmp(view.data, data, dataLen) == 0);
+
+    // Every prefix asks for more, never for less than it has
+    for (size_t len = 0; len < size; len++)
+    {
+        pn532_frame_status_t status = pn532_frame_decode(frame, len, &view);
+        CHECK(status == PN532_FRAME_INCOMPLETE || status == PN532_FRAME_NO_START);
+        if (status == PN532_FRAME_INCOMPLETE)
+            CHECK(view.size > len);
+    }
+}
+
+static void test_encode_limits(void)
+{
+    static uint8_t data[PN532_FRAME_MAX_LEN];
+    static uint8_t frame[PN532_FRAME_MAX_SIZE];
+
+    CHECK_EQ(pn532_frame_encode(frame, sizeof(frame), 0xD4, data, PN532_FRAME_MAX_LEN), 0);
+    CHECK_EQ(pn532_frame_encode(frame, 9, 0xD4, data, 2), 0);
+    CHECK_EQ(pn532_frame_encode(frame, 10, 0xD4, data, 2), 10);
+}
+
+static void test_control_frames(void)
+{
+    uint8_t frame[8];
+    pn532_frame_view_t view;
+
+    CHECK_EQ(pn532_frame_encode_ack(frame, sizeof(frame)), 6);
+    CHECK_EQ(pn532_frame_decode(frame, 6, &view), PN532_FRAME_OK);
+    CHECK_EQ(view.kind, PN532_FRAME_ACK);
+
+    CHECK_EQ(pn532_frame_encode_nack(frame, sizeof(frame)), 6);
+    CHECK_EQ(pn532_frame_decode(frame, 6, &view), PN532_FRAME_OK);
+    CHECK_EQ(view.kind, PN532_FRAME_NACK);
+
+    CHECK_EQ(pn532_frame_encode_error(frame, sizeof(frame)), 8);
+    CHECK_EQ(pn532_frame_decode(frame, 8, &view), PN532_FRAME_OK);
+    CHECK_EQ(view.kind, PN532_FRAME_ERROR);
+
+    CHECK_EQ(pn532_frame_encode_ack(frame, 5), 0);
+}
+
+static void test_resync(void)
+{
+    // Noise and no preamble before an ACK
+    const uint8_t noisy[] = {0x12, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+    // Response to GetFirmwareVersion without preamble
+    const uint8_t fw[] = {0x00, 0xFF, 0x06, 0xFA, 0xD5, 0x03, 0x32, 0x01, 0x06, 0x07, 0xE8, 0x00};
+    pn532_frame_view_t view;
+
+    CHECK_EQ(pn532_frame_decode(noisy, sizeof(noisy), &view), PN532_FRAME_OK);
+    CHECK_EQ(view.kind, PN532_FRAME_ACK);
+    CHECK_EQ(view.size, sizeof(noisy));
+
+    CHECK_EQ(pn532_frame_decode(fw, sizeof(fw), &view), PN532_FRAME_OK);
+    CHECK_EQ(view.tfi, 0xD5);
+    CHECK_EQ(view.dataLen, 5);
+    CHECK_EQ(view.data[1], 0x32);
+
+    // A trailing 00 is kept, it may start the next start code
+    CHECK_EQ(pn532_frame_decode(noisy, 3, &view), PN532_FRAME_NO_START);
+    CHECK_EQ(view.size, 2);
+}
+
+static void test_errors(void)
+{
+    const uint8_t badLcs[] = {0x00, 0x00, 0xFF, 0x03, 0xFC, 0xD5, 0x01, 0x2A, 0x00};
+    const uint8_t badDcs[] = {0x00, 0x00, 0xFF, 0x02, 0xFE, 0xD5, 0x01, 0x2B, 0x00};
+    const uint8_t zeroLen[] = {0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00};
+    pn532_frame_view_t view;
+
+    CHECK_EQ(pn532_frame_decode(badLcs, sizeof(badLcs), &view), PN532_FRAME_BAD_LCS);
+    CHECK(view.size > 0 && view.size <= sizeof(badLcs));
+    CHECK_EQ(pn532_frame_decode(badDcs, sizeof(badDcs), &view), PN532_FRAME_BAD_DCS);
+    CHECK(view.size > 0 && view.size <= sizeof(badDcs));
+    CHECK_EQ(pn532_frame_decode(zeroLen, sizeof(zeroLen), &view), PN532_FRAME_BAD_LEN);
+}
+
+static void test_extended_max_len(void)
+{
+    // LEN = 0xFFFF with a valid LCS: the data checksum has to end after
+    // 0x10000 bytes instead of wrapping its index around
+    static uint8_t buf[70000];
+    pn532_frame_view_t view;
+    pn532_frame_status_t status;
+
+    memset(buf, 0xA5, sizeof(buf));
+    memcpy(buf, (const uint8_t[]){0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x02}, 8);
+
+    CHECK_EQ(pn532_frame_decode(buf, 1000, &view), PN532_FRAME_INCOMPLETE);
+    CHECK_EQ(view.size, 8 + 0xFFFF + 2);
+
+    status = pn532_frame_decode(buf, sizeof(buf), &view);
+    CHECK(status == PN532_FRAME_OK || status == PN532_FRAME_BAD_DCS);
+}
+
+int main(void)
+{
+    test_roundtrip(0);
+    test_roundtrip(1);
+    test_roundtrip(PN532_FRAME_NORMAL_MAX_LEN - 1);
+    test_roundtrip(PN532_FRAME_NORMAL_MAX_LEN);
+    test_roundtrip(PN532_FRAME_MAX_LEN - 1);
+    test_encode_limits();
+    test_control_frames();
+    test_resync();
+    test_errors();
+    test_extended_max_len();
+    return 0;
+}
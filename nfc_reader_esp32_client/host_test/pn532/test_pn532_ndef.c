@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "pn532.h"
+#include "pn532_ndef.h"
+#include "pn532_sim.h"
+#include "esp_log.h"
+#include "host_test.h"
+
+#define MAD2_SECTOR     (16)
+#define PAYLOAD_LEN     (900)  // More than the data blocks of sectors 1-15 hold
+
+static const uint8_t uid4[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+static const uint8_t ndefKey[6] = PN532_NDEF_CLASSIC_KEY;
+static const uint8_t madKey[6] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5};
+
+// Writes data into the data blocks of the NDEF sectors from sector 1 on,
+// past the MAD sectors, as an NFC Forum formatted card lays it out
+static void write_ndef(uint8_t *classic, const uint8_t *data, uint16_t len)
+{
+    uint8_t sector = 1;
+    uint8_t block = 0;
+
+    for (uint16_t pos = 0; pos < len; pos += 16)
+    {
+        if (sector == MAD2_SECTOR)
+            sector++;
+        memcpy(&classic[(sector * 4 + block) * 16], &data[pos], len - pos < 16 ? len - pos : 16);
+        if (++block == 3)
+        {
+            block = 0;
+            sector++;
+        }
+    }
+}
+
+static void test_read_classic_4k(void)
+{
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t classic[4096];
+    static uint8_t tlv[16 + PAYLOAD_LEN];
+    static uint8_t buff[1024];
+    uint16_t msgLen = 1 + 1 + 4 + 1 + PAYLOAD_LEN;
+    uint16_t len = 0;
+    uint8_t uid[4];
+    pn532_sim_card_t card;
+    pn532_target_t target;
+    pn532_ndef_record_t record;
+
+    memset(&obj, 0, sizeof(obj));
+    pn532_sim_init(&obj, &sim, NULL);
+    pn532_begin(&obj);
+    CHECK(pn532_SAMConfig(&obj));
+
+    memcpy(uid, uid4, sizeof(uid));
+    pn532_sim_card_init(&card, PN532_SIM_CLASSIC_4K, uid, sizeof(uid), classic, sizeof(classic));
+
+    // Key A: MAD key in the MAD sectors, NDEF key in the others
+    for (int sector = 0; sector < 32; sector++)
+        memcpy(&classic[(sector * 4 + 3) * 16], sector == 0 || sector == MAD2_SECTOR ? madKey : ndefKey, 6);
+
+    // NDEF message TLV with a three byte length, one MIME record
+    tlv[len++] = 0x03;
+    tlv[len++] = 0xFF;
+    tlv[len++] = msgLen >> 8;
+    tlv[len++] = msgLen & 0xFF;
+    tlv[len++] = PN532_NDEF_MB | PN532_NDEF_ME | PN532_NDEF_TNF_MIME;
+    tlv[len++] = 1;
+    tlv[len++] = 0;
+    tlv[len++] = 0;
+    tlv[len++] = PAYLOAD_LEN >> 8;
+    tlv[len++] = PAYLOAD_LEN & 0xFF;
+    tlv[len++] = 'x';
+    for (int i = 0; i < PAYLOAD_LEN; i++)
+        tlv[len++] = i;
+    tlv[len++] = 0xFE;
+    write_ndef(classic, tlv, len);
+
+    CHECK(pn532_sim_present(&sim, &card));
+    CHECK_EQ(pn532_inListPassiveTargets(&obj, 1, &target, 0), 1);
+
+    CHECK(pn532_ndef_readClassic(&obj, uid, sizeof(uid), ndefKey, 1, buff, sizeof(buff), NULL, NULL, &record));
+    CHECK_EQ(record.tnf, PN532_NDEF_TNF_MIME);
+    CHECK_EQ(record.payloadLen, PAYLOAD_LEN);
+    CHECK_EQ(record.payload[0], 0);
+    CHECK_EQ(record.payload[PAYLOAD_LEN - 1], (PAYLOAD_LEN - 1) & 0xFF);
+}
+
+int main(void)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    test_read_classic_4k();
+    return 0;
+}
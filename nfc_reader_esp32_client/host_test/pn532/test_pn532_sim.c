@@ -0,0 +1,254 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "pn532.h"
+#include "pn532_sim.h"
+#include "card_reader_nfc.h"
+#include "esp_log.h"
+#include "host_test.h"
+
+static const uint8_t uid4[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+static const uint8_t uid7[7] = {0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06};
+static const uint8_t aid[] = NFC_ISODEP_AID;
+static uint8_t readerId[READER_ID_LEN] = {1};
+
+// The right key second, so the first tap of a Classic tries both
+static const nfc_key_t candidates[] = {
+    {NFC_KEY_A, {0x01, 0x02, 0x03, 0x04, 0x05, 0x06}},
+    {NFC_KEY_A, {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}},
+};
+static const nfc_sector_keys_t sectorKeys[] = {{0, 39, candidates, 2}};
+static const nfc_key_table_t keys = {sectorKeys, 1};
+
+static void setup(pn532_t *obj, pn532_sim_t *sim)
+{
+    memset(obj, 0, sizeof(*obj));
+    pn532_sim_init(obj, sim, NULL);
+    pn532_begin(obj);
+    CHECK_EQ(pn532_getFirmwareVersion(obj), 0x32010607);
+    CHECK(pn532_SAMConfig(obj));
+    nfc_clearKeyCache();
+    nfc_clearTapCache();
+}
+
+// Puts a card into the field once the virtual clock reaches arriveAt
+typedef struct {
+    const pn532_transport_t *inner;
+    void *innerCtx;
+    pn532_sim_t *sim;
+    pn532_sim_card_t *card;
+    int64_t arriveAt;
+} arrival_t;
+
+static void arrival_select(void *ctx)
+{
+    arrival_t *arrival = ctx;
+
+    if (arrival->card != NULL && pn532_time_now() >= arrival->arriveAt)
+    {
+        pn532_sim_present(arrival->sim, arrival->card);
+        arrival->card = NULL;
+    }
+    arrival->inner->select(arrival->innerCtx);
+}
+
+static void arrival_deselect(void *ctx)
+{
+    arrival_t *arrival = ctx;
+
+    arrival->inner->deselect(arrival->innerCtx);
+}
+
+static void arrival_transfer(void *ctx, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    arrival_t *arrival = ctx;
+
+    arrival->inner->transfer(arrival->innerCtx, tx, rx, len);
+}
+
+static const pn532_transport_t arrival_transport = {
+    .select = arrival_select,
+    .deselect = arrival_deselect,
+    .transfer = arrival_transfer,
+};
+
+static void test_log_classic_and_isodep(bool async)
+{
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t classic[1024];
+    static uint8_t file[300];
+    pn532_sim_card_t c1, c2;
+    log_data_t logData[NFC_MAX_CARDS];
+    uint8_t count;
+
+    setup(&obj, &sim);
+    // The firmware always pairs the driver task with the device lock
+    if (async)
+    {
+        CHECK_EQ(pn532_lock_init(&obj), ESP_OK);
+        CHECK_EQ(pn532_async_start(&obj, 4, 6), ESP_OK);
+    }
+
+    pn532_sim_card_init(&c1, PN532_SIM_CLASSIC_1K, uid4, sizeof(uid4), classic, sizeof(classic));
+    for (int i = 0; i < CARD_DATA_LEN; i++)
+        classic[CARD_DATA_FIRST_BLOCK * 16 + i] = i + 1;
+    pn532_sim_card_init(&c2, PN532_SIM_ISODEP, uid7, sizeof(uid7), file, sizeof(file));
+    c2.aid = aid;
+    c2.aidLen = sizeof(aid);
+    for (int i = 0; i < (int)sizeof(file); i++)
+        file[i] = 0x50 + i;
+
+    CHECK(pn532_sim_present(&sim, &c1));
+    CHECK(pn532_sim_present(&sim, &c2));
+    CHECK_EQ(nfc_logCard(&obj, logData, &count, readerId, &keys), 0);
+    CHECK_EQ(count, 2);
+    CHECK(memcmp(logData[0].cid, uid4, sizeof(uid4)) == 0);
+    CHECK_EQ(logData[0].data[0], 1);
+    CHECK_EQ(logData[0].data[CARD_DATA_LEN - 1], CARD_DATA_LEN);
+    CHECK_EQ(logData[1].cidLen, sizeof(uid7));
+    CHECK_EQ(logData[1].data[0], 0x50);
+    CHECK_EQ(logData[1].data[CARD_DATA_LEN - 1], 0x50 + CARD_DATA_LEN - 1);
+}
+
+static void test_log_ntag(void)
+{
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t ntag[540];
+    pn532_sim_card_t card;
+    log_data_t logData[NFC_MAX_CARDS];
+    uint8_t count;
+
+    setup(&obj, &sim);
+    pn532_sim_card_init(&card, PN532_SIM_NTAG215, uid7, sizeof(uid7), ntag, sizeof(ntag));
+    for (int i = 0; i < CARD_DATA_LEN; i++)
+        ntag[NFC_NTAG_DATA_FIRST_PAGE * 4 + i] = 0xA0 + i;
+
+    CHECK(pn532_sim_present(&sim, &card));
+    CHECK_EQ(nfc_logCard(&obj, logData, &count, readerId, &keys), 0);
+    CHECK_EQ(count, 1);
+    CHECK_EQ(logData[0].data[0], 0xA0);
+    CHECK_EQ(logData[0].data[CARD_DATA_LEN - 1], 0xA0 + CARD_DATA_LEN - 1);
+
+    // Left on the reader: not logged again
+    CHECK_EQ(nfc_logCard(&obj, logData, &count, readerId, &keys), 0);
+    CHECK_EQ(count, 0);
+}
+
+static void test_idle_locked_async(void)
+{
+    // As set up by nfc_setupReader: device lock and driver task. The card
+    // arrives after the first detection cycle, so nfc_logCard powers the
+    // PN532 down and resumes it while holding the lock.
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t ntag[540];
+    arrival_t arrival = {0};
+    pn532_sim_card_t card;
+    log_data_t logData[NFC_MAX_CARDS];
+    uint8_t count;
+
+    memset(&obj, 0, sizeof(obj));
+    pn532_sim_init(&obj, &sim, NULL);
+    arrival.inner = obj._transport;
+    arrival.innerCtx = obj._transportCtx;
+    arrival.sim = &sim;
+    pn532_transport_init(&obj, &arrival_transport, &arrival);
+    CHECK_EQ(pn532_lock_init(&obj), ESP_OK);
+    pn532_begin(&obj);
+    CHECK(pn532_SAMConfig(&obj));
+    CHECK_EQ(pn532_async_start(&obj, 4, 6), ESP_OK);
+    nfc_clearTapCache();
+
+    pn532_sim_card_init(&card, PN532_SIM_NTAG215, uid7, sizeof(uid7), ntag, sizeof(ntag));
+    ntag[NFC_NTAG_DATA_FIRST_PAGE * 4] = 0x42;
+    arrival.card = &card;
+    arrival.arriveAt = pn532_time_now() + 2000000;
+
+    CHECK_EQ(nfc_logCard(&obj, logData, &count, readerId, &keys), 0);
+    CHECK_EQ(count, 1);
+    CHECK_EQ(logData[0].data[0], 0x42);
+    CHECK(arrival.card == NULL);
+
+    // The same from a caller holding the lock itself
+    pn532_lock(&obj);
+    CHECK(pn532_powerDown(&obj, PN532_WAKEUP_SPI, false));
+    pn532_resume(&obj);
+    CHECK_EQ(pn532_getFirmwareVersion(&obj), 0x32010607);
+    pn532_unlock(&obj);
+}
+
+static void test_apdu_chaining(void)
+{
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t file[300];
+    uint8_t select[5 + sizeof(aid)] = {0x00, 0xA4, 0x04, 0x00, sizeof(aid)};
+    const uint8_t readBinary[] = {0x00, 0xB0, 0x00, 0x00, 0x00};
+    uint8_t resp[600];
+    uint16_t respLen, sw;
+    pn532_sim_card_t card;
+    pn532_target_t target;
+
+    setup(&obj, &sim);
+    pn532_sim_card_init(&card, PN532_SIM_ISODEP, uid7, sizeof(uid7), file, sizeof(file));
+    card.aid = aid;
+    card.aidLen = sizeof(aid);
+    for (int i = 0; i < (int)sizeof(file); i++)
+        file[i] = i;
+
+    CHECK(pn532_sim_present(&sim, &card));
+    CHECK_EQ(pn532_inListPassiveTargets(&obj, 1, &target, 0), 1);
+    memcpy(&select[5], aid, sizeof(aid));
+    CHECK(pn532_apdu(&obj, target.tg, select, sizeof(select), resp, sizeof(resp), &respLen, &sw));
+    CHECK_EQ(sw, PN532_SW_OK);
+
+    // Le = 00: 256 bytes, more than one frame
+    CHECK(pn532_apdu(&obj, target.tg, readBinary, sizeof(readBinary), resp, sizeof(resp), &respLen, &sw));
+    CHECK_EQ(sw, PN532_SW_OK);
+    CHECK_EQ(respLen, 256);
+    CHECK_EQ(resp[255], 255);
+}
+
+static void test_classic_4k(void)
+{
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t classic[4096];
+    uint8_t key[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t uid[4];
+    uint8_t block[16] = {9};
+    pn532_sim_card_t card;
+    pn532_target_t target;
+
+    setup(&obj, &sim);
+    memcpy(uid, uid4, sizeof(uid));
+    pn532_sim_card_init(&card, PN532_SIM_CLASSIC_4K, uid, sizeof(uid), classic, sizeof(classic));
+    CHECK(pn532_sim_present(&sim, &card));
+    CHECK_EQ(pn532_inListPassiveTargets(&obj, 1, &target, 0), 1);
+    CHECK_EQ(target.sak, 0x18);
+
+    // Block 200 lies in one of the 16 block sectors
+    CHECK(pn532_mifareclassic_AuthenticateBlock(&obj, uid, sizeof(uid), 200, 0, key));
+    CHECK(pn532_mifareclassic_WriteDataBlock(&obj, 200, block));
+    memset(block, 0, sizeof(block));
+    CHECK(pn532_mifareclassic_ReadDataBlock(&obj, 200, block));
+    CHECK_EQ(block[0], 9);
+    CHECK_EQ(classic[200 * 16], 9);
+
+    // Another sector isn't authenticated
+    CHECK(!pn532_mifareclassic_ReadDataBlock(&obj, 4, block));
+}
+
+int main(void)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    test_log_classic_and_isodep(false);
+    test_log_classic_and_isodep(true);
+    test_log_ntag();
+    test_idle_locked_async();
+    test_apdu_chaining();
+    test_classic_4k();
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pn532.h"
+#include "pn532_sim.h"
+#include "pn532_trace.h"
+#include "esp_log.h"
+#include "host_test.h"
+
+// Dump of the recorded session, left behind for the pn532_replay test
+#define TRACE_FILE "pn532_trace.txt"
+
+static const uint8_t uid4[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+// The driver calls that are recorded and then replayed
+static void session(pn532_t *obj, uint8_t *block)
+{
+    uint8_t key[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t uid[4];
+    pn532_target_t target;
+
+    memcpy(uid, uid4, sizeof(uid));
+    pn532_begin(obj);
+    CHECK_EQ(pn532_getFirmwareVersion(obj), 0x32010607);
+    CHECK(pn532_SAMConfig(obj));
+    CHECK_EQ(pn532_inListPassiveTargets(obj, 1, &target, 0), 1);
+    CHECK(memcmp(target.uid, uid4, sizeof(uid4)) == 0);
+    CHECK(pn532_mifareclassic_AuthenticateBlock(obj, uid, sizeof(uid), 4, 0, key));
+    CHECK(pn532_mifareclassic_ReadDataBlock(obj, 4, block));
+}
+
+static void record(pn532_trace_t *trace)
+{
+    static pn532_t obj;
+    static pn532_sim_t sim;
+    static uint8_t classic[1024];
+    uint8_t block[16];
+    pn532_sim_card_t card;
+
+    pn532_sim_init(&obj, &sim, NULL);
+    pn532_sim_card_init(&card, PN532_SIM_CLASSIC_1K, uid4, sizeof(uid4), classic, sizeof(classic));
+    for (int i = 0; i < 16; i++)
+        classic[4 * 16 + i] = 0x30 + i;
+    CHECK(pn532_sim_present(&sim, &card));
+
+    pn532_trace_init(trace);
+    pn532_trace_attach(&obj, trace);
+    session(&obj, block);
+    pn532_trace_detach(&obj, trace);
+
+    CHECK_EQ(block[15], 0x3F);
+    CHECK(trace->count > 0);
+    CHECK_EQ(trace->dropped, 0);
+}
+
+// pn532_trace_dump prints to stdout, send that to TRACE_FILE
+static void dump(pn532_trace_t *trace)
+{
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(TRACE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    CHECK(saved >= 0 && fd >= 0);
+    fflush(stdout);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    pn532_trace_dump(trace);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+static void load(pn532_trace_t *trace)
+{
+    static char line[2 * PN532_TRACE_FRAME_MAX + 64];
+    FILE *in = fopen(TRACE_FILE, "r");
+
+    CHECK(in != NULL);
+    pn532_trace_init(trace);
+    while (fgets(line, sizeof(line), in) != NULL)
+        pn532_trace_load(trace, line);
+    fclose(in);
+}
+
+static void test_dump_load(const pn532_trace_t *recorded, const pn532_trace_t *loaded)
+{
+    static uint8_t a[PN532_TRACE_FRAME_MAX], b[PN532_TRACE_FRAME_MAX];
+    pn532_trace_iter_t ia, ib;
+    pn532_trace_rec_t ra, rb;
+
+    CHECK_EQ(loaded->count, recorded->count);
+    pn532_trace_begin(recorded, &ia);
+    pn532_trace_begin(loaded, &ib);
+    while (pn532_trace_next(recorded, &ia, &ra, a, sizeof(a)))
+    {
+        CHECK(pn532_trace_next(loaded, &ib, &rb, b, sizeof(b)));
+        CHECK_EQ(rb.time, ra.time);
+        CHECK_EQ(rb.duration, ra.duration);
+        CHECK_EQ(rb.len, ra.len);
+        CHECK(memcmp(a, b, ra.len) == 0);
+    }
+}
+
+static void test_replay(const pn532_trace_t *trace)
+{
+    static pn532_t obj;
+    pn532_trace_replay_t replay;
+    uint8_t block[16] = {0};
+
+    // No PN532 behind it: every response comes from the trace
+    memset(&obj, 0, sizeof(obj));
+    pn532_trace_replay(&obj, &replay, trace);
+    session(&obj, block);
+
+    CHECK_EQ(block[0], 0x30);
+    CHECK_EQ(block[15], 0x3F);
+    CHECK(replay.frames > 0);
+    CHECK_EQ(replay.mismatches, 0);
+
+    // Past the end of the trace every command diverges
+    pn532_setPassiveActivationRetries(&obj, 0x10);
+    CHECK(replay.mismatches > 0);
+}
+
+static void test_vcd(const pn532_trace_t *trace)
+{
+    char line[64];
+    size_t edges = 0;
+    FILE *out = tmpfile();
+
+    CHECK(out != NULL);
+    pn532_trace_vcd(trace, out);
+    rewind(out);
+    CHECK(fgets(line, sizeof(line), out) != NULL);
+    CHECK(strcmp(line, "$timescale 1us $end\n") == 0);
+    while (fgets(line, sizeof(line), out) != NULL)
+        edges += strcmp(line, "0s\n") == 0;
+    fclose(out);
+
+    CHECK_EQ(edges, trace->count);
+}
+
+int main(void)
+{
+    static pn532_trace_t recorded, loaded;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    record(&recorded);
+    dump(&recorded);
+    load(&loaded);
+    test_dump_load(&recorded, &loaded);
+    test_replay(&loaded);
+    test_vcd(&loaded);
+    return 0;
+}
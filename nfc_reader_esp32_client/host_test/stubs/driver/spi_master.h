@@ -0,0 +1,51 @@
+#ifndef __HOST_DRIVER_SPI_MASTER_H__
+#define __HOST_DRIVER_SPI_MASTER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// No SPI host on the host: the bus accepts everything and reads zeros
+typedef int spi_host_device_t;
+typedef struct host_spi_device *spi_device_handle_t;
+
+#define SPI1_HOST (0)
+#define HSPI_HOST (1)
+#define VSPI_HOST (2)
+
+#define SPI_DEVICE_TXBIT_LSBFIRST (1 << 0)
+#define SPI_DEVICE_RXBIT_LSBFIRST (1 << 1)
+#define SPI_DEVICE_BIT_LSBFIRST   (SPI_DEVICE_TXBIT_LSBFIRST | SPI_DEVICE_RXBIT_LSBFIRST)
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+} spi_bus_config_t;
+
+typedef struct {
+    uint8_t mode;
+    int clock_speed_hz;
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct {
+    size_t length;           // Bits
+    const void *tx_buffer;
+    void *rx_buffer;
+} spi_transaction_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dmaChan);
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config, spi_device_handle_t *device);
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, uint32_t wait);
+void spi_device_release_bus(spi_device_handle_t device);
+esp_err_t spi_device_transmit(spi_device_handle_t device, spi_transaction_t *trans);
+esp_err_t spi_device_polling_transmit(spi_device_handle_t device, spi_transaction_t *trans);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+// One level for all tags, ESP_LOG_INFO until esp_log_level_set
+extern esp_log_level_t esp_log_host_level;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+void esp_log_buffer_hexdump_internal(const char *tag, const void *buffer, uint16_t length, esp_log_level_t level);
+
+#define ESP_LOG_HOST(level, letter, tag, format, ...)                      \
+    do                                                                     \
+    {                                                                      \
+        if (esp_log_host_level >= (level))                                 \
+            printf(letter " (%s) " format "\n", tag, ##__VA_ARGS__);       \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_HOST(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+
+#endif
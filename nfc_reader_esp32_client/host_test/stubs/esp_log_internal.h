@@ -0,0 +1,6 @@
+#ifndef __HOST_ESP_LOG_INTERNAL_H__
+#define __HOST_ESP_LOG_INTERNAL_H__
+
+#include "esp_log.h"
+
+#endif
@@ -0,0 +1,431 @@
+#define _GNU_SOURCE // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_log.h"
+
+#include "pn532_time.h"
+
+#ifndef PN532_VIRTUAL_CLOCK
+#error "The host stubs run FreeRTOS ticks on the PN532 virtual clock"
+#endif
+
+/*
+ * Tasks are threads, queues and semaphores are guarded by a mutex and a
+ * condition variable each. Delays move the virtual clock instead of
+ * sleeping; waits with a finite timeout wait that long in real time, so a
+ * wrong wait shows up as a slow test rather than a hang.
+ */
+
+#define HOST_TICK_US ((uint32_t)portTICK_PERIOD_MS * 1000)
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+typedef enum {
+    HOST_SEM_BINARY,
+    HOST_SEM_MUTEX,
+    HOST_SEM_RECURSIVE,
+} host_sem_kind_t;
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    host_sem_kind_t kind;
+    unsigned count;        // Binary: given, mutexes: takes by the owner
+    TaskHandle_t owner;
+    bool isStatic;
+};
+
+_Static_assert(sizeof(struct host_sem) <= sizeof(StaticSemaphore_t), "StaticSemaphore_t too small");
+
+esp_log_level_t esp_log_host_level = ESP_LOG_INFO;
+
+static struct host_task host_mainTask;
+static __thread struct host_task *host_currentTask;
+static pthread_mutex_t host_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// Waits on cond until ready() holds, the deadline passes (false) or forever
+static bool host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, bool (*ready)(void *), void *ctx)
+{
+    struct timespec deadline;
+
+    if (ticks != portMAX_DELAY)
+    {
+        uint64_t ns;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        ns = (uint64_t)deadline.tv_nsec + (uint64_t)ticks * HOST_TICK_US * 1000;
+        deadline.tv_sec += ns / 1000000000;
+        deadline.tv_nsec = ns % 1000000000;
+    }
+
+    while (!ready(ctx))
+    {
+        if (ticks == 0)
+            return false;
+        if (ticks == portMAX_DELAY)
+            pthread_cond_wait(cond, lock);
+        else if (pthread_cond_timedwait(cond, lock, &deadline) == ETIMEDOUT)
+            return ready(ctx);
+    }
+    return true;
+}
+
+/************** tasks */
+
+static void *host_taskMain(void *arg)
+{
+    struct host_task *task = arg;
+
+    host_currentTask = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *arg, UBaseType_t priority, TaskHandle_t *task)
+{
+    struct host_task *t = calloc(1, sizeof(*t));
+
+    if (t == NULL)
+        return pdFAIL;
+    t->fn = fn;
+    t->arg = arg;
+    if (pthread_create(&t->thread, NULL, host_taskMain, t) != 0)
+    {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(t->thread);
+    if (task != NULL)
+        *task = t;
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return host_currentTask != NULL ? host_currentTask : &host_mainTask;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    pn532_time_advance(ticks * HOST_TICK_US);
+    sched_yield();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(pn532_time_now() / HOST_TICK_US);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&host_critical);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&host_critical);
+}
+
+/************** queues */
+
+static bool host_queueNotEmpty(void *ctx)
+{
+    return ((struct host_queue *)ctx)->count > 0;
+}
+
+static bool host_queueNotFull(void *ctx)
+{
+    struct host_queue *queue = ctx;
+
+    return queue->count < queue->length;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+
+    if (queue == NULL)
+        return NULL;
+    queue->items = malloc((size_t)length * itemSize);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    bool ok;
+
+    pthread_mutex_lock(&queue->lock);
+    ok = host_wait(&queue->changed, &queue->lock, ticks, host_queueNotFull, queue);
+    if (ok)
+    {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+
+        memcpy(queue->items + (size_t)tail * queue->itemSize, item, queue->itemSize);
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    bool ok;
+
+    pthread_mutex_lock(&queue->lock);
+    ok = host_wait(&queue->changed, &queue->lock, ticks, host_queueNotEmpty, queue);
+    if (ok)
+    {
+        memcpy(item, queue->items + (size_t)queue->head * queue->itemSize, queue->itemSize);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+/************** semaphores */
+
+static SemaphoreHandle_t host_semInit(struct host_sem *sem, host_sem_kind_t kind, bool isStatic)
+{
+    if (sem == NULL)
+        return NULL;
+    memset(sem, 0, sizeof(*sem));
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->changed, NULL);
+    sem->kind = kind;
+    sem->isStatic = isStatic;
+    return sem;
+}
+
+static bool host_semAvailable(void *ctx)
+{
+    struct host_sem *sem = ctx;
+
+    switch (sem->kind)
+    {
+    case HOST_SEM_BINARY:
+        return sem->count > 0;
+    case HOST_SEM_RECURSIVE:
+        return sem->count == 0 || sem->owner == xTaskGetCurrentTaskHandle();
+    default:
+        return sem->count == 0;
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_semInit(malloc(sizeof(struct host_sem)), HOST_SEM_BINARY, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    return host_semInit((struct host_sem *)buffer, HOST_SEM_BINARY, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_semInit(malloc(sizeof(struct host_sem)), HOST_SEM_MUTEX, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return host_semInit(malloc(sizeof(struct host_sem)), HOST_SEM_RECURSIVE, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->changed);
+    if (!sem->isStatic)
+        free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    bool ok;
+
+    pthread_mutex_lock(&sem->lock);
+    ok = host_wait(&sem->changed, &sem->lock, ticks, host_semAvailable, sem);
+    if (ok && sem->kind == HOST_SEM_BINARY)
+    {
+        sem->count = 0;
+    }
+    else if (ok)
+    {
+        sem->owner = xTaskGetCurrentTaskHandle();
+        sem->count++;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    bool ok = true;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->kind == HOST_SEM_BINARY)
+    {
+        ok = sem->count == 0;
+        sem->count = 1;
+    }
+    else if (sem->count > 0 && sem->owner == xTaskGetCurrentTaskHandle())
+    {
+        if (--sem->count == 0)
+            sem->owner = NULL;
+    }
+    else
+    {
+        ok = false;
+    }
+    pthread_cond_broadcast(&sem->changed);
+    pthread_mutex_unlock(&sem->lock);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    if (woken != NULL)
+        *woken = pdFALSE;
+    return xSemaphoreGive(sem);
+}
+
+/************** GPIO and SPI, no hardware behind them */
+
+void gpio_pad_select_gpio(uint8_t gpio)
+{
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    return 1;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t isr, void *arg)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dmaChan)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config, spi_device_handle_t *device)
+{
+    static int devices[3];
+
+    *device = (spi_device_handle_t)&devices[host % 3];
+    return ESP_OK;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, uint32_t wait)
+{
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t device)
+{
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t device, spi_transaction_t *trans)
+{
+    if (trans->rx_buffer != NULL)
+        memset(trans->rx_buffer, 0, trans->length / 8);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t device, spi_transaction_t *trans)
+{
+    return spi_device_transmit(device, trans);
+}
+
+/************** logging */
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    esp_log_host_level = level;
+}
+
+void esp_log_buffer_hexdump_internal(const char *tag, const void *buffer, uint16_t length, esp_log_level_t level)
+{
+    const uint8_t *bytes = buffer;
+
+    if (esp_log_host_level < level)
+        return;
+    printf("(%s)", tag);
+    for (uint16_t i = 0; i < length; i++)
+        printf(" %02x", bytes[i]);
+    printf("\n");
+}
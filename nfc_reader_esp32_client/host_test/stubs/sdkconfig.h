@@ -0,0 +1,7 @@
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+// The options of the project's sdkconfig that the host build depends on
+#define CONFIG_FREERTOS_HZ 100
+
+#endif
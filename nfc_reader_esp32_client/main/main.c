@@ -3,6 +3,7 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -20,11 +21,14 @@
 #include "card_reader_gpio.h"
 #include "card_reader_wifi.h"
 #include "card_reader_nfc.h"
+#include "card_reader_allowlist.h"
 
 static const char* TAG = "main";
 
 #define ALIVE_MSG_INTERVAL_S 10
 #define READER_KEY_LEN 32
+#define LOG_QUEUE_LEN 8 // Logs of locally decided cards waiting for the server
+#define LOG_RETRY_S 10
 
 /**
 * Embeding binary and text files
@@ -38,80 +42,180 @@ extern const char rkey_seed_txt_end[]   asm("_binary_rkey_seed_txt_end");
 SemaphoreHandle_t httpSemaphore = NULL;
 SemaphoreHandle_t indLedSemaphore = NULL;
 
+/**
+* Logs of cards decided locally (allowlist or cached server decision), sent to the server in the background
+*/
+typedef struct {
+  log_data_t logData;
+  uint8_t decision; // ALLOWLIST_GRANT or ALLOWLIST_DENY given locally
+  bool cached; // Decided by the decision cache, not the allowlist
+} card_log_t;
+
+QueueHandle_t logQueue = NULL;
+
 /**
 * Global variables of the Main component
 */
-static pn532_t nfc; // PN532 module struct
+static pn532_t nfc[NFC_READER_COUNT]; // PN532 module structs
 
-uint8_t keyA[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }; // Key A to acess data on card
+// Keys to access data on cards, the key that worked last is tried first
+static const nfc_key_t cardKeys[] = {
+  { NFC_KEY_A, { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } }, // Transport key
+};
+static const nfc_sector_keys_t cardKeyTable[] = {
+  { 0, NFC_CLASSIC_SECTORS - 1, cardKeys, sizeof(cardKeys) / sizeof(cardKeys[0]) },
+};
+static const nfc_key_table_t keys = { cardKeyTable, sizeof(cardKeyTable) / sizeof(cardKeyTable[0]) };
 uint8_t rid[] = { 0x12, 0x34, 0x56, 0x78, 0x12, 0x34, 0x56, 0x78 }; // Reader ID
 uint8_t rkey[READER_KEY_LEN]; // Reader Key
 
 char responseBuffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
 
+/**
+*  @brief Indicate to a user if the access was granted
+*
+*  @param granted   true to flash green, false to flash red
+*/
+void indicateAccess(bool granted) {
+  // Check if Indicator LED resource is avalible
+  if(xSemaphoreTake(indLedSemaphore, portMAX_DELAY) == pdTRUE) {
+    if(granted) {
+      gpio_setIndicatorLed(LED_GREEN);
+      ESP_LOGI(TAG, "ACCESS GRANTED");
+    }
+    else {
+      gpio_setIndicatorLed(LED_RED);
+      ESP_LOGI(TAG, "ACCESS DENIED");
+    }
+    vTaskDelay(500 / portTICK_PERIOD_MS); // Flash lasts 0.5s
+    gpio_setIndicatorLed(LED_OFF);
+
+    xSemaphoreGive(indLedSemaphore); // Free Indicator LED reasource
+  }
+}
+
+/**
+*  @brief Send log data of one card to a remote server and get its response
+*
+*  @param logData   Pointer to struct holding log data of the card
+*  @param resp      Pointer to struct to store the response to
+*
+*  @return Error code (0 = success)
+*/
+uint8_t exchangeCardLog(log_data_t *logData, http_response_t *resp) {
+  // Convert log data and Reader Key to REST API string
+  char queryStr[MAX_HTTP_URL_BUFFER];
+  char rkeyStr[READER_KEY_LEN*2+8]; // "rkey=0x", hex digits and terminator
+  if(nfc_logDataToApiString(logData, queryStr, sizeof(queryStr)) == NULL ||
+     nfc_arrayToApiString("rkey", rkey, READER_KEY_LEN, rkeyStr, sizeof(rkeyStr)) == NULL) {
+    return 1;
+  }
+
+  // Check if HTTP resource is avalible
+  if(xSemaphoreTake(httpSemaphore, portMAX_DELAY) == pdTRUE) {
+    // Send data to server and get response
+    uint8_t err = wifi_httpsExchangeData(resp, responseBuffer, queryStr, rkeyStr);
+    xSemaphoreGive(httpSemaphore); // Free HTTP resource
+    // Remember the decision for repeat taps as long as the server allows
+    if(!err) {
+      wifi_cacheUpdate(logData->cid, logData->cidLen, logData->data, CARD_DATA_LEN, resp);
+    }
+    return err;
+  }
+  ESP_LOGE(TAG, "HTTP reasource occupied. Couldn't send log data message");
+  return 1;
+}
+
+/**
+*  @brief Send log data of one card to a remote server, process response and indicate it to a user
+*
+*  @param logData   Pointer to struct holding log data of the card
+*/
+void sendCardLog(log_data_t *logData) {
+  http_response_t resp;
+  // Check errors
+  if(exchangeCardLog(logData, &resp)) {
+    ESP_LOGE(TAG, "Log data message response failed");
+
+    // Double red flash
+    gpio_setIndicatorLed(LED_RED);
+    vTaskDelay(200 / portTICK_PERIOD_MS); // Flash lasts 0.2s
+    gpio_setIndicatorLed(LED_OFF);
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    gpio_setIndicatorLed(LED_RED);
+    vTaskDelay(200 / portTICK_PERIOD_MS); // Flash lasts 0.2s
+    gpio_setIndicatorLed(LED_OFF);
+  }
+  else {
+    // Print response
+    wifi_printResponse(&resp);
+    // Indicate if the access was granted to a user
+    indicateAccess(resp.apiCode == 100);
+  }
+}
+
+/**
+*  @brief Task sending logs of locally decided cards to the server and reporting
+*         when the server decides otherwise (outdated snapshot or changed decision)
+*/
+void logSyncTask(void *pvParameter) {
+  static http_response_t resp;
+  card_log_t entry;
+  ESP_LOGI(TAG, "Log Sync task runs!");
+  // Infinite loop
+  while (1) {
+    if(xQueueReceive(logQueue, &entry, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    // Keep trying while the server is unreachable, new logs wait in the queue
+    while(exchangeCardLog(&entry.logData, &resp)) {
+      ESP_LOGW(TAG, "Log of a locally decided card not delivered, retrying");
+      vTaskDelay((LOG_RETRY_S*1000) / portTICK_PERIOD_MS);
+    }
+    if((resp.apiCode == 100) != (entry.decision == ALLOWLIST_GRANT)) {
+      if(entry.cached)
+        ESP_LOGW(TAG, "Server changed its decision for a cached card");
+      else
+        ESP_LOGW(TAG, "Server decision differs from allowlist #%u", allowlist_sequence());
+    }
+  }
+
+}
+
 /**
 *  @brief Task reading card data, sending it to a remote server, processing response and indicating it to a user
+*
+*  @param pvParameter   Pointer to the PN532 module struct the task polls
 */
 void cardReadTask(void *pvParameter) {
+  pn532_t *reader = (pn532_t *) pvParameter;
   ESP_LOGI(TAG, "Card Read task runs!");
   // Infinite loop
   while (1) {
-    // Wait for card and log data
-    log_data_t logData;
-    if(nfc_logCard(&nfc, &logData, rid, keyA)) {
+    // Wait for cards and log data, cards presented together are logged one by one
+    log_data_t logData[NFC_MAX_CARDS];
+    uint8_t cardCount;
+    if(nfc_logCard(reader, logData, &cardCount, rid, &keys)) {
       ESP_LOGE(TAG, "Loging card failed");
     }
-    else {
-      // Convert log data and Reader Key to REST API string
-      char queryStr[MAX_HTTP_URL_BUFFER];
-      nfc_logDataToApiString(&logData, queryStr);
-      char rkeyStr[READER_KEY_LEN*2+7];
-      nfc_arrayToApiString(NULL, "rkey", rkey, READER_KEY_LEN, rkeyStr);
-
-      // Check if HTTP resource is avalible
-      if(xSemaphoreTake(httpSemaphore, portMAX_DELAY) == pdTRUE) {
-        // Send data to server and get response
-        http_response_t resp;
-        uint8_t err = wifi_httpsExchangeData(&resp, responseBuffer, queryStr, rkeyStr);
-        xSemaphoreGive(httpSemaphore); // Free HTTP resource
-        // Check errors
-        if(err) {
-          ESP_LOGE(TAG, "Log data message response failed");
-
-          // Double red flash
-          gpio_setIndicatorLed(LED_RED);
-          vTaskDelay(200 / portTICK_PERIOD_MS); // Flash lasts 0.2s
-          gpio_setIndicatorLed(LED_OFF);
-          vTaskDelay(100 / portTICK_PERIOD_MS);
-          gpio_setIndicatorLed(LED_RED);
-          vTaskDelay(200 / portTICK_PERIOD_MS); // Flash lasts 0.2s
-          gpio_setIndicatorLed(LED_OFF);
-        }
-        else {
-          // Print response
-          wifi_printResponse(&resp);
-          // Check if Indicator LED resource is avalible
-          if(xSemaphoreTake(indLedSemaphore, portMAX_DELAY) == pdTRUE) {
-            // Indicate if the access was granted to a user
-            if(resp.apiCode == 100) {
-              gpio_setIndicatorLed(LED_GREEN);
-              ESP_LOGI(TAG, "ACCESS GRANTED");
-            }
-            else {
-              gpio_setIndicatorLed(LED_RED);
-              ESP_LOGI(TAG, "ACCESS DENIED");
-            }
-            vTaskDelay(500 / portTICK_PERIOD_MS); // Flash lasts 0.5s
-            gpio_setIndicatorLed(LED_OFF);
-
-            xSemaphoreGive(indLedSemaphore); // Free Indicator LED reasource
-          }
-        }
+    for(int i = 0; i < cardCount; ++i) {
+      // The allowlist or a recent server decision decides without a round trip, other cards ask the server
+      uint8_t decision = allowlist_lookup(logData[i].cid, logData[i].cidLen, logData[i].data, CARD_DATA_LEN);
+      bool cached = false;
+      uint32_t apiCode;
+      if(decision == ALLOWLIST_UNKNOWN && wifi_cacheLookup(logData[i].cid, logData[i].cidLen, logData[i].data, CARD_DATA_LEN, &apiCode)) {
+        decision = apiCode == 100 ? ALLOWLIST_GRANT : ALLOWLIST_DENY;
+        cached = true;
       }
-      else {
-        ESP_LOGE(TAG, "HTTP reasource occupied. Couldn't send log data message");
+      if(decision == ALLOWLIST_UNKNOWN) {
+        sendCardLog(&logData[i]);
+        continue;
       }
-
+      card_log_t entry = { logData[i], decision, cached };
+      if(xQueueSend(logQueue, &entry, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Log queue full, log of a locally decided card dropped");
+      }
+      indicateAccess(decision == ALLOWLIST_GRANT);
     }
   }
 
@@ -128,10 +232,13 @@ void aliveTask(void *pvParameter) {
     vTaskDelay((ALIVE_MSG_INTERVAL_S*1000) / portTICK_PERIOD_MS);
 
     // Convert reader ID and key to REST API string
-    char rkeyStr[READER_KEY_LEN*2+7];
-    nfc_arrayToApiString(NULL, "rkey", rkey, READER_KEY_LEN, rkeyStr);
-    char queryStr[READER_ID_LEN*2+7];
-    nfc_arrayToApiString(NULL, "rid", rid, READER_ID_LEN, queryStr);
+    char rkeyStr[READER_KEY_LEN*2+8]; // "rkey=0x", hex digits and terminator
+    char queryStr[READER_ID_LEN*2+7]; // "rid=0x", hex digits and terminator
+    if(nfc_arrayToApiString("rkey", rkey, READER_KEY_LEN, rkeyStr, sizeof(rkeyStr)) == NULL ||
+       nfc_arrayToApiString("rid", rid, READER_ID_LEN, queryStr, sizeof(queryStr)) == NULL) {
+      ESP_LOGE(TAG, "Alive message couldn't be encoded");
+      continue;
+    }
 
     // Check if HTTP resource is avalible
     if(xSemaphoreTake(httpSemaphore, portMAX_DELAY) == pdTRUE) {
@@ -248,7 +355,8 @@ void app_main() {
   // Setups
   gpio_setup();
   wifi_setup();
-  nfc_setup(&nfc);
+  nfc_setupReaders(nfc);
+  allowlist_setup();
 
   // Generate Reader Key from Reader ID and seed
   generateReaderKey(rid, rkey_seed_txt_start, rkey);
@@ -257,9 +365,13 @@ void app_main() {
   // Set semaphores
   vSemaphoreCreateBinary(httpSemaphore);
   vSemaphoreCreateBinary(indLedSemaphore);
+  logQueue = xQueueCreate(LOG_QUEUE_LEN, sizeof(card_log_t));
 
   // Start tasks
-  xTaskCreate(&cardReadTask, "card_read_task", 8192, NULL, 5, NULL);
+  for(int i = 0; i < NFC_READER_COUNT; ++i) {
+    xTaskCreate(&cardReadTask, "card_read_task", 8192, &nfc[i], 5, NULL);
+  }
   xTaskCreate(&aliveTask, "alive_task", 10*1024, NULL, 5, NULL);
+  xTaskCreate(&logSyncTask, "log_sync_task", 10*1024, NULL, 5, NULL);
   xTaskCreate(&batteryWarningTask, "battery_warning_task", 4096, NULL, 5, NULL);
 }